@@ -29,10 +29,15 @@
 #include <wx/dcbuffer.h>
 #include <wx/stdpaths.h>
 #include <wx/filename.h>
+#include <wx/timer.h>
+#include <wx/numdlg.h>
+
+#include <thread>
 
 #include "netlist.h"
 #include "devices.h"
-#include <fstream>
+#include "journal.h"
+#include "parallel.h"
 
 // ----------------------------------------------------------------------------
 // constants
@@ -42,6 +47,13 @@
 #define SW_COPYRIGHT_STR       "(C) 2010-2025"
 #define HELP_PAGE              "https://github.com/f18m/netlist-viewer/issues"
 
+// how often (in milliseconds) the canvas shows the progress of a placement
+#define PLACEMENT_POLL_INTERVAL     50
+
+// the netlists whose top-level circuit has more devices than this are
+// automatically split in sheets of (at most about) this size
+#define SHEET_MAX_DEVICES           2000
+
 // file dialog filters
 #define FILTER_NETLISTVIEWERSCHEMATIC_FILES \
     "NetlistViewer schematic (*.nvs)|*.nvs"
@@ -64,6 +76,23 @@ enum
     SpiceViewer_ShowGrid = wxID_HIGHEST+1,
     SpiceViewer_OpenNVS,
     SpiceViewer_Export,
+    SpiceViewer_NetConnections,
+    SpiceViewer_ConnectedComponents,
+    SpiceViewer_ShortestPath,
+    SpiceViewer_PlaceNonOverlapped,
+    SpiceViewer_PlacePackByKind,
+    SpiceViewer_PlacePackByCluster,
+    SpiceViewer_PlaceForceDirected,
+    SpiceViewer_PlaceKamadaKawai,
+    SpiceViewer_PlaceMultilevel,
+    SpiceViewer_PlaceQuadratic,
+    SpiceViewer_PlaceAnnealing,
+    SpiceViewer_PlaceLayered,
+    SpiceViewer_StopPlacement,
+    SpiceViewer_RouteWires,
+    SpiceViewer_SplitSheets,
+    SpiceViewer_NextSheet,
+    SpiceViewer_PreviousSheet,
     SpiceViewer_OpenNetlist = wxID_OPEN,
     SpiceViewer_Quit = wxID_EXIT,
 
@@ -95,24 +124,98 @@ public:
 class SpiceViewerCanvas: public wxScrolledCanvas
 {
 public:
-    SpiceViewerCanvas(wxFrame *parent);
+    SpiceViewerCanvas(wxFrame *parent, svLayoutStore* layouts);
+    ~SpiceViewerCanvas()
+        { AbortPlacement(); }
 
     void OnPaint(wxPaintEvent &event);
     void OnMouseMove(wxMouseEvent &event);
     void OnMouseDown(wxMouseEvent &event);
     void OnMouseUp(wxMouseEvent &event);
     void OnMouseWheel(wxMouseEvent &event);
+    void OnPlacementTimer(wxTimerEvent &event);
 
     void SetCircuit(const svCircuit& ckt)
     { 
+        AbortPlacement();
+        m_journal.close();
         m_ckt = ckt; 
+        if (m_bRouteWires)
+            RouteNets();
         UpdateVirtualSize();
         UpdateGraphics();
+        UpdateLabelExtent();
+    }
+
+    //! Starts journaling all layout edits of the current circuit, which
+    //! has been loaded from (or saved to) the given NVS file.
+    void OpenJournal(const wxString& nvsFilename)
+    {
+        m_journal.open(m_ckt, nvsFilename.ToStdString());
+        UpdateVirtualSize();
+        Refresh();
     }
 
     const svCircuit& GetCircuit() const
         { return m_ckt; }
 
+    //! Places again all devices of the current circuit using the given algorithm.
+    //! The placement runs in a secondary thread: meanwhile the canvas shows the
+    //! layout as it improves and the devices can't be dragged.
+    void PlaceDevices(svPlaceAlgorithm ag)
+    {
+        AbortPlacement();
+
+        m_placedCkt = m_ckt;
+        m_progress.reset();
+        m_snapshotSeq = 0;
+        m_placementDone = false;
+        m_placementThread = std::thread([this, ag]() {
+            m_placedCkt.placeDevices(ag, &m_progress);
+            m_placementDone = true;
+        });
+
+        m_placementTimer.Start(PLACEMENT_POLL_INTERVAL);
+        wxLogStatus("Placing the devices... press Esc to keep the current layout");
+    }
+
+    //! Returns true while a placement started by PlaceDevices() is running.
+    bool IsPlacing() const
+        { return m_placementThread.joinable(); }
+
+    //! Asks the running placement to stop: the layout it reached is kept.
+    void StopPlacement()
+    {
+        if (IsPlacing())
+            m_progress.requestStop();
+    }
+
+    //! Stops the running placement (if any) and discards its layout.
+    void AbortPlacement()
+    {
+        if (!IsPlacing())
+            return;
+
+        m_progress.requestStop();
+        m_placementThread.join();
+        m_placementTimer.Stop();
+    }
+
+    //! Moves all devices of the current circuit to the given positions.
+    void SetLayout(const std::vector<wxPoint>& positions, const std::vector<svRotation>& rotations)
+    {
+        const svBaseDeviceArray& devices = m_ckt.getDevices();
+        for (size_t i=0; i<devices.size(); i++)
+        {
+            devices[i]->setRotation(rotations[i]);
+            devices[i]->setGridPosition(positions[i]);
+        }
+
+        m_ckt.updateBoundingBox();
+        UpdateVirtualSize();
+        Refresh();
+    }
+
     //! Updates all graphic objects cached in the current circuit (sub)objects.
     //! This function needs to be called only on new circuit (see SetCircuit())
     //! and in case the grid size has been changed (see OnMouseWheel()).
@@ -126,6 +229,65 @@ public:
         delete gc;
     }
 
+    //! Updates the size (in pixels) of the longest label of the current circuit;
+    //! see GetDraggedDeviceRegion().
+    void UpdateLabelExtent()
+    {
+        size_t len = 0;
+        const svBaseDeviceArray& devices = m_ckt.getDevices();
+        for (size_t i=0; i<devices.size(); i++)
+            len = std::max(len, devices[i]->getDescription().length());
+        for (size_t i=0; i<m_ckt.getNodesCount(); i++)
+            len = std::max(len, m_ckt.getNodeName(i).length());
+
+        wxClientDC dc(this);
+        dc.SetFont(*wxSWISS_FONT);
+        wxSize sz = dc.GetTextExtent(wxString('W', len));
+        m_labelExtent = std::max(sz.GetWidth(), sz.GetHeight());
+    }
+
+    //! Returns the area (in unscrolled pixel coordinates) covered by the dragged
+    //! device, by the wires of its nets and by their labels.
+    wxRect GetDraggedDeviceRegion() const
+    {
+        wxRect rc = m_ckt.getDeviceCells(m_idxDraggedDev, m_pDraggedDev->getGridPosition());
+        const svHyperGraph& hg = m_ckt.getHyperGraph();
+        for (const unsigned int* net = hg.getDeviceNetsBegin(m_idxDraggedDev);
+             net != hg.getDeviceNetsEnd(m_idxDraggedDev); net++)
+            rc.Union(m_ckt.getNetBoundingBox(*net));
+
+        return GridToPixels(rc);
+    }
+
+    //! Converts the given area in grid coordinates to unscrolled pixel
+    //! coordinates, enlarging it to include the labels drawn next to it.
+    wxRect GridToPixels(const wxRect& rc) const
+    {
+        const int grid = m_gridSize;
+        return wxRect(rc.x*grid, rc.y*grid, rc.width*grid, rc.height*grid)
+                    .Inflate(m_labelExtent + grid, m_labelExtent + grid);
+    }
+
+    //! Refreshes only the given area (previously covered by the dragged device,
+    //! see GetDraggedDeviceRegion()) and the area it covers now, rerouting
+    //! only the nets it's attached to and the ones running through it.
+    void RefreshDraggedDevice(const wxRect& before)
+    {
+        wxRect rc = before;
+        if (m_bRouteWires)
+        {
+            wxRect damaged;
+            m_ckt.rerouteDirtyNets(&damaged);
+            if (!damaged.IsEmpty())
+                rc.Union(GridToPixels(damaged));
+        }
+        UpdateVirtualSize();
+
+        rc.Union(GetDraggedDeviceRegion());
+        rc.SetPosition(CalcScrolledPosition(rc.GetPosition()));
+        RefreshRect(rc, false);
+    }
+
     void UpdateVirtualSize()
     {
         wxRect rc = m_ckt.getBoundingBox();
@@ -139,16 +301,52 @@ public:
         Refresh();
     }
 
+    //! Draws the nets with orthogonal wires (routed again after each change
+    //! of the layout) or with airwires.
+    void RouteWires(bool b)
+    {
+        m_bRouteWires = b;
+        if (b)
+            RouteNets();
+        else
+            m_ckt.clearRoutes();
+        Refresh();
+    }
+
+    //! Routes all nets of the current circuit.
+    void RouteNets()
+    {
+        size_t conflicts = m_ckt.routeNets();
+        if (conflicts)
+            wxLogStatus("Routing completed: %lu nets share some wires with other ones", (unsigned long)conflicts);
+        else
+            wxLogStatus("Routing completed");
+    }
+
 private:        // misc vars
     svCircuit m_ckt;
+    svEditJournal m_journal;
     unsigned int m_gridSize;
     wxPen m_gridPen;
     bool m_bShowGrid;
+    bool m_bRouteWires;
+    int m_labelExtent;                  // in pixels, see UpdateLabelExtent()
 
 private:        // vars for dragging
     svBaseDevice* m_pDraggedDev;
     wxPoint m_ptDraggedDevOffset; // in pixel coords
     int m_idxDraggedDev;
+    wxPoint m_ptDraggedDevOrigPos; // in grid coords
+    svRotation m_rotDraggedDevOrig;
+
+private:        // vars for the placement running in background
+    svCircuit m_placedCkt;              // the copy of m_ckt being placed
+    std::thread m_placementThread;
+    std::atomic<bool> m_placementDone;
+    svPlacementProgress m_progress;
+    unsigned long m_snapshotSeq;        // the last snapshot shown
+    wxTimer m_placementTimer;
+    svLayoutStore* m_layouts;           // where the final layouts are stored
 
     wxDECLARE_EVENT_TABLE();
 };
@@ -166,12 +364,42 @@ public:
     void OnExportNVS(wxCommandEvent& event);
     void OnQuit(wxCommandEvent& event);
 
+    void OnNetConnections(wxCommandEvent& event);
+    void OnConnectedComponents(wxCommandEvent& event);
+    void OnShortestPath(wxCommandEvent& event);
+
+    void OnPlaceDevices(wxCommandEvent& event);
+    void OnStopPlacement(wxCommandEvent& event);
+    void OnUpdateStopPlacement(wxUpdateUIEvent& event);
+    void OnRouteWires(wxCommandEvent& event);
+
+    void OnSplitSheets(wxCommandEvent& event);
+    void OnChangeSheet(wxCommandEvent& event);
+    void OnUpdateChangeSheet(wxUpdateUIEvent& event);
+
     void OnHelp(wxCommandEvent& event);
     void OnAbout(wxCommandEvent& event);
 
 private:
     SpiceViewerCanvas* m_canvas;
 
+    //! The layouts of the circuits shown so far: the subcircuits opened later
+    //! with the same structure reuse them instead of being placed again.
+    svLayoutStore m_layouts;
+
+    //! The circuit split in m_sheets (empty if it's not split) and its sheets,
+    //! each placed on its own: the canvas shows the sheet m_currentSheet.
+    svCircuit m_unsplitCkt;
+    svCircuitArray m_sheets;
+    size_t m_currentSheet;
+
+    //! Splits the given circuit in the given number of sheets, places them and
+    //! shows the first one.
+    void SplitIntoSheets(const svCircuit& ckt, unsigned int nSheets);
+
+    //! Shows the given sheet, saving in m_sheets the changes done to the current one.
+    void ShowSheet(size_t idx);
+
     wxDECLARE_EVENT_TABLE();
 };
 
@@ -256,6 +484,29 @@ wxBEGIN_EVENT_TABLE(SpiceViewerFrame, wxFrame)
     EVT_MENU(SpiceViewer_Export,      SpiceViewerFrame::OnExportNVS)
     EVT_MENU(SpiceViewer_Quit,        SpiceViewerFrame::OnQuit)
 
+    EVT_MENU(SpiceViewer_NetConnections,      SpiceViewerFrame::OnNetConnections)
+    EVT_MENU(SpiceViewer_ConnectedComponents, SpiceViewerFrame::OnConnectedComponents)
+    EVT_MENU(SpiceViewer_ShortestPath,        SpiceViewerFrame::OnShortestPath)
+
+    EVT_MENU(SpiceViewer_PlaceNonOverlapped,  SpiceViewerFrame::OnPlaceDevices)
+    EVT_MENU(SpiceViewer_PlacePackByKind,     SpiceViewerFrame::OnPlaceDevices)
+    EVT_MENU(SpiceViewer_PlacePackByCluster,  SpiceViewerFrame::OnPlaceDevices)
+    EVT_MENU(SpiceViewer_PlaceForceDirected,  SpiceViewerFrame::OnPlaceDevices)
+    EVT_MENU(SpiceViewer_PlaceKamadaKawai,    SpiceViewerFrame::OnPlaceDevices)
+    EVT_MENU(SpiceViewer_PlaceMultilevel,     SpiceViewerFrame::OnPlaceDevices)
+    EVT_MENU(SpiceViewer_PlaceQuadratic,      SpiceViewerFrame::OnPlaceDevices)
+    EVT_MENU(SpiceViewer_PlaceAnnealing,      SpiceViewerFrame::OnPlaceDevices)
+    EVT_MENU(SpiceViewer_PlaceLayered,        SpiceViewerFrame::OnPlaceDevices)
+    EVT_MENU(SpiceViewer_StopPlacement,       SpiceViewerFrame::OnStopPlacement)
+    EVT_UPDATE_UI(SpiceViewer_StopPlacement,  SpiceViewerFrame::OnUpdateStopPlacement)
+    EVT_MENU(SpiceViewer_RouteWires,          SpiceViewerFrame::OnRouteWires)
+
+    EVT_MENU(SpiceViewer_SplitSheets,         SpiceViewerFrame::OnSplitSheets)
+    EVT_MENU(SpiceViewer_NextSheet,           SpiceViewerFrame::OnChangeSheet)
+    EVT_MENU(SpiceViewer_PreviousSheet,       SpiceViewerFrame::OnChangeSheet)
+    EVT_UPDATE_UI(SpiceViewer_NextSheet,      SpiceViewerFrame::OnUpdateChangeSheet)
+    EVT_UPDATE_UI(SpiceViewer_PreviousSheet,  SpiceViewerFrame::OnUpdateChangeSheet)
+
     EVT_MENU(SpiceViewer_Help,        SpiceViewerFrame::OnHelp)
     EVT_MENU(SpiceViewer_About,       SpiceViewerFrame::OnAbout)
 wxEND_EVENT_TABLE()
@@ -280,6 +531,31 @@ SpiceViewerFrame::SpiceViewerFrame(const wxString& title)
 
         // TODO: export routine for gEDA: http://geda.seul.org/wiki/geda:file_format_spec
 
+    wxMenu *connMenu = new wxMenu;
+    connMenu->Append(SpiceViewer_NetConnections, "&Net connections...", "Show the device pins attached to a node");
+    connMenu->Append(SpiceViewer_ConnectedComponents, "&Connected components", "Show the connected components of the circuit");
+    connMenu->Append(SpiceViewer_ShortestPath, "&Shortest path...", "Show the shortest path between two device pins");
+
+    wxMenu *placeMenu = new wxMenu;
+    placeMenu->Append(SpiceViewer_PlaceNonOverlapped, "&Non-overlapped", "Pack all devices in rows");
+    placeMenu->Append(SpiceViewer_PlacePackByKind, "Packed by &kind", "Pack all devices in rows, grouping the devices of the same kind");
+    placeMenu->Append(SpiceViewer_PlacePackByCluster, "Packed by &cluster", "Pack all devices in rows, keeping connected devices together");
+    placeMenu->Append(SpiceViewer_PlaceForceDirected, "&Force-directed", "Place the devices so that connected devices are close");
+    placeMenu->Append(SpiceViewer_PlaceKamadaKawai, "&Kamada-Kawai", "Place the devices so that their distance reflects the circuit topology (slow on large circuits)");
+    placeMenu->Append(SpiceViewer_PlaceMultilevel, "&Multilevel", "Place the devices clustering the most connected ones (fast on large circuits)");
+    placeMenu->Append(SpiceViewer_PlaceQuadratic, "&Quadratic", "Place the devices minimizing the wirelength, with the external pins on the border");
+    placeMenu->Append(SpiceViewer_PlaceAnnealing, "&Annealing", "Improve the quadratic placement with simulated annealing (slow)");
+    placeMenu->Append(SpiceViewer_PlaceLayered, "&Layered", "Place the devices in columns, following the signal from the inputs to the outputs");
+    placeMenu->AppendSeparator();
+    placeMenu->Append(SpiceViewer_StopPlacement, "&Stop\tEsc", "Stop the running placement, keeping the layout it reached");
+    placeMenu->AppendSeparator();
+    placeMenu->AppendCheckItem(SpiceViewer_RouteWires, "&Route wires\tCtrl-R", "Draw the nets with orthogonal wires instead of airwires");
+
+    wxMenu *sheetMenu = new wxMenu;
+    sheetMenu->Append(SpiceViewer_SplitSheets, "&Split into sheets...", "Split the circuit in sheets, cutting as few nets as possible");
+    sheetMenu->Append(SpiceViewer_NextSheet, "&Next sheet\tPgDn", "Show the next sheet");
+    sheetMenu->Append(SpiceViewer_PreviousSheet, "&Previous sheet\tPgUp", "Show the previous sheet");
+
     wxMenu *helpMenu = new wxMenu;
     helpMenu->Append(SpiceViewer_Help, "&Help...\tF1", "Show help page");
     helpMenu->Append(SpiceViewer_About, "&About...", "Show about dialog");
@@ -287,6 +563,9 @@ SpiceViewerFrame::SpiceViewerFrame(const wxString& title)
     // now append the freshly created menu to the menu bar...
     wxMenuBar *menuBar = new wxMenuBar();
     menuBar->Append(fileMenu, "&File");
+    menuBar->Append(connMenu, "&Connectivity");
+    menuBar->Append(placeMenu, "&Placement");
+    menuBar->Append(sheetMenu, "&Sheets");
     menuBar->Append(helpMenu, "&Help");
 
     // ... and attach this menu bar to the frame
@@ -299,7 +578,8 @@ SpiceViewerFrame::SpiceViewerFrame(const wxString& title)
     // create the main canvas of this application
     // (it will get automatically linked to this frame and its size will be
     //  adjusted to fill the entire window)
-    m_canvas = new SpiceViewerCanvas(this);
+    m_canvas = new SpiceViewerCanvas(this, &m_layouts);
+    m_currentSheet = 0;
 }
 
 void SpiceViewerFrame::OnShowGrid(wxCommandEvent& event)
@@ -333,15 +613,21 @@ void SpiceViewerFrame::OnOpenNetlist(wxCommandEvent& WXUNUSED(event))
         return;
     }
 
-    if (subcktArray.size() > 1)
+    // the subcircuits instantiated by the top-level one are shown as macros;
+    // a top-level circuit too large for a single sheet is placed sheet by sheet
+    size_t top = svPlaceHierarchy(subcktArray, SVPA_PLACE_NON_OVERLAPPED, &m_layouts,
+                                  SHEET_MAX_DEVICES);
+    const svCircuit& ckt = subcktArray[top];
+    size_t nDevices = ckt.getDevices().size();
+    if (nDevices > SHEET_MAX_DEVICES)
     {
-        wxLogError("Sorry: multi-subcircuits not supported yet...");
+        SplitIntoSheets(ckt, (nDevices + SHEET_MAX_DEVICES - 1)/SHEET_MAX_DEVICES);
         return;
     }
 
-    subcktArray[0].placeDevices(SVPA_PLACE_NON_OVERLAPPED);
-    m_canvas->SetCircuit(subcktArray[0]);
-    SetTitle(wxString::Format("Netlist Viewer [%s]", subcktArray[0].getName()));
+    m_sheets.clear();
+    m_canvas->SetCircuit(ckt);
+    SetTitle(wxString::Format("Netlist Viewer [%s]", ckt.getName()));
 
     Refresh();
 }
@@ -357,31 +643,19 @@ void SpiceViewerFrame::OnOpenNVS(wxCommandEvent& WXUNUSED(event))
         return;     // the user changed idea...
 
     // proceed loading the file chosen by the user:
-    std::ifstream ifs((const char*)openFileDialog.GetPath());
-    if (!ifs.fail())
-    {
-        try {
-            boost::archive::text_iarchive ia(ifs);
-            svDeviceFactory::registerAllDevicesForSerialization(ia);
+    svCircuit ckt;
+    if (!ckt.loadNVS(openFileDialog.GetPath().ToStdString()))
+        return;
 
-            // read class state from archive
-            svCircuit ckt;
-            ia >> ckt;
-            m_canvas->SetCircuit(ckt);
+    m_sheets.clear();
+    m_canvas->SetCircuit(ckt);
 
-            SetTitle(wxString::Format("Netlist Viewer [%s]", ckt.getName()));
-            Refresh();
-        } 
-        catch (const boost::archive::archive_exception& e)
-        {
-            wxLogError("Error while importing the NVS file: %s", e.what());
-        }
-    }
-    else
-    {
-        wxLogError("Error while trying to open the NVS file '%s'", openFileDialog.GetPath());
-        return;
-    }
+    // replay the edits not yet compacted in the NVS file and keep journaling:
+    m_canvas->OpenJournal(openFileDialog.GetPath());
+    m_layouts.store(m_canvas->GetCircuit());
+
+    SetTitle(wxString::Format("Netlist Viewer [%s]", ckt.getName()));
+    Refresh();
 }
 
 void SpiceViewerFrame::OnExportNVS(wxCommandEvent& WXUNUSED(event))
@@ -394,32 +668,212 @@ void SpiceViewerFrame::OnExportNVS(wxCommandEvent& WXUNUSED(event))
         return;     // the user changed idea...
 
     // save data to archive
-    std::ofstream ofs((const char*)saveFileDialog.GetPath());
-    if (!ofs.fail())
+    if (!m_canvas->GetCircuit().saveNVS(saveFileDialog.GetPath().ToStdString()))
+        return;
+
+    // the NVS file now contains all edits: start a new, empty journal
+    // for all further edits
+    wxRemoveFile(svEditJournal::getJournalFilename(saveFileDialog.GetPath().ToStdString()));
+    m_canvas->OpenJournal(saveFileDialog.GetPath());
+    m_layouts.store(m_canvas->GetCircuit());
+}
+
+void SpiceViewerFrame::OnQuit(wxCommandEvent& WXUNUSED(event))
+{
+    Close(true /* force the frame to close */);
+}
+
+void SpiceViewerFrame::OnNetConnections(wxCommandEvent& WXUNUSED(event))
+{
+    const svCircuit& ckt = m_canvas->GetCircuit();
+    wxString node = wxGetTextFromUser("Name of the node:", "Net connections", "", this);
+    if (node.empty())
+        return;     // the user changed idea...
+
+    unsigned int idx = ckt.getNodeIndex(node.Lower().ToStdString());     // like the parser does
+    if (idx == svInvalidNodeIndex)
     {
-        try {
-            boost::archive::text_oarchive oa(ofs);
-            svDeviceFactory::registerAllDevicesForSerialization(oa);
+        wxLogError("The circuit has no node named '%s'", node);
+        return;
+    }
 
-            // write class instance to archive
-            oa << m_canvas->GetCircuit();
-        }
-        catch (const boost::archive::archive_exception& e)
-        {
-            // NOTE: this is typically a logic error in the program!
-            wxLogError("Error while exporting in NVS format: %s", e.what());
-        }
+    wxString msg = wxString::Format("Node '%s' has a fan-out of %u:\n", node, ckt.getNodeFanout(idx));
+    const svPinRefArray& pins = ckt.getNodePins(idx);
+    for (size_t i=0; i<pins.size(); i++)
+        msg += "\n" + ckt.getPinDescription(pins[i]);
+
+    wxMessageBox(msg, "Net connections", wxOK|wxICON_INFORMATION, this);
+}
+
+void SpiceViewerFrame::OnConnectedComponents(wxCommandEvent& WXUNUSED(event))
+{
+    const svCircuit& ckt = m_canvas->GetCircuit();
+    std::vector<unsigned int> component;
+    unsigned int n = ckt.getConnectedComponents(component);
+
+    std::vector<unsigned int> sizes(n, 0);
+    for (size_t i=0; i<component.size(); i++)
+        sizes[component[i]]++;
+
+    wxString msg = wxString::Format("The circuit has %u connected components:\n", n);
+    for (unsigned int c=0; c<n; c++)
+        msg += wxString::Format("\ncomponent %u: %u devices", c, sizes[c]);
+
+    wxMessageBox(msg, "Connected components", wxOK|wxICON_INFORMATION, this);
+}
+
+void SpiceViewerFrame::OnShortestPath(wxCommandEvent& WXUNUSED(event))
+{
+    const svCircuit& ckt = m_canvas->GetCircuit();
+    wxString pins = wxGetTextFromUser("The two pins, as DEV:PIN,DEV:PIN (e.g. R1:0,M2:1):",
+                                      "Shortest path", "", this);
+    if (pins.empty())
+        return;     // the user changed idea...
+
+    svPinRef from, to;
+    if (!ckt.findPin(pins.BeforeFirst(',').ToStdString(), from) ||
+        !ckt.findPin(pins.AfterFirst(',').ToStdString(), to))
+    {
+        wxLogError("Invalid pins '%s'", pins);
+        return;
     }
-    else
+
+    svPinRefArray path = ckt.getShortestPath(from, to);
+    if (path.empty())
     {
-        wxLogError("Error while saving the NVS file '%s'", saveFileDialog.GetPath());
+        wxMessageBox("The two pins are not connected.", "Shortest path", wxOK|wxICON_INFORMATION, this);
         return;
     }
+
+    wxString msg = wxString::Format("The shortest path crosses %lu devices:\n", (unsigned long)(path.size()/2 - 1));
+    for (size_t i=0; i<path.size(); i++)
+        msg += "\n" + ckt.getPinDescription(path[i]);
+
+    wxMessageBox(msg, "Shortest path", wxOK|wxICON_INFORMATION, this);
 }
 
-void SpiceViewerFrame::OnQuit(wxCommandEvent& WXUNUSED(event))
+void SpiceViewerFrame::OnPlaceDevices(wxCommandEvent& event)
 {
-    Close(true /* force the frame to close */);
+    switch (event.GetId())
+    {
+    case SpiceViewer_PlaceNonOverlapped:
+        m_canvas->PlaceDevices(SVPA_PLACE_NON_OVERLAPPED);
+        break;
+    case SpiceViewer_PlacePackByKind:
+        m_canvas->PlaceDevices(SVPA_PACK_BY_KIND);
+        break;
+    case SpiceViewer_PlacePackByCluster:
+        m_canvas->PlaceDevices(SVPA_PACK_BY_CLUSTER);
+        break;
+    case SpiceViewer_PlaceForceDirected:
+        m_canvas->PlaceDevices(SVPA_FORCE_DIRECTED);
+        break;
+    case SpiceViewer_PlaceKamadaKawai:
+        m_canvas->PlaceDevices(SVPA_KAMADA_KAWAI);
+        break;
+    case SpiceViewer_PlaceMultilevel:
+        m_canvas->PlaceDevices(SVPA_MULTILEVEL);
+        break;
+    case SpiceViewer_PlaceQuadratic:
+        m_canvas->PlaceDevices(SVPA_QUADRATIC);
+        break;
+    case SpiceViewer_PlaceAnnealing:
+        m_canvas->PlaceDevices(SVPA_ANNEALING);
+        break;
+    case SpiceViewer_PlaceLayered:
+        m_canvas->PlaceDevices(SVPA_LAYERED);
+        break;
+    }
+}
+
+void SpiceViewerFrame::OnStopPlacement(wxCommandEvent& WXUNUSED(event))
+{
+    m_canvas->StopPlacement();
+}
+
+void SpiceViewerFrame::OnUpdateStopPlacement(wxUpdateUIEvent& event)
+{
+    event.Enable(m_canvas && m_canvas->IsPlacing());
+}
+
+void SpiceViewerFrame::OnRouteWires(wxCommandEvent& event)
+{
+    m_canvas->RouteWires(event.IsChecked());
+}
+
+void SpiceViewerFrame::SplitIntoSheets(const svCircuit& ckt, unsigned int nSheets)
+{
+    m_unsplitCkt = ckt;
+    ckt.splitIntoSheets(nSheets, m_sheets);
+
+    // the sheets are independent: place them in parallel
+    svParallelFor(m_sheets.size(),
+        [this](size_t begin, size_t end, unsigned int) {
+            for (size_t i=begin; i<end; i++)
+                m_sheets[i].placeDevices(SVPA_PLACE_NON_OVERLAPPED);
+        }, 0, 1);
+
+    m_currentSheet = 0;
+    m_canvas->SetCircuit(m_sheets[0]);
+    SetTitle(wxString::Format("Netlist Viewer [%s]", m_sheets[0].getName()));
+    Refresh();
+}
+
+void SpiceViewerFrame::ShowSheet(size_t idx)
+{
+    m_sheets[m_currentSheet] = m_canvas->GetCircuit();
+    m_currentSheet = idx;
+    m_canvas->SetCircuit(m_sheets[idx]);
+    SetTitle(wxString::Format("Netlist Viewer [%s]", m_sheets[idx].getName()));
+    Refresh();
+}
+
+void SpiceViewerFrame::OnSplitSheets(wxCommandEvent& WXUNUSED(event))
+{
+    // the sheets are always cut from the whole circuit
+    const svCircuit& ckt = m_sheets.empty() ? m_canvas->GetCircuit() : m_unsplitCkt;
+    long nDevices = ckt.getDevices().size();
+    if (nDevices < 2)
+        return;
+
+    long nSheets = wxGetNumberFromUser("Each sheet gets about the same number of devices; the nets\n"
+                                       "crossing the sheets end in off-sheet connectors.",
+                                       "Number of sheets:", "Split into sheets",
+                                       m_sheets.empty() ? 2 : m_sheets.size(), 1, nDevices, this);
+    if (nSheets <= 0)
+        return;     // the user changed idea...
+
+    if (nSheets == 1)
+    {
+        // go back to the whole circuit
+        if (!m_sheets.empty())
+        {
+            svCircuit whole(m_unsplitCkt);
+            m_sheets.clear();
+            m_canvas->SetCircuit(whole);
+            SetTitle(wxString::Format("Netlist Viewer [%s]", whole.getName()));
+            Refresh();
+        }
+        return;
+    }
+
+    SplitIntoSheets(svCircuit(ckt), nSheets);
+}
+
+void SpiceViewerFrame::OnChangeSheet(wxCommandEvent& event)
+{
+    if (m_sheets.size() < 2)
+        return;
+
+    if (event.GetId() == SpiceViewer_NextSheet)
+        ShowSheet((m_currentSheet + 1) % m_sheets.size());
+    else
+        ShowSheet((m_currentSheet + m_sheets.size() - 1) % m_sheets.size());
+}
+
+void SpiceViewerFrame::OnUpdateChangeSheet(wxUpdateUIEvent& event)
+{
+    event.Enable(m_sheets.size() > 1);
 }
 
 void SpiceViewerFrame::OnHelp(wxCommandEvent& WXUNUSED(event))
@@ -455,17 +909,26 @@ wxBEGIN_EVENT_TABLE(SpiceViewerCanvas, wxScrolledCanvas)
     EVT_LEFT_DOWN(SpiceViewerCanvas::OnMouseDown)
     EVT_LEFT_UP(SpiceViewerCanvas::OnMouseUp)
     EVT_RIGHT_UP(SpiceViewerCanvas::OnMouseUp)
+
+    EVT_TIMER(wxID_ANY, SpiceViewerCanvas::OnPlacementTimer)
 wxEND_EVENT_TABLE()
 
-SpiceViewerCanvas::SpiceViewerCanvas(wxFrame *parent)
+SpiceViewerCanvas::SpiceViewerCanvas(wxFrame *parent, svLayoutStore* layouts)
         : wxScrolledCanvas(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize,
-                           wxHSCROLL | wxVSCROLL | wxFULL_REPAINT_ON_RESIZE)
+                           wxHSCROLL | wxVSCROLL | wxFULL_REPAINT_ON_RESIZE),
+          m_placementTimer(this)
 {
     m_pDraggedDev = NULL;
     m_idxDraggedDev = wxNOT_FOUND;
+    m_rotDraggedDevOrig = SVR_0;
     m_gridSize = 40;
     m_gridPen = wxPen(*wxLIGHT_GREY, 1, wxPENSTYLE_DOT);
     m_bShowGrid = true;
+    m_bRouteWires = false;
+    m_labelExtent = 0;
+    m_placementDone = false;
+    m_snapshotSeq = 0;
+    m_layouts = layouts;
 
     SetScrollRate(m_gridSize/10, m_gridSize/10);
     SetCursor(wxCURSOR_CROSS);
@@ -481,22 +944,28 @@ void SpiceViewerCanvas::OnPaint(wxPaintEvent &WXUNUSED(event))
     wxBufferedPaintDC dc(this, wxBUFFER_VIRTUAL_AREA);
 #endif
 
+    // the damaged area, in unscrolled coordinates: while dragging a device
+    // it's usually a small part of the window (see RefreshDraggedDevice())
+    wxRect update = GetUpdateRegion().GetBox();
+    update.SetPosition(CalcUnscrolledPosition(update.GetPosition()));
+
     // clear our background
     dc.SetBackground(*wxWHITE_BRUSH);
     dc.SetBackgroundMode(wxSOLID);
     dc.SetPen(*wxTRANSPARENT_PEN);
     //dc.Clear();  -- doesn't clear all the virtual area!
-    dc.DrawRectangle(wxPoint(0,0), GetVirtualSize()+wxSize(1,1));
+    dc.DrawRectangle(update.GetPosition(), update.GetSize()+wxSize(1,1));
 
     // draw the grid
     if (m_bShowGrid)
     {
         dc.SetPen(m_gridPen);
-        wxSize sz = GetVirtualSize();
-        for (int xx=m_gridSize; xx<sz.GetWidth(); xx+=m_gridSize)
-            dc.DrawLine(xx, 0, xx, sz.GetHeight());
-        for (int yy=m_gridSize; yy<sz.GetHeight(); yy+=m_gridSize)
-            dc.DrawLine(0, yy, sz.GetWidth(), yy);
+        int firstX = (update.GetLeft()/int(m_gridSize) + 1)*m_gridSize,
+            firstY = (update.GetTop()/int(m_gridSize) + 1)*m_gridSize;
+        for (int xx=firstX; xx<=update.GetRight(); xx+=m_gridSize)
+            dc.DrawLine(xx, update.GetTop(), xx, update.GetBottom()+1);
+        for (int yy=firstY; yy<=update.GetBottom(); yy+=m_gridSize)
+            dc.DrawLine(update.GetLeft(), yy, update.GetRight()+1, yy);
     }
 
     wxGraphicsContext *gc = wxGraphicsContext::Create(dc);
@@ -504,13 +973,15 @@ void SpiceViewerCanvas::OnPaint(wxPaintEvent &WXUNUSED(event))
         return;
 
     // draw the schematic currently loaded
-    m_ckt.draw(gc, m_gridSize, m_pDraggedDev ? m_idxDraggedDev : wxNOT_FOUND);
+    // (the labels may extend out of the devices and wires being culled)
+    update.Inflate(m_labelExtent + m_gridSize, m_labelExtent + m_gridSize);
+    m_ckt.draw(gc, m_gridSize, m_pDraggedDev ? m_idxDraggedDev : wxNOT_FOUND, update);
     delete gc;
 }
 
 void SpiceViewerCanvas::OnMouseDown(wxMouseEvent &event)
 {
-    if (m_pDraggedDev != NULL || !event.LeftDown())
+    if (m_pDraggedDev != NULL || !event.LeftDown() || IsPlacing())
         return;
 
     wxClientDC dc(this);
@@ -528,6 +999,10 @@ void SpiceViewerCanvas::OnMouseDown(wxMouseEvent &event)
     // the offset (in pixel) between the clicked point and the reference node of the dragged device
     m_ptDraggedDevOffset = m_pDraggedDev->getGridPosition()*m_gridSize - click;
 
+    // remember the original placement to know whether it's been edited at the end of the drag
+    m_ptDraggedDevOrigPos = m_pDraggedDev->getGridPosition();
+    m_rotDraggedDevOrig = m_pDraggedDev->getRotation();
+
     Refresh();
 }
 
@@ -551,11 +1026,17 @@ void SpiceViewerCanvas::OnMouseMove(wxMouseEvent &event)
         // get the position of the closest grid point
         wxPoint newGridPt = m_pDraggedDev->getGridPosition() + wxPoint(wxRound(dx),wxRound(dy));
 
-        // update&refresh
-        m_pDraggedDev->setGridPosition(newGridPt);
-        m_ckt.updateBoundingBox();
-        UpdateVirtualSize();
-        Refresh();
+        // don't drop the device over other ones (unless it already overlaps
+        // some of them: it must be possible to drag it away)
+        if (!m_ckt.isFreeFor(m_idxDraggedDev, newGridPt) &&
+            m_ckt.isFreeFor(m_idxDraggedDev, m_pDraggedDev->getGridPosition()))
+            return;
+
+        // update&refresh: only the nets of the dragged device are rerouted
+        // and only the area they cover is repainted
+        wxRect before = GetDraggedDeviceRegion();
+        m_ckt.moveDevice(m_idxDraggedDev, newGridPt);
+        RefreshDraggedDevice(before);
     }
 }
 
@@ -563,15 +1044,67 @@ void SpiceViewerCanvas::OnMouseUp(wxMouseEvent &event)
 {
     if (event.LeftUp())
     {
+        if (m_pDraggedDev &&
+            (m_pDraggedDev->getGridPosition() != m_ptDraggedDevOrigPos ||
+             m_pDraggedDev->getRotation() != m_rotDraggedDevOrig))
+        {
+            // save the edit (if we're journaling the edits for a NVS file)
+            m_journal.record(m_ckt, m_idxDraggedDev);
+
+            // the nets of the dragged device have already been rerouted
+            // while dragging it
+        }
+
         m_pDraggedDev = NULL;
         Refresh();
     }
     else if (event.RightUp() && m_pDraggedDev)
     {
-        // rotate the device being dragged
-        m_pDraggedDev->rotateClockwise();
-        Refresh();
+        // rotate the device being dragged, unless it would overlap other ones
+        wxRect before = GetDraggedDeviceRegion();
+        if (m_ckt.rotateDevice(m_idxDraggedDev))
+            RefreshDraggedDevice(before);
+    }
+}
+
+void SpiceViewerCanvas::OnPlacementTimer(wxTimerEvent &WXUNUSED(event))
+{
+    if (!IsPlacing())
+        return;
+
+    std::vector<wxPoint> positions;
+    std::vector<svRotation> rotations;
+    if (!m_placementDone)
+    {
+        // show the last snapshot of the placement, if it's a new one
+        if (m_progress.getSnapshot(positions, rotations, m_snapshotSeq))
+            SetLayout(positions, rotations);
+        return;
     }
+
+    m_placementThread.join();
+    m_placementTimer.Stop();
+
+    const svBaseDeviceArray& placed = m_placedCkt.getDevices();
+    for (size_t i=0; i<placed.size(); i++)
+    {
+        positions.push_back(placed[i]->getGridPosition());
+        rotations.push_back(placed[i]->getRotation());
+    }
+    SetLayout(positions, rotations);
+    m_placedCkt = svCircuit();
+
+    // the new layout is an edit of the whole schematic: save it at once
+    // in the NVS file instead of journaling each device
+    if (m_journal.isOpen())
+        m_journal.compact(m_ckt);
+
+    // the structurally identical subcircuits opened later get the new layout
+    m_layouts->store(m_ckt);
+    wxLogStatus("Placement completed");
+
+    if (m_bRouteWires)
+        RouteNets();
 }
 
 void SpiceViewerCanvas::OnMouseWheel(wxMouseEvent &event)
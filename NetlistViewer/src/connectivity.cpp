@@ -0,0 +1,339 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        connectivity.cpp
+// Purpose:     connectivity queries on the circuits
+// Author:      Francesco Montorsi
+// Created:     18/10/2026
+// Copyright:   (c) 2026 Francesco Montorsi
+// Licence:     GPL licence
+/////////////////////////////////////////////////////////////////////////////
+
+// ============================================================================
+// declarations
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// headers
+// ----------------------------------------------------------------------------
+
+#include <wx/wx.h>
+
+#include "netlist.h"
+#include "devices.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <functional>
+
+// ----------------------------------------------------------------------------
+// constants
+// ----------------------------------------------------------------------------
+
+// the structural hash refines the labels of the devices at most this number
+// of times (each round extends the neighbourhood described by a label by one
+// net):
+#define STRUCTURAL_HASH_ROUNDS      8
+
+
+// ============================================================================
+// implementation
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// svCircuit - connectivity queries
+// ----------------------------------------------------------------------------
+
+const svHyperGraph& svCircuit::getHyperGraph() const
+{
+    if (!m_hyperGraphValid)
+    {
+        m_hyperGraph = buildHyperGraph();
+        m_hyperGraphValid = true;
+    }
+
+    return m_hyperGraph;
+}
+
+unsigned int svCircuit::getConnectedComponents(std::vector<unsigned int>& deviceComponent) const
+{
+    const svHyperGraph& hg = getHyperGraph();
+    size_t nDevices = hg.getDevicesCount();
+
+    // merge the devices attached to the same net: each thread works on
+    // a different range of nets
+    svConcurrentUnionFind uf(nDevices);
+    svParallelFor(hg.getNetsCount(),
+        [&hg, &uf](size_t begin, size_t end, unsigned int) {
+            for (size_t net=begin; net<end; net++)
+            {
+                if (hg.isIgnoredNet(net) || hg.getNetDegree(net) < 2)
+                    continue;
+
+                const unsigned int* first = hg.getNetDevicesBegin(net);
+                for (const unsigned int* dev = first+1; dev != hg.getNetDevicesEnd(net); dev++)
+                    uf.unite(*first, *dev);
+            }
+        });
+
+    // the representative of each set is its smallest device:
+    deviceComponent.resize(nDevices);
+    svParallelFor(nDevices,
+        [&uf, &deviceComponent](size_t begin, size_t end, unsigned int) {
+            for (size_t dev=begin; dev<end; dev++)
+                deviceComponent[dev] = uf.find(dev);
+        });
+
+    // renumber the components 0..N-1; since representatives are the smallest
+    // device of each component, one pass in device order is enough
+    unsigned int nComponents = 0;
+    for (size_t dev=0; dev<nDevices; dev++)
+    {
+        if (deviceComponent[dev] == dev)
+            deviceComponent[dev] = nComponents++;
+        else
+            deviceComponent[dev] = deviceComponent[deviceComponent[dev]];
+    }
+
+    return nComponents;
+}
+
+svPinRefArray svCircuit::getShortestPath(const svPinRef& from, const svPinRef& to) const
+{
+    const svHyperGraph& hg = getHyperGraph();
+    size_t nNets = hg.getNetsCount();
+
+    unsigned int source = hg.getDeviceNetsBegin(from.device)[from.pin];
+    unsigned int target = hg.getDeviceNetsBegin(to.device)[to.pin];
+
+    svPinRefArray ret;
+    ret.push_back(from);
+    if (source == target)
+    {
+        ret.push_back(to);
+        return ret;
+    }
+
+    // the BFS visits the nets; going from a net to another means crossing
+    // a device: for each visited net we remember through which device (and
+    // which of its pins) we reached it
+    std::vector< std::atomic<unsigned char> > visited(nNets);
+    svParallelFor(nNets,
+        [&visited](size_t begin, size_t end, unsigned int) {
+            for (size_t net=begin; net<end; net++)
+                visited[net].store(0, std::memory_order_relaxed);
+        });
+
+    std::vector<svPinRef> parentIn(nNets), parentOut(nNets);
+    visited[source] = 1;
+
+    unsigned int nThreads = svGetThreadsCount();
+    std::vector<unsigned int> frontier(1, source);
+    std::vector< std::vector<unsigned int> > nextFrontiers(nThreads);
+    std::atomic<bool> found(false);
+    if (hg.isIgnoredNet(source))
+    {
+        // don't fan out through a global net: the path can only leave it
+        // through the device of @a from
+        frontier.clear();
+        const unsigned int* nets = hg.getDeviceNetsBegin(from.device);
+        for (unsigned int q=0; q<hg.getDeviceDegree(from.device); q++)
+        {
+            unsigned int other = nets[q];
+            if (visited[other] || (other != target && hg.isIgnoredNet(other)))
+                continue;
+
+            visited[other] = 1;
+            parentIn[other] = from;
+            parentOut[other] = svPinRef(from.device, q);
+            if (other == target)
+                found = true;
+            frontier.push_back(other);
+        }
+    }
+    while (!frontier.empty() && !found)
+    {
+        // level-synchronous BFS: the current frontier is split among the threads;
+        // a net is claimed by the first thread which marks it as visited
+        // (svParallelFor runs fewer threads than nThreads on small frontiers:
+        // the slots of the idle ones must not keep the nets of the previous level)
+        for (unsigned int t=0; t<nThreads; t++)
+            nextFrontiers[t].clear();
+        svParallelFor(frontier.size(),
+            [&](size_t begin, size_t end, unsigned int threadIdx) {
+                std::vector<unsigned int>& next = nextFrontiers[threadIdx];
+                for (size_t i=begin; i<end && !found; i++)
+                {
+                    unsigned int net = frontier[i];
+                    for (unsigned int k=0; k<hg.getNetDegree(net); k++)
+                    {
+                        svPinRef in = hg.getNetPin(net, k);
+                        const unsigned int* nets = hg.getDeviceNetsBegin(in.device);
+                        for (unsigned int q=0; q<hg.getDeviceDegree(in.device); q++)
+                        {
+                            unsigned int other = nets[q];
+                            if (other != target && hg.isIgnoredNet(other))
+                                continue;       // never go through global nets
+
+                            unsigned char expected = 0;
+                            if (visited[other].load(std::memory_order_relaxed) ||
+                                !visited[other].compare_exchange_strong(expected, 1))
+                                continue;
+
+                            parentIn[other] = in;
+                            parentOut[other] = svPinRef(in.device, q);
+                            if (other == target)
+                                found = true;
+                            next.push_back(other);
+                        }
+                    }
+                }
+            }, nThreads, 64 /* nets with high fan-out make even small frontiers expensive */);
+
+        frontier.clear();
+        for (unsigned int t=0; t<nThreads; t++)
+            frontier.insert(frontier.end(), nextFrontiers[t].begin(), nextFrontiers[t].end());
+    }
+
+    if (!found)
+        return svPinRefArray();
+
+    // walk back from the target net to the source net; a path which leaves
+    // through the device of @a from enters it at @a from, already listed
+    svPinRefArray path;
+    path.push_back(to);
+    for (unsigned int net = target; net != source; )
+    {
+        const svPinRef& in = parentIn[net];
+        path.push_back(parentOut[net]);
+        if (in.device == from.device && in.pin == from.pin)
+            break;
+        path.push_back(in);
+        net = hg.getDeviceNetsBegin(in.device)[in.pin];
+    }
+
+    ret.insert(ret.end(), path.rbegin(), path.rend());
+    return ret;
+}
+
+int svCircuit::findDevice(const std::string& spiceName) const
+{
+    wxString name = wxString(spiceName).Lower();
+    for (size_t i=0; i<m_devices.size(); i++)
+        if (wxString(m_devices[i]->getSPICEName()).Lower() == name)
+            return i;
+    return wxNOT_FOUND;
+}
+
+bool svCircuit::findPin(const std::string& desc, svPinRef& ret) const
+{
+    wxString str(desc);
+    unsigned long pin;
+    int dev = findDevice(str.BeforeLast(':').Trim().Trim(false).ToStdString());
+    if (dev == wxNOT_FOUND || !str.AfterLast(':').Trim().Trim(false).ToULong(&pin) ||
+        pin >= m_devices[dev]->getNodes().size())
+        return false;
+
+    ret = svPinRef(dev, pin);
+    return true;
+}
+
+std::string svCircuit::getPinDescription(const svPinRef& pin) const
+{
+    const svBaseDevice* dev = m_devices[pin.device];
+    return wxString::Format("%s:%u (%s, node '%s')",
+                            dev->getSPICEName(), pin.pin,
+                            dev->getHumanReadableDesc(), dev->getNode(pin.pin)).ToStdString();
+}
+
+// ----------------------------------------------------------------------------
+// svCircuit - structural hash
+// ----------------------------------------------------------------------------
+
+//! Scrambles the bits of the given value (the finalizer of SplitMix64), so
+//! that sums of scrambled values make good order-independent hashes.
+static inline unsigned long long scrambleHash(unsigned long long h)
+{
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+//! Returns the number of distinct values of the given array.
+static size_t getDistinctCount(std::vector<unsigned long long> values)
+{
+    std::sort(values.begin(), values.end());
+    return std::unique(values.begin(), values.end()) - values.begin();
+}
+
+unsigned long long svCircuit::getStructuralHash(std::vector<unsigned long long>* deviceLabels) const
+{
+    const svHyperGraph& hg = getHyperGraph();
+    size_t nDevices = hg.getDevicesCount(), nNets = hg.getNetsCount();
+
+    // the first label of a device tells its kind and its size (which doesn't
+    // change with the rotation), so that devices with the same label can
+    // always take each other's place; names and values are not used, but the
+    // order of the external pins (the interface of the circuit) is
+    std::vector<unsigned long long> devLabel(nDevices), netLabel(nNets);
+    std::hash<std::string> hashString;
+    unsigned int nExternalPins = 0;
+    for (size_t i=0; i<nDevices; i++)
+    {
+        wxRect bb = m_devices[i]->getRelativeBoundingBox();
+        unsigned long long h = scrambleHash(hashString(m_devices[i]->getHumanReadableDesc()));
+        if (dynamic_cast<const svExternalPin*>(m_devices[i]))
+            h = scrambleHash(h + ++nExternalPins);
+        h = scrambleHash(h + hg.getDeviceDegree(i));
+        h = scrambleHash(h + std::min(bb.width, bb.height));
+        devLabel[i] = scrambleHash(h + std::max(bb.width, bb.height));
+    }
+
+    // refine the labels (like in the Weisfeiler-Lehman test): the label of a
+    // net summarizes the labels of its pins, in any order, and the new label
+    // of a device the labels of the nets attached to its pins, in pin order
+    size_t nClasses = getDistinctCount(devLabel);
+    for (unsigned int round=0; round<STRUCTURAL_HASH_ROUNDS; round++)
+    {
+        svParallelFor(nNets,
+            [&](size_t begin, size_t end, unsigned int) {
+                for (size_t net=begin; net<end; net++)
+                {
+                    unsigned long long h = hg.isIgnoredNet(net) ? 1 : 0;
+                    for (unsigned int k=0; k<hg.getNetDegree(net); k++)
+                    {
+                        svPinRef pin = hg.getNetPin(net, k);
+                        h += scrambleHash(devLabel[pin.device] + pin.pin);
+                    }
+                    netLabel[net] = scrambleHash(h);
+                }
+            });
+
+        std::vector<unsigned long long> refined(nDevices);
+        svParallelFor(nDevices,
+            [&](size_t begin, size_t end, unsigned int) {
+                for (size_t i=begin; i<end; i++)
+                {
+                    unsigned long long h = devLabel[i];
+                    for (const unsigned int* net = hg.getDeviceNetsBegin(i); net != hg.getDeviceNetsEnd(i); net++)
+                        h = scrambleHash(h + netLabel[*net]);
+                    refined[i] = h;
+                }
+            });
+        devLabel.swap(refined);
+
+        // stop when the labels don't tell apart more devices than before
+        size_t n = getDistinctCount(devLabel);
+        if (n == nClasses)
+            break;
+        nClasses = n;
+    }
+
+    unsigned long long ret = scrambleHash(nDevices) + scrambleHash(nNets + 1);
+    for (size_t i=0; i<nDevices; i++)
+        ret += scrambleHash(devLabel[i]);
+
+    if (deviceLabels)
+        deviceLabels->swap(devLabel);
+    return ret;
+}
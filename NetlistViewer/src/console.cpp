@@ -0,0 +1,556 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        console.cpp
+// Purpose:     NetlistViewer console (non-GUI) entry point, for benchmarks and queries
+// Author:      Francesco Montorsi
+// Created:     18/10/2026
+// Copyright:   (c) 2026 Francesco Montorsi
+// Licence:     GPL license
+/////////////////////////////////////////////////////////////////////////////
+
+// ============================================================================
+// declarations
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// headers
+// ----------------------------------------------------------------------------
+
+#include <wx/wx.h>
+#include <wx/init.h>
+#include <wx/cmdline.h>
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+
+#ifndef __WINDOWS__
+    #include <sys/resource.h>
+#endif
+
+#include "netlist.h"
+#include "devices.h"
+#include "parallel.h"
+
+// ----------------------------------------------------------------------------
+// constants
+// ----------------------------------------------------------------------------
+
+#define DEFAULT_BENCH_MAX_NODES     1000000
+#define DEFAULT_BENCH_SEED          1234
+
+//! The placement algorithms, with the names used by the placement benchmark.
+static const struct
+{
+    svPlaceAlgorithm algorithm;
+    const char* name;
+} g_placeAlgorithms[] =
+{
+    { SVPA_PLACE_NON_OVERLAPPED,    "non-overlapped" },
+    { SVPA_PACK_BY_KIND,            "pack-by-kind" },
+    { SVPA_PACK_BY_CLUSTER,         "pack-by-cluster" },
+    { SVPA_HEURISTIC_1,             "heuristic-1" },
+    { SVPA_FORCE_DIRECTED,          "force-directed" },
+    { SVPA_KAMADA_KAWAI,            "kamada-kawai" },
+    { SVPA_MULTILEVEL,              "multilevel" },
+    { SVPA_QUADRATIC,               "quadratic" },
+    { SVPA_ANNEALING,               "annealing" },
+    { SVPA_LAYERED,                 "layered" }
+};
+
+static const wxCmdLineEntryDesc g_cmdLineDesc[] =
+{
+    { wxCMD_LINE_SWITCH, "h", "help", "show this help message",
+        wxCMD_LINE_VAL_NONE, wxCMD_LINE_OPTION_HELP },
+    { wxCMD_LINE_SWITCH, NULL, "bench-graph", "benchmark the construction of the connectivity graph",
+        wxCMD_LINE_VAL_NONE, 0 },
+    { wxCMD_LINE_SWITCH, NULL, "bench-placement", "benchmark the placement algorithms on the given netlists and on random circuits",
+        wxCMD_LINE_VAL_NONE, 0 },
+    { wxCMD_LINE_OPTION, NULL, "algorithm", "the only placement algorithm to benchmark (default: all)",
+        wxCMD_LINE_VAL_STRING, 0 },
+    { wxCMD_LINE_OPTION, NULL, "report", "the file where the JSON report of the placement benchmark is written (default: stdout)",
+        wxCMD_LINE_VAL_STRING, 0 },
+    { wxCMD_LINE_OPTION, NULL, "max-nodes", "the size of the largest circuit generated by benchmarks",
+        wxCMD_LINE_VAL_NUMBER, 0 },
+    { wxCMD_LINE_OPTION, NULL, "seed", "the seed used to generate random circuits",
+        wxCMD_LINE_VAL_NUMBER, 0 },
+
+    { wxCMD_LINE_OPTION, NULL, "subckt", "the subcircuit of the netlist to query (default: the first one)",
+        wxCMD_LINE_VAL_STRING, 0 },
+    { wxCMD_LINE_OPTION, NULL, "net-pins", "list the device pins attached to the given node",
+        wxCMD_LINE_VAL_STRING, 0 },
+    { wxCMD_LINE_OPTION, NULL, "fanout", "show the fan-out of the given node",
+        wxCMD_LINE_VAL_STRING, 0 },
+    { wxCMD_LINE_SWITCH, NULL, "components", "list the connected components of the circuit",
+        wxCMD_LINE_VAL_NONE, 0 },
+    { wxCMD_LINE_OPTION, NULL, "path", "show the shortest path between two pins, given as DEV:PIN,DEV:PIN",
+        wxCMD_LINE_VAL_STRING, 0 },
+
+    { wxCMD_LINE_PARAM, NULL, NULL, "netlist file to query (or netlist files to benchmark)",
+        wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_OPTIONAL | wxCMD_LINE_PARAM_MULTIPLE },
+
+    wxCMD_LINE_DESC_END
+};
+
+
+// ============================================================================
+// implementation
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// helpers
+// ----------------------------------------------------------------------------
+
+//! Returns the peak resident memory of this process, in KB (or 0 if unknown).
+static long getPeakMemoryKB()
+{
+#ifdef __LINUX__
+    // unlike getrusage(), this value can be reset by resetPeakMemory()
+    FILE* status = fopen("/proc/self/status", "r");
+    if (status)
+    {
+        char line[256];
+        long peak = 0;
+        while (fgets(line, sizeof(line), status))
+            if (sscanf(line, "VmHWM: %ld", &peak) == 1)
+                break;
+        fclose(status);
+        if (peak > 0)
+            return peak;
+    }
+#endif
+#ifndef __WINDOWS__
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+    #ifdef __APPLE__
+        return usage.ru_maxrss/1024;        // bytes on macOS
+    #else
+        return usage.ru_maxrss;             // KB on Linux
+    #endif
+    }
+#endif
+    return 0;
+}
+
+//! Resets the peak resident memory to the current one, where supported (Linux),
+//! so that getPeakMemoryKB() measures the peak of the following operations only.
+static void resetPeakMemory()
+{
+#ifdef __LINUX__
+    FILE* clearRefs = fopen("/proc/self/clear_refs", "w");
+    if (clearRefs)
+    {
+        fputs("5", clearRefs);
+        fclose(clearRefs);
+    }
+#endif
+}
+
+//! Returns the seconds elapsed since the given time point.
+static double getElapsedSec(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//! Generates a random circuit with (about) the given number of nodes.
+//! The circuit is a chain of resistors with additional random capacitors and
+//! transistors, so that each node has a few pins and a few long-range
+//! connections, like in real netlists.
+static void generateCircuit(svCircuit& ckt, unsigned int nNodes, unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<unsigned int> anyNode(0, nNodes-1);
+
+    ckt = svCircuit(wxString::Format("random%u", nNodes).ToStdString());
+    ckt.addNode(svGroundNode);
+
+    std::vector<svNode> names(nNodes);
+    for (unsigned int i=0; i<nNodes; i++)
+    {
+        names[i] = wxString::Format("n%u", i).ToStdString();
+        ckt.addNode(names[i]);
+    }
+
+    for (unsigned int i=0; i<nNodes; i++)
+    {
+        svBaseDevice* dev = svDeviceFactory::getDeviceMatchingIdentifier('R');
+        dev->setName(wxString::Format("%u", i).ToStdString());
+        dev->addNode(names[i]);
+        dev->addNode(i+1 < nNodes ? names[i+1] : svGroundNode);
+        ckt.addDevice(dev);
+
+        if (i % 2 == 0)
+        {
+            dev = svDeviceFactory::getDeviceMatchingIdentifier('C');
+            dev->setName(wxString::Format("%u", i).ToStdString());
+            dev->addNode(names[i]);
+            dev->addNode(names[anyNode(rng)]);
+            ckt.addDevice(dev);
+        }
+
+        if (i % 4 == 0)
+        {
+            dev = svDeviceFactory::getDeviceMatchingIdentifier('M');
+            dev->setName(wxString::Format("%u", i).ToStdString());
+            dev->addNode(names[anyNode(rng)]);
+            dev->addNode(names[i]);
+            dev->addNode(svGroundNode);
+            ckt.addDevice(dev);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// benchmarks
+// ----------------------------------------------------------------------------
+
+static void benchGraph(unsigned int maxNodes, unsigned int seed)
+{
+    printf("%10s %10s %12s %12s %14s %16s %12s %16s %14s\n",
+           "nodes", "devices", "edges", "build [s]", "CSR [KB]", "matrix [KB]",
+           "hyper [s]", "hypergraph [KB]", "peak RSS [KB]");
+
+    for (unsigned int n=1000; n<=maxNodes; n*=10)
+    {
+        svCircuit ckt;
+        generateCircuit(ckt, n, seed);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        svUGraph g = ckt.buildGraph();
+        double elapsed = getElapsedSec(start);
+
+        // the CSR graph stores one row offset per vertex plus one column index per edge;
+        // the adjacency matrix used in the past stored one bit per pair of vertices
+        size_t V = boost::num_vertices(g), E = boost::num_edges(g);
+        double csrKB = double((V+1)*sizeof(svUGraph::vertices_size_type) +
+                              E*sizeof(svUGraph::vertex_descriptor))/1024;
+        double matrixKB = double(V)*(V+1)/2/8/1024;
+
+        // the hypergraph (which is what placement algorithms use) is linear in the pins
+        start = std::chrono::steady_clock::now();
+        svHyperGraph hg = ckt.buildHyperGraph();
+        double elapsedHyper = getElapsedSec(start);
+
+        printf("%10lu %10lu %12lu %12.4f %14.0f %16.0f %12.4f %16.0f %14ld\n",
+               (unsigned long)V, (unsigned long)ckt.getDevices().size(), (unsigned long)E,
+               elapsed, csrKB, matrixKB, elapsedHyper, double(hg.getMemoryUsage())/1024,
+               getPeakMemoryKB());
+        fflush(stdout);
+    }
+}
+
+//! Returns the total length of the airwires drawn by svCircuit::draw().
+static double getAirwireLength(const svCircuit& ckt)
+{
+    double length = 0;
+    for (unsigned int i=0; i<ckt.getNodesCount(); i++)
+    {
+        if (ckt.getHyperGraph().isIgnoredNet(i))
+            continue;
+
+        const svAirwireArray& airwires = ckt.getAirwires(i);
+        for (size_t j=0; j<airwires.size(); j++)
+        {
+            double dx = airwires[j].to.x - airwires[j].from.x, dy = airwires[j].to.y - airwires[j].from.y;
+            length += sqrt(dx*dx + dy*dy);
+        }
+    }
+    return length;
+}
+
+//! Returns the number of devices which overlap some device preceding them.
+static size_t getOverlapsCount(const svCircuit& ckt)
+{
+    svOccupancyGrid grid;
+    size_t overlaps = 0;
+    for (size_t i=0; i<ckt.getDevices().size(); i++)
+    {
+        wxRect cells = ckt.getDeviceCells(i, ckt.getDevices()[i]->getGridPosition());
+        if (!grid.isFree(cells))
+            overlaps++;
+        grid.occupy(cells);
+    }
+    return overlaps;
+}
+
+//! Returns the given string quoted and escaped for a JSON document.
+static std::string getJSONString(const wxString& str)
+{
+    std::string chars = str.ToStdString();
+    std::string ret = "\"";
+    for (const char* p = chars.c_str(); *p; p++)
+    {
+        if (*p == '"' || *p == '\\')
+            ret += '\\';
+        if ((unsigned char)*p < 0x20)
+            ret += wxString::Format("\\u%04x", (unsigned int)(unsigned char)*p).ToStdString();
+        else
+            ret += *p;
+    }
+    return ret + "\"";
+}
+
+//! Places the given circuit with all the algorithms (or only the given one)
+//! and writes one JSON object for each run to @a report.
+static void benchPlacementOf(const svCircuit& ckt, const wxString& source,
+                             const wxString& algorithm, FILE* report, bool& first)
+{
+    for (size_t a=0; a<WXSIZEOF(g_placeAlgorithms); a++)
+    {
+        if (!algorithm.empty() && algorithm != g_placeAlgorithms[a].name)
+            continue;
+
+        // each algorithm starts from the circuit as it was loaded
+        svCircuit placed(ckt);
+        placed.getHyperGraph();
+
+        resetPeakMemory();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        wxRect bb = placed.placeDevices(g_placeAlgorithms[a].algorithm);
+        double elapsed = getElapsedSec(start);
+        long peakKB = getPeakMemoryKB();
+
+        fprintf(stderr, "%-24s %10lu devices  %-16s %10.3f s\n", ckt.getName().c_str(),
+                (unsigned long)ckt.getDevices().size(), g_placeAlgorithms[a].name, elapsed);
+
+        fprintf(report, "%s\n    {\n", first ? "" : ",");
+        fprintf(report, "      \"circuit\": %s,\n", getJSONString(ckt.getName()).c_str());
+        fprintf(report, "      \"source\": %s,\n", getJSONString(source).c_str());
+        fprintf(report, "      \"devices\": %lu,\n", (unsigned long)ckt.getDevices().size());
+        fprintf(report, "      \"nets\": %lu,\n", (unsigned long)ckt.getNodesCount());
+        fprintf(report, "      \"algorithm\": \"%s\",\n", g_placeAlgorithms[a].name);
+        fprintf(report, "      \"time_s\": %.6f,\n", elapsed);
+        fprintf(report, "      \"peak_rss_kb\": %ld,\n", peakKB);
+        fprintf(report, "      \"airwire_length\": %.1f,\n", getAirwireLength(placed));
+        fprintf(report, "      \"overlaps\": %lu,\n", (unsigned long)getOverlapsCount(placed));
+        fprintf(report, "      \"crossings\": %lu,\n", (unsigned long)placed.getAirwireCrossingsCount());
+        fprintf(report, "      \"bbox_width\": %d,\n", bb.width);
+        fprintf(report, "      \"bbox_height\": %d,\n", bb.height);
+        fprintf(report, "      \"bbox_area\": %lld\n", (long long)bb.width*bb.height);
+        fprintf(report, "    }");
+        fflush(report);
+        first = false;
+    }
+}
+
+//! Runs all the placement algorithms on all the subcircuits of the given
+//! netlists and on random circuits with 1k to @a maxNodes nodes, writing a
+//! JSON report to the given file (or to stdout).
+static bool benchPlacement(const wxArrayString& netlists, unsigned int maxNodes, unsigned int seed,
+                           const wxString& algorithm, const wxString& reportFile)
+{
+    bool known = algorithm.empty();
+    for (size_t a=0; a<WXSIZEOF(g_placeAlgorithms); a++)
+        known = known || algorithm == g_placeAlgorithms[a].name;
+    if (!known)
+    {
+        wxLogError("Unknown placement algorithm '%s'", algorithm);
+        return false;
+    }
+
+    FILE* report = reportFile.empty() ? stdout : fopen(reportFile.ToStdString().c_str(), "w");
+    if (!report)
+    {
+        wxLogError("Cannot write the report file '%s'", reportFile);
+        return false;
+    }
+
+    fprintf(report, "{\n  \"threads\": %u,\n  \"seed\": %u,\n  \"runs\": [", svGetThreadsCount(), seed);
+
+    bool ok = true, first = true;
+    for (size_t i=0; i<netlists.size(); i++)
+    {
+        svParserSPICE parser;
+        svCircuitArray subcktArray;
+        if (!parser.load(subcktArray, netlists[i].ToStdString()))
+        {
+            wxLogError("Error while parsing the netlist file '%s'", netlists[i]);
+            ok = false;
+            continue;
+        }
+
+        for (size_t j=0; j<subcktArray.size(); j++)
+            benchPlacementOf(subcktArray[j], netlists[i], algorithm, report, first);
+    }
+
+    for (unsigned int n=1000; n<=maxNodes; n*=10)
+    {
+        svCircuit ckt;
+        generateCircuit(ckt, n, seed);
+        benchPlacementOf(ckt, "generated", algorithm, report, first);
+    }
+
+    fprintf(report, "\n  ]\n}\n");
+    if (report != stdout)
+        fclose(report);
+    return ok;
+}
+
+// ----------------------------------------------------------------------------
+// queries
+// ----------------------------------------------------------------------------
+
+//! Loads the given subcircuit (or the first one, if @a subckt is empty) from
+//! the given SPICE netlist.
+static bool loadCircuit(svCircuit& ckt, const wxString& filename, const wxString& subckt)
+{
+    svParserSPICE parser;
+    svCircuitArray subcktArray;
+    if (!parser.load(subcktArray, filename.ToStdString()))
+    {
+        wxLogError("Error while parsing the netlist file '%s'", filename);
+        return false;
+    }
+
+    for (size_t i=0; i<subcktArray.size(); i++)
+        if (subckt.empty() || subckt.CmpNoCase(subcktArray[i].getName()) == 0)
+        {
+            ckt = subcktArray[i];
+            return true;
+        }
+
+    if (subckt.empty())
+        wxLogError("The netlist file '%s' didn't contain any subcircuit", filename);
+    else
+        wxLogError("The netlist file '%s' has no subcircuit named '%s'", filename, subckt);
+    return false;
+}
+
+//! Returns the index of the given node or svInvalidNodeIndex, logging an error.
+static unsigned int getNodeIndexOrLog(const svCircuit& ckt, const wxString& node)
+{
+    unsigned int idx = ckt.getNodeIndex(node.Lower().ToStdString());     // like the parser does
+    if (idx == svInvalidNodeIndex)
+        wxLogError("The subcircuit '%s' has no node named '%s'", ckt.getName(), node);
+    return idx;
+}
+
+static bool queryNetPins(const svCircuit& ckt, const wxString& node)
+{
+    unsigned int idx = getNodeIndexOrLog(ckt, node);
+    if (idx == svInvalidNodeIndex)
+        return false;
+
+    const svPinRefArray& pins = ckt.getNodePins(idx);
+    for (size_t i=0; i<pins.size(); i++)
+        printf("%s\n", ckt.getPinDescription(pins[i]).c_str());
+    return true;
+}
+
+static bool queryFanout(const svCircuit& ckt, const wxString& node)
+{
+    unsigned int idx = getNodeIndexOrLog(ckt, node);
+    if (idx == svInvalidNodeIndex)
+        return false;
+
+    printf("%u\n", ckt.getNodeFanout(idx));
+    return true;
+}
+
+static bool queryComponents(const svCircuit& ckt)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<unsigned int> component;
+    unsigned int n = ckt.getConnectedComponents(component);
+    double elapsed = getElapsedSec(start);
+
+    std::vector<unsigned int> sizes(n, 0);
+    for (size_t i=0; i<component.size(); i++)
+        sizes[component[i]]++;
+
+    printf("%u connected components (%.4f s)\n", n, elapsed);
+    for (unsigned int c=0; c<n; c++)
+        printf("component %u: %u devices\n", c, sizes[c]);
+    return true;
+}
+
+static bool queryPath(const svCircuit& ckt, const wxString& pins)
+{
+    svPinRef from, to;
+    if (!ckt.findPin(pins.BeforeFirst(',').ToStdString(), from) ||
+        !ckt.findPin(pins.AfterFirst(',').ToStdString(), to))
+    {
+        wxLogError("Invalid pins '%s': expected e.g. R1:0,M2:1", pins);
+        return false;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    svPinRefArray path = ckt.getShortestPath(from, to);
+    double elapsed = getElapsedSec(start);
+
+    if (path.empty())
+        printf("no path (%.4f s)\n", elapsed);
+    else
+    {
+        printf("path through %lu devices (%.4f s)\n", (unsigned long)(path.size()/2 - 1), elapsed);
+        for (size_t i=0; i<path.size(); i++)
+            printf("%s\n", ckt.getPinDescription(path[i]).c_str());
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// main
+// ----------------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    wxInitializer initializer(argc, argv);
+    if (!initializer.IsOk())
+    {
+        fprintf(stderr, "Failed to initialize the wxWidgets library, aborting.");
+        return 1;
+    }
+
+    wxCmdLineParser parser(g_cmdLineDesc, argc, argv);
+    if (parser.Parse() != 0)
+        return 1;       // help was shown or there was a syntax error
+
+    svDeviceFactory::registerAllDevices();
+    setlocale(LC_NUMERIC, "C");
+
+    long maxNodes = DEFAULT_BENCH_MAX_NODES, seed = DEFAULT_BENCH_SEED;
+    parser.Found("max-nodes", &maxNodes);
+    parser.Found("seed", &seed);
+
+    int ret = 0;
+    wxString subckt, query;
+    parser.Found("subckt", &subckt);
+    if (parser.Found("bench-graph"))
+        benchGraph((unsigned int)maxNodes, (unsigned int)seed);
+    else if (parser.Found("bench-placement"))
+    {
+        wxString algorithm, reportFile;
+        parser.Found("algorithm", &algorithm);
+        parser.Found("report", &reportFile);
+
+        wxArrayString netlists;
+        for (size_t i=0; i<parser.GetParamCount(); i++)
+            netlists.push_back(parser.GetParam(i));
+        ret = benchPlacement(netlists, (unsigned int)maxNodes, (unsigned int)seed,
+                             algorithm, reportFile) ? 0 : 1;
+    }
+    else if (parser.GetParamCount() == 1)
+    {
+        svCircuit ckt;
+        bool ok = loadCircuit(ckt, parser.GetParam(0), subckt);
+        if (ok && parser.Found("net-pins", &query))
+            ok = queryNetPins(ckt, query);
+        if (ok && parser.Found("fanout", &query))
+            ok = queryFanout(ckt, query);
+        if (ok && parser.Found("components"))
+            ok = queryComponents(ckt);
+        if (ok && parser.Found("path", &query))
+            ok = queryPath(ckt, query);
+        ret = ok ? 0 : 1;
+    }
+    else
+    {
+        parser.Usage();
+        ret = 1;
+    }
+
+    svDeviceFactory::unregisterAllDevices();
+    return ret;
+}
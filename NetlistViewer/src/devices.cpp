@@ -25,9 +25,6 @@
 
 #include <algorithm>
 
-#include <boost/graph/kamada_kawai_spring_layout.hpp>
-#include <boost/graph/circle_layout.hpp>
-
 #include "netlist.h"
 #include "devices.h"
 
@@ -52,6 +49,7 @@ template<> void svDeviceFactory::registerAllDevicesForSerialization<boost::archi
 
 svBaseDeviceArray svDeviceFactory::s_registered;
 wxGraphicsPath svExternalPin::s_path;
+wxGraphicsPath svOffSheetConnector::s_path;
 wxGraphicsPath svCapacitor::s_path;
 wxGraphicsPath svResistor::s_path;
 wxGraphicsPath svInductor::s_path;
@@ -67,6 +65,8 @@ wxGraphicsPath svSource::s_pathDipendent;
 wxGraphicsPath svSource::s_pathCurrentArrow;
 wxGraphicsPath svSource::s_pathVoltageSigns;
 wxGraphicsPath svCircuit::s_pathGround;
+wxGraphicsPath svCircuit::s_pathSupplyUp;
+wxGraphicsPath svCircuit::s_pathSupplyDown;
 
 
 // ----------------------------------------------------------------------------
@@ -87,11 +87,13 @@ void svDeviceFactory::registerAllDevices()
     svDeviceFactory::registerDevice(new svJFET);
     svDeviceFactory::registerDevice(new svGSource);
     svDeviceFactory::registerDevice(new svESource);
+    svDeviceFactory::registerDevice(new svSubcircuitInstance);
 }
 
 void svDeviceFactory::initGraphics(wxGraphicsContext* gc, unsigned int gridSpacing)
 {
     svExternalPin::initGraphics(gc, gridSpacing);
+    svOffSheetConnector::initGraphics(gc, gridSpacing);
     svCapacitor::initGraphics(gc, gridSpacing);
     svResistor::initGraphics(gc, gridSpacing);
     svInductor::initGraphics(gc, gridSpacing);
@@ -109,6 +111,7 @@ void svDeviceFactory::initGraphics(wxGraphicsContext* gc, unsigned int gridSpaci
 void svDeviceFactory::releaseGraphics()
 {
     svExternalPin::releaseGraphics();
+    svOffSheetConnector::releaseGraphics();
     svCapacitor::releaseGraphics();
     svResistor::releaseGraphics();
     svInductor::releaseGraphics();
@@ -103,6 +103,11 @@ public:     // misc functions
     std::string getName() const
         { return m_name; }
 
+    //! Returns the name of this device as written in a SPICE netlist,
+    //! i.e. prefixed by its SPICE identifier (e.g. "R1").
+    std::string getSPICEName() const
+        { return getSPICEid() ? getSPICEid() + m_name : m_name; }
+
 public:     // node management functions
 
     //! Adds the given node name to the list of nodes connected to this device.
@@ -211,6 +216,10 @@ public:     // drawing functions
     void setRotation(svRotation rot)
         { m_rotation=rot; }
 
+    //! Returns the rotation value for this device.
+    svRotation getRotation() const
+        { return m_rotation; }
+
     //! Rotates this device clockwise.
     void rotateClockwise()
         {
@@ -344,6 +353,81 @@ public:
         { return getRealBoundingBoxFromPath(s_path, gridSpacing); }
 };
 
+//! An off-sheet connector: marks a net which continues on other sheets of the
+//! schematic (see svCircuit::splitIntoSheets). It behaves like an external pin
+//! of the sheet.
+class svOffSheetConnector : public svExternalPin
+{
+    //! The graphics path. Filled by initGraphics(), it's used by draw() for painting.
+    static wxGraphicsPath s_path;
+
+    //! The (zero-based) indexes of the other sheets where the net continues.
+    std::vector<unsigned int> m_sheets;
+
+private:     // serialization functions
+    friend class boost::serialization::access;
+
+    template<class Archive>
+    void serialize(Archive & ar, const unsigned int WXUNUSED(version))
+    {
+        ar & boost::serialization::base_object<svExternalPin>(*this);
+        ar & m_sheets;
+    }
+
+public:
+    svOffSheetConnector(const svNode& node = "",
+                        const std::vector<unsigned int>& sheets = std::vector<unsigned int>())
+        : svExternalPin(node), m_sheets(sheets) {}
+
+    //! Returns the indexes of the other sheets where the net continues.
+    const std::vector<unsigned int>& getSheets() const
+        { return m_sheets; }
+
+    //! Returns the list of the other sheets (numbered from one).
+    virtual wxString getDescription() const
+    {
+        wxString ret = m_sheets.size() > 1 ? "sheets " : "sheet ";
+        for (size_t i=0; i<m_sheets.size(); i++)
+            ret += wxString::Format(i == 0 ? "%u" : ", %u", m_sheets[i] + 1);
+        return ret;
+    }
+
+    std::string getHumanReadableDesc() const { return "OFF-SHEET CONNECTOR"; }
+    svBaseDevice* clone() const { return new svOffSheetConnector(*this); }
+
+    static void initGraphics(wxGraphicsContext* gc, unsigned int gridSpacing)
+    {
+        wxRealPoint nodePos(0,0);
+        double l = gridSpacing/4.0;
+
+        s_path = gc->CreatePath();
+        wxASSERT(!s_path.IsNull());
+
+        // draw wires
+        drawLine(s_path, nodePos, nodePos + wxRealPoint(0, -l));
+
+        // draw a flag pointing away from the net
+        s_path.MoveToPoint(-l, -l);
+        s_path.AddLineToPoint(l, -l);
+        s_path.AddLineToPoint(l, -2.5*l);
+        s_path.AddLineToPoint(0, -3.5*l);
+        s_path.AddLineToPoint(-l, -2.5*l);
+        s_path.CloseSubpath();
+    }
+
+    static void releaseGraphics()
+        { s_path.UnRef(); }
+
+    void draw(wxGraphicsContext* gc, unsigned int gridSpacing, const wxPen& pen) const
+    {
+        setupGC(gc, gridSpacing, pen);
+        gc->StrokePath(s_path);
+    }
+
+    wxRect getRealBoundingBox(unsigned int gridSpacing) const
+        { return getRealBoundingBoxFromPath(s_path, gridSpacing); }
+};
+
 // ----------------------------------------------------------------------------
 // passive devices
 // ----------------------------------------------------------------------------
@@ -1412,6 +1496,118 @@ public:
 
 
 
+// ----------------------------------------------------------------------------
+// subcircuit instances
+// ----------------------------------------------------------------------------
+
+//! An instance of a subcircuit (the X device of SPICE). It's drawn as a box (a
+//! "macro") as large as the layout of the subcircuit definition, with its pins
+//! in the positions of the external pins of the definition (see setMacro()).
+class svSubcircuitInstance : public svBaseDevice
+{
+    //! The name of the instantiated subcircuit (lowercase).
+    std::string m_subcktName;
+
+    //! The positions of the pins, relative to the first one, with no rotation.
+    //! Empty until setMacro() is called.
+    std::vector<wxPoint> m_pinPositions;
+
+    //! The cells covered by the instance, relative to the first pin, with no rotation.
+    wxRect m_box;
+
+    //! Returns the given (relative) point rotated like this device.
+    wxPoint rotate(const wxPoint& pt) const
+    {
+        switch (m_rotation)
+        {
+        case SVR_0:   return pt;
+        case SVR_90:  return wxPoint(-pt.y, pt.x);
+        case SVR_180: return wxPoint(-pt.x, -pt.y);
+        case SVR_270: return wxPoint(pt.y, -pt.x);
+        }
+        return pt;
+    }
+
+    //! Returns the cells covered by the instance, relative to the first pin.
+    //! Before setMacro() is called, the pins are drawn in a column.
+    wxRect getRotatedBox() const
+    {
+        wxRect box = m_pinPositions.empty() ? wxRect(0, 0, 3, std::max<int>(m_nodes.size(), 1)) : m_box;
+        wxPoint a = rotate(box.GetTopLeft()), b = rotate(box.GetBottomRight());
+        return wxRect(wxPoint(std::min(a.x, b.x), std::min(a.y, b.y)),
+                      wxPoint(std::max(a.x, b.x), std::max(a.y, b.y)));
+    }
+
+private:     // serialization functions
+    friend class boost::serialization::access;
+
+    template<class Archive>
+    void serialize(Archive & ar, const unsigned int WXUNUSED(version))
+    {
+        ar & boost::serialization::base_object<svBaseDevice>(*this);
+        ar & m_subcktName;
+        ar & m_pinPositions;
+        ar & m_box;
+    }
+
+public:
+    svSubcircuitInstance(const std::string& subcktName = "")
+        : m_subcktName(subcktName) {}
+
+    //! Returns the name of the instantiated subcircuit (lowercase).
+    const std::string& getSubcircuitName() const
+        { return m_subcktName; }
+
+    //! Sets the layout of the instance: the positions of its pins and the cells
+    //! it covers, both relative to the position of the first pin.
+    void setMacro(const std::vector<wxPoint>& pinPositions, const wxRect& box)
+        {
+            wxASSERT(pinPositions.size() == m_nodes.size());
+            m_pinPositions = pinPositions;
+            m_box = box;
+        }
+
+    //! The number of nodes of an instance is the number of nodes it was given.
+    unsigned int getNodesCount() const { return m_nodes.size(); }
+
+    wxPoint getRelativeGridNodePosition(unsigned int nodeIdx) const
+    {
+        wxASSERT(nodeIdx < m_nodes.size());
+        if (nodeIdx >= m_nodes.size())
+            return svInvalidPoint;
+        return rotate(m_pinPositions.empty() ? wxPoint(0, nodeIdx) : m_pinPositions[nodeIdx]);
+    }
+
+    int getTopmostGridNodePosition() const { return getRotatedBox().GetTop(); }
+    int getLeftmostGridNodePosition() const { return getRotatedBox().GetLeft(); }
+    int getRightmostGridNodePosition() const { return getRotatedBox().GetRight(); }
+    int getBottommostGridNodePosition() const { return getRotatedBox().GetBottom(); }
+
+    //! The parameters of the instance (PARAM=VALUE) don't change its drawing.
+    bool parseSPICEProperty(unsigned int WXUNUSED(j), const std::string& WXUNUSED(prop))
+        { return true; }
+
+    char getSPICEid() const { return 'X'; }
+    std::string getHumanReadableDesc() const { return "SUBCIRCUIT"; }
+    svBaseDevice* clone() const { return new svSubcircuitInstance(*this); }
+
+    void draw(wxGraphicsContext* gc, unsigned int gridSpacing, const wxPen& pen) const
+    {
+        wxRect box = m_pinPositions.empty() ? wxRect(0, 0, 3, std::max<int>(m_nodes.size(), 1)) : m_box;
+
+        setupGC(gc, gridSpacing, pen);
+        gc->DrawRectangle(box.x*gridSpacing, box.y*gridSpacing,
+                          (box.width - 1)*gridSpacing, (box.height - 1)*gridSpacing);
+        gc->DrawText(m_subcktName, box.x*gridSpacing + 2, box.y*gridSpacing + 2);
+    }
+
+    wxRect getRealBoundingBox(unsigned int gridSpacing) const
+    {
+        wxRect box = getRotatedBox();
+        return wxRect((m_position.x + box.x)*gridSpacing, (m_position.y + box.y)*gridSpacing,
+                      (box.width - 1)*gridSpacing, (box.height - 1)*gridSpacing);
+    }
+};
 
 
 
@@ -1448,6 +1644,8 @@ public:
         ar.template register_type<svJFET>();
         ar.template register_type<svGSource>();
         ar.template register_type<svESource>();
+        ar.template register_type<svSubcircuitInstance>();
+        ar.template register_type<svOffSheetConnector>();
     }
 
     static void initGraphics(wxGraphicsContext* gc, unsigned int gridSpacing);
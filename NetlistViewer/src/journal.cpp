@@ -0,0 +1,266 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        journal.cpp
+// Purpose:     append-only journal of the layout edits of a NVS schematic
+// Author:      Francesco Montorsi
+// Created:     18/10/2026
+// Copyright:   (c) 2026 Francesco Montorsi
+// Licence:     GPL licence
+/////////////////////////////////////////////////////////////////////////////
+
+// ============================================================================
+// declarations
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// headers
+// ----------------------------------------------------------------------------
+
+#include <wx/wx.h>
+#include <wx/filefn.h>
+
+#include <sstream>
+
+#include "journal.h"
+#include "devices.h"
+
+// the first line of each journal file:
+#define JOURNAL_HEADER          "NVSJOURNAL 1"
+
+
+// ============================================================================
+// implementation
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// svEditJournal
+// ----------------------------------------------------------------------------
+
+svEditJournal::svEditJournal()
+{
+    m_compacting = false;
+    m_compactSucceeded = false;
+    m_compactSeq = 0;
+    m_pendingSnapshot = NULL;
+}
+
+/* static */
+bool svEditJournal::read(const std::string& journalFilename, std::vector<svEditRecord>& ret)
+{
+    ret.clear();
+
+    std::ifstream ifs(journalFilename.c_str());
+    if (ifs.fail())
+        return true;        // no journal: no edits to replay
+
+    std::string line;
+    if (!std::getline(ifs, line) || line != JOURNAL_HEADER)
+    {
+        wxLogError("The journal file '%s' is not valid", journalFilename);
+        return false;
+    }
+
+    while (std::getline(ifs, line))
+    {
+        std::istringstream iss(line);
+        svEditRecord rec;
+        int rot;
+        if (!(iss >> rec.seq >> rec.device >> rec.position.x >> rec.position.y >> rot) ||
+            rot < SVR_0 || rot > SVR_270)
+        {
+            // this is typically the last line, partially written when the
+            // program crashed: all previous edits are still good
+            break;
+        }
+
+        rec.rotation = svRotation(rot);
+        ret.push_back(rec);
+    }
+
+    return true;
+}
+
+bool svEditJournal::open(svCircuit& ckt, const std::string& baseFilename)
+{
+    close();
+
+    std::vector<svEditRecord> records;
+    if (!read(getJournalFilename(baseFilename), records))
+        return false;
+
+    // apply the edits which were not compacted into the base file yet:
+    const std::vector<svBaseDevice*>& devices = ckt.getDevices();
+    for (size_t i=0; i<records.size(); i++)
+    {
+        const svEditRecord& rec = records[i];
+        if (rec.seq <= ckt.getEditSeq())
+            continue;
+
+        if (rec.device >= devices.size())
+        {
+            wxLogError("The journal of '%s' references an invalid device; ignoring it", baseFilename);
+            continue;
+        }
+
+        devices[rec.device]->setGridPosition(rec.position);
+        devices[rec.device]->setRotation(rec.rotation);
+        ckt.setEditSeq(rec.seq);
+        m_records.push_back(rec);
+    }
+
+    ckt.updateBoundingBox();
+
+    m_baseFilename = baseFilename;
+    return rewrite();
+}
+
+void svEditJournal::close()
+{
+    finishCompaction();
+
+    if (m_stream.is_open())
+        m_stream.close();
+    m_records.clear();
+    m_baseFilename.clear();
+}
+
+bool svEditJournal::rewrite()
+{
+    if (m_stream.is_open())
+        m_stream.close();
+
+    // write the new journal aside and then replace the old one, so that
+    // a crash in the middle of this function does not lose any edit
+    std::string journalFilename = getJournalFilename(m_baseFilename);
+    std::string tempFilename = journalFilename + ".tmp";
+    {
+        std::ofstream ofs(tempFilename.c_str(), std::ios::trunc);
+        ofs << JOURNAL_HEADER << "\n";
+        for (size_t i=0; i<m_records.size(); i++)
+        {
+            const svEditRecord& rec = m_records[i];
+            ofs << rec.seq << " " << rec.device << " "
+                << rec.position.x << " " << rec.position.y << " " << int(rec.rotation) << "\n";
+        }
+
+        ofs.close();
+        if (ofs.fail() || !wxRenameFile(tempFilename, journalFilename, true /* overwrite */))
+        {
+            wxLogError("Error while writing the journal file '%s'", journalFilename);
+            return false;
+        }
+    }
+
+    m_stream.open(journalFilename.c_str(), std::ios::app);
+    if (m_stream.fail())
+    {
+        wxLogError("Error while opening the journal file '%s'", journalFilename);
+        return false;
+    }
+
+    return true;
+}
+
+bool svEditJournal::record(svCircuit& ckt, unsigned int idx)
+{
+    if (!isOpen())
+        return false;
+
+    // if a previous compaction has completed, trim the journal now
+    if (!m_compacting)
+        finishCompaction();
+
+    const svBaseDevice* dev = ckt.getDevices().at(idx);
+
+    svEditRecord rec;
+    rec.seq = ckt.getEditSeq() + 1;
+    rec.device = idx;
+    rec.position = dev->getGridPosition();
+    rec.rotation = dev->getRotation();
+    ckt.setEditSeq(rec.seq);
+    m_records.push_back(rec);
+
+    // append & flush: this is all the I/O done for each edit
+    m_stream << rec.seq << " " << rec.device << " "
+             << rec.position.x << " " << rec.position.y << " " << int(rec.rotation) << std::endl;
+    if (m_stream.fail())
+    {
+        wxLogError("Error while writing the journal file '%s'", getJournalFilename(m_baseFilename));
+        return false;
+    }
+
+    // (a running compaction trims the journal anyway when it completes)
+    if (m_records.size() >= SV_JOURNAL_COMPACT_THRESHOLD && !m_compacting)
+        compact(ckt);
+
+    return true;
+}
+
+void svEditJournal::compact(const svCircuit& ckt)
+{
+    if (!isOpen())
+        return;
+
+    // the copy is the only O(circuit) operation done in the main thread;
+    // serialization and disk I/O happen in the secondary thread
+    svCircuit* snapshot = new svCircuit(ckt);
+
+    {
+        std::lock_guard<std::mutex> lock(m_compactMutex);
+        if (m_compacting)
+        {
+            // the running compaction will write this snapshot too
+            // (instead of an older pending one, if any)
+            delete m_pendingSnapshot;
+            m_pendingSnapshot = snapshot;
+            return;
+        }
+    }
+
+    // if a previous compaction has completed, trim the journal now
+    finishCompaction();
+
+    std::string baseFilename = m_baseFilename;
+    m_compactSucceeded = false;
+    m_compacting = true;
+    m_compactThread = std::thread([this, snapshot, baseFilename]() {
+        std::string tempFilename = baseFilename + ".tmp";
+        for (svCircuit* current = snapshot; current; )
+        {
+            unsigned long seq = current->getEditSeq();
+            bool ok = current->saveNVS(tempFilename) &&
+                      wxRenameFile(tempFilename, baseFilename, true /* overwrite */);
+            delete current;
+
+            // go on with the snapshot requested meanwhile, if any
+            std::lock_guard<std::mutex> lock(m_compactMutex);
+            if (ok)
+            {
+                m_compactSeq = seq;
+                m_compactSucceeded = true;
+            }
+            current = m_pendingSnapshot;
+            m_pendingSnapshot = NULL;
+            if (!current)
+                m_compacting = false;
+        }
+    });
+}
+
+void svEditJournal::finishCompaction()
+{
+    if (!m_compactThread.joinable())
+        return;
+
+    m_compactThread.join();
+    if (!m_compactSucceeded)
+        return;     // the edits are still in the journal: nothing is lost
+
+    // remove from the journal all edits now contained in the base file
+    std::vector<svEditRecord> remaining;
+    for (size_t i=0; i<m_records.size(); i++)
+        if (m_records[i].seq > m_compactSeq)
+            remaining.push_back(m_records[i]);
+    m_records.swap(remaining);
+
+    rewrite();
+}
@@ -0,0 +1,147 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        journal.h
+// Purpose:     append-only journal of the layout edits of a NVS schematic
+// Author:      Francesco Montorsi
+// Created:     18/10/2026
+// Copyright:   (c) 2026 Francesco Montorsi
+// Licence:     GPL licence
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+// ----------------------------------------------------------------------------
+// headers
+// ----------------------------------------------------------------------------
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+#include "netlist.h"
+
+// ----------------------------------------------------------------------------
+// constants
+// ----------------------------------------------------------------------------
+
+//! The number of journaled edits after which the journal gets compacted
+//! into the base NVS file.
+#define SV_JOURNAL_COMPACT_THRESHOLD        256
+
+//! The suffix appended to the name of the NVS file to obtain the journal file name.
+#define SV_JOURNAL_SUFFIX                   ".journal"
+
+// ----------------------------------------------------------------------------
+// svEditRecord
+// ----------------------------------------------------------------------------
+
+//! A single layout edit (a drag or a rotation of a device) stored in the journal.
+struct svEditRecord
+{
+    //! The sequence number of this edit; see svCircuit::getEditSeq().
+    unsigned long seq;
+
+    //! The index of the edited device in svCircuit::getDevices().
+    unsigned int device;
+
+    //! The new grid position of the device.
+    wxPoint position;
+
+    //! The new rotation of the device.
+    svRotation rotation;
+};
+
+// ----------------------------------------------------------------------------
+// svEditJournal
+// ----------------------------------------------------------------------------
+
+//! An append-only journal of the layout edits done on a NVS schematic.
+//! Each edit is appended (and flushed) to the journal file as soon as it's
+//! recorded, so that saving an edit costs O(1) instead of re-serializing the
+//! whole circuit. Once the journal grows past SV_JOURNAL_COMPACT_THRESHOLD
+//! edits, a snapshot of the circuit is written over the base NVS file by a
+//! secondary thread and the journal is trimmed of the edits it contains.
+//!
+//! At any point in time the base NVS file plus the edits of the journal having
+//! a sequence number greater than the one saved in the base file describe the
+//! last layout of the circuit; thus a crash loses nothing.
+class svEditJournal
+{
+    //! The name of the base NVS file.
+    std::string m_baseFilename;
+
+    //! The stream used to append edits to the journal file.
+    std::ofstream m_stream;
+
+    //! The edits currently contained in the journal file.
+    std::vector<svEditRecord> m_records;
+
+    //! The thread writing the snapshot of the circuit over the base NVS file.
+    std::thread m_compactThread;
+
+    //! True while m_compactThread is running.
+    std::atomic<bool> m_compacting;
+
+    //! Set by m_compactThread when a snapshot has been successfully written.
+    std::atomic<bool> m_compactSucceeded;
+
+    //! The sequence number of the last snapshot written by m_compactThread.
+    unsigned long m_compactSeq;
+
+    //! The snapshot requested by compact() while m_compactThread was busy
+    //! writing another one: the thread writes it as soon as it's done.
+    svCircuit* m_pendingSnapshot;
+
+    //! Protects m_compacting, m_compactSeq and m_pendingSnapshot while
+    //! m_compactThread is running.
+    std::mutex m_compactMutex;
+
+    //! Rewrites the journal file with all edits in m_records and
+    //! reopens it in append mode.
+    bool rewrite();
+
+    //! Waits for the compaction thread (if any) and trims the journal of
+    //! the edits which are now part of the base NVS file.
+    void finishCompaction();
+
+public:
+    svEditJournal();
+    ~svEditJournal()
+        { close(); }
+
+    //! Starts journaling the edits of the given circuit, which must have been
+    //! just loaded from the given NVS file.
+    //! If a journal for that NVS file already exists, the edits it contains
+    //! which are not already part of the circuit are applied to it.
+    bool open(svCircuit& ckt, const std::string& baseFilename);
+
+    //! Stops journaling, waiting for any running compaction.
+    void close();
+
+    //! Returns true if edits are currently being journaled.
+    bool isOpen() const
+        { return m_stream.is_open(); }
+
+    //! Appends to the journal the current position and rotation of the
+    //! @a idx-th device of the given circuit.
+    //! The edit sequence number of the circuit gets updated; if needed, a
+    //! background compaction is started.
+    bool record(svCircuit& ckt, unsigned int idx);
+
+    //! Starts writing a snapshot of the given circuit over the base NVS file
+    //! in a secondary thread. If a compaction is already running, the snapshot
+    //! is written as soon as it completes.
+    void compact(const svCircuit& ckt);
+
+    //! Returns the name of the journal file associated with the given NVS file.
+    static std::string getJournalFilename(const std::string& baseFilename)
+        { return baseFilename + SV_JOURNAL_SUFFIX; }
+
+    //! Reads all (valid) edits contained in the given journal file.
+    static bool read(const std::string& journalFilename, std::vector<svEditRecord>& ret);
+};
+
+#endif      // _JOURNAL_H_
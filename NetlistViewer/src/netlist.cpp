@@ -22,11 +22,11 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
 
 #include <algorithm>
-
-#include <boost/graph/kamada_kawai_spring_layout.hpp>
-#include <boost/graph/circle_layout.hpp>
+#include <map>
+#include <fstream>
 
 #include "netlist.h"
 #include "devices.h"
@@ -48,9 +48,23 @@
 
 wxPoint svInvalidPoint = wxPoint(-1e9, -1e9);
 svNode svGroundNode = svNode("0");      // SPICE conventional name for GND
+unsigned int svInvalidNodeIndex = UINT_MAX;
 
 #define ALLOWED_CHARS       "0123456789.+-"
 
+// devices with more pins than this are represented in the connectivity graph
+// as a star (centered on their first node) instead of a clique
+#define MAX_CLIQUE_PINS     4
+
+// the Steiner trees of the nets with up to this number of pins are computed
+// with the (slower but better) iterated 1-Steiner heuristic
+#define MAX_ITERATED_STEINER_PINS   6
+
+// the nodes named like a supply (see g_supplyNets) are considered supply nets
+// only if attached to at least this number of pins: a few short wires are
+// clearer than the symbols
+#define SUPPLY_MIN_PINS     4
+
 struct {
     const char* postfixShort;
     const char* postfixLong;
@@ -80,6 +94,353 @@ struct {
     { "V", "VOLT" }
 };
 
+// the (upper case) names of the supply nets, optionally followed by '_' or by
+// a digit (e.g. VDD_CORE or VCC3V3)
+struct {
+    const char* name;
+    svSupplyNet kind;
+} g_supplyNets[] =
+{
+    { "GND", SVSN_GROUND },
+    { "AGND", SVSN_GROUND },
+    { "DGND", SVSN_GROUND },
+    { "VCC", SVSN_POSITIVE },
+    { "VDD", SVSN_POSITIVE },
+    { "AVDD", SVSN_POSITIVE },
+    { "DVDD", SVSN_POSITIVE },
+    { "VPP", SVSN_POSITIVE },
+    { "VEE", SVSN_NEGATIVE },
+    { "VSS", SVSN_NEGATIVE },
+    { "AVSS", SVSN_NEGATIVE },
+    { "DVSS", SVSN_NEGATIVE },
+    { "VNN", SVSN_NEGATIVE }
+};
+
+// ----------------------------------------------------------------------------
+// helper functions
+// ----------------------------------------------------------------------------
+
+void svGetRectilinearMST(const std::vector<wxPoint>& points, std::vector<unsigned int>& parent)
+{
+    // each point is connected only to its nearest neighbours in the 8 octants
+    // around it, which always include the edges of a rectilinear MST: the
+    // candidates are found with a sweep in each of 4 octants (the other 4 give
+    // the same edges, reversed) and then Kruskal's algorithm picks the tree
+    // among them
+    size_t n = points.size();
+    parent.assign(n, UINT_MAX);
+    if (n < 2)
+        return;
+    if (n == 2)
+    {
+        parent[1] = 0;
+        return;
+    }
+
+    std::vector<wxPoint> pts(points);
+    std::vector<unsigned int> order(n);
+    for (size_t i=0; i<n; i++)
+        order[i] = i;
+
+    // candidate edges as (length, (point, point))
+    std::vector< std::pair<int, std::pair<unsigned int, unsigned int> > > edges;
+    for (int octant=0; octant<4; octant++)
+    {
+        // sweep the points by increasing x+y: the points still in the sweep
+        // whose nearest neighbour in the octant is the current point are
+        // removed from it
+        std::sort(order.begin(), order.end(), [&pts](unsigned int a, unsigned int b) {
+            return pts[a].x + pts[a].y < pts[b].x + pts[b].y ||
+                   (pts[a].x + pts[a].y == pts[b].x + pts[b].y && a < b);
+        });
+
+        std::map<int, unsigned int> sweep;      // -y => point
+        for (size_t k=0; k<n; k++)
+        {
+            unsigned int i = order[k];
+            std::map<int, unsigned int>::iterator it = sweep.lower_bound(-pts[i].y);
+            while (it != sweep.end())
+            {
+                unsigned int j = it->second;
+                int dx = pts[i].x - pts[j].x, dy = pts[i].y - pts[j].y;
+                if (dy > dx)
+                    break;
+                edges.push_back(std::make_pair(dx + dy, std::make_pair(i, j)));
+                sweep.erase(it++);
+            }
+            sweep[-pts[i].y] = i;
+        }
+
+        // move to the next octant
+        for (size_t i=0; i<n; i++)
+            if (octant & 1)
+                pts[i].x = -pts[i].x;
+            else
+                std::swap(pts[i].x, pts[i].y);
+    }
+
+    std::sort(edges.begin(), edges.end());
+
+    std::vector<unsigned int> set(n);
+    for (size_t i=0; i<n; i++)
+        set[i] = i;
+    auto find = [&set](unsigned int i) {
+        while (set[i] != i)
+            i = set[i] = set[set[i]];
+        return i;
+    };
+
+    std::vector< std::vector<unsigned int> > adjacent(n);
+    size_t nEdges = 0;
+    for (size_t e=0; e<edges.size() && nEdges < n-1; e++)
+    {
+        unsigned int i = edges[e].second.first, j = edges[e].second.second;
+        unsigned int a = find(i), b = find(j);
+        if (a == b)
+            continue;
+        set[a] = b;
+        adjacent[i].push_back(j);
+        adjacent[j].push_back(i);
+        nEdges++;
+    }
+
+    // root the tree in the first point
+    std::vector<unsigned int> queue(1, 0);
+    for (size_t head=0; head<queue.size(); head++)
+    {
+        unsigned int i = queue[head];
+        for (size_t k=0; k<adjacent[i].size(); k++)
+        {
+            unsigned int j = adjacent[i][k];
+            if (j != 0 && parent[j] == UINT_MAX)
+            {
+                parent[j] = i;
+                queue.push_back(j);
+            }
+        }
+    }
+}
+
+//! Returns the rectilinear distance of the given points.
+static int getRectilinearDistance(const wxPoint& a, const wxPoint& b)
+{
+    return abs(a.x - b.x) + abs(a.y - b.y);
+}
+
+//! Returns the length of a rectilinear minimum spanning tree of the given
+//! points, computed with Prim's algorithm in O(k^2) time (k is small here).
+static int getRectilinearMSTLength(const std::vector<wxPoint>& points)
+{
+    size_t n = points.size();
+    std::vector<int> dist(n, INT_MAX);
+    std::vector<bool> inTree(n, false);
+    int length = 0;
+    dist[0] = 0;
+    for (size_t k=0; k<n; k++)
+    {
+        size_t best = n;
+        for (size_t i=0; i<n; i++)
+            if (!inTree[i] && (best == n || dist[i] < dist[best]))
+                best = i;
+        inTree[best] = true;
+        length += dist[best];
+        for (size_t i=0; i<n; i++)
+            if (!inTree[i])
+                dist[i] = std::min(dist[i], getRectilinearDistance(points[best], points[i]));
+    }
+    return length;
+}
+
+//! Iterated 1-Steiner heuristic: adds to @a points, one at a time, the point of
+//! the Hanan grid (the intersections of the horizontal and vertical lines through
+//! the pins) which shortens the spanning tree the most, until none does.
+static void addIteratedSteinerPoints(std::vector<wxPoint>& points)
+{
+    std::vector<int> xs, ys;
+    for (size_t i=0; i<points.size(); i++)
+    {
+        xs.push_back(points[i].x);
+        ys.push_back(points[i].y);
+    }
+    std::sort(xs.begin(), xs.end());
+    xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+    std::sort(ys.begin(), ys.end());
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+    size_t nPins = points.size();
+    int length = getRectilinearMSTLength(points);
+    for (;;)
+    {
+        int bestLength = length;
+        wxPoint best;
+        for (size_t i=0; i<xs.size(); i++)
+            for (size_t j=0; j<ys.size(); j++)
+            {
+                wxPoint candidate(xs[i], ys[j]);
+                if (std::find(points.begin(), points.end(), candidate) != points.end())
+                    continue;
+
+                points.push_back(candidate);
+                int newLength = getRectilinearMSTLength(points);
+                points.pop_back();
+                if (newLength < bestLength)
+                {
+                    bestLength = newLength;
+                    best = candidate;
+                }
+            }
+        if (bestLength == length)
+            break;
+
+        points.push_back(best);
+        length = bestLength;
+
+        // the Steiner points left with less than 3 edges are useless
+        std::vector<unsigned int> parent;
+        bool removed;
+        do
+        {
+            svGetRectilinearMST(points, parent);
+            std::vector<unsigned int> degree(points.size(), 0);
+            for (size_t k=1; k<points.size(); k++)
+            {
+                degree[k]++;
+                degree[parent[k]]++;
+            }
+
+            removed = false;
+            for (size_t k=points.size(); k-- > nPins; )
+                if (degree[k] < 3)
+                {
+                    points.erase(points.begin() + k);
+                    removed = true;
+                    break;
+                }
+        }
+        while (removed);
+        length = getRectilinearMSTLength(points);
+    }
+}
+
+//! Adds to the spanning tree of @a points (as adjacency lists) a Steiner point
+//! wherever two edges leaving the same point overlap: e.g. the edges from (0,0)
+//! to (2,1) and to (2,3) share the path from (0,0) to (2,1), so they're replaced
+//! by the edges from (0,0) to (2,1) and from (2,1) to (2,3). This takes
+//! O(k log k) time for k points, since each point of a rectilinear MST has at
+//! most 8 edges. Returns false if the tree could not be shortened.
+static bool addOverlapSteinerPoints(std::vector<wxPoint>& points,
+                                    std::vector< std::vector<unsigned int> >& adjacent)
+{
+    auto getMedian = [](int a, int b, int c) {
+        return std::max(std::min(a, b), std::min(std::max(a, b), c));
+    };
+    auto removeEdge = [&adjacent](unsigned int i, unsigned int j) {
+        adjacent[i].erase(std::find(adjacent[i].begin(), adjacent[i].end(), j));
+        adjacent[j].erase(std::find(adjacent[j].begin(), adjacent[j].end(), i));
+    };
+    auto addEdge = [&adjacent](unsigned int i, unsigned int j) {
+        adjacent[i].push_back(j);
+        adjacent[j].push_back(i);
+    };
+
+    // the candidates as (-gain, (point, (neighbour, neighbour)))
+    typedef std::pair<int, std::pair<unsigned int, std::pair<unsigned int, unsigned int> > > Candidate;
+    std::vector<Candidate> candidates;
+    for (unsigned int p=0; p<points.size(); p++)
+        for (size_t i=0; i<adjacent[p].size(); i++)
+            for (size_t j=i+1; j<adjacent[p].size(); j++)
+            {
+                const wxPoint& a = points[adjacent[p][i]];
+                const wxPoint& b = points[adjacent[p][j]];
+                wxPoint s(getMedian(points[p].x, a.x, b.x), getMedian(points[p].y, a.y, b.y));
+                int gain = getRectilinearDistance(points[p], s);       // the overlap
+                if (gain > 0)
+                    candidates.push_back(Candidate(-gain, std::make_pair(p, std::make_pair(adjacent[p][i], adjacent[p][j]))));
+            }
+    std::sort(candidates.begin(), candidates.end());
+
+    // the best candidates are applied first; each edge is replaced only once
+    bool shortened = false;
+    for (size_t k=0; k<candidates.size(); k++)
+    {
+        unsigned int p = candidates[k].second.first;
+        unsigned int a = candidates[k].second.second.first, b = candidates[k].second.second.second;
+        if (std::find(adjacent[p].begin(), adjacent[p].end(), a) == adjacent[p].end() ||
+            std::find(adjacent[p].begin(), adjacent[p].end(), b) == adjacent[p].end())
+            continue;
+
+        wxPoint s(getMedian(points[p].x, points[a].x, points[b].x),
+                  getMedian(points[p].y, points[a].y, points[b].y));
+        removeEdge(p, a);
+        removeEdge(p, b);
+        shortened = true;
+        if (s == points[a])
+        {
+            addEdge(p, a);
+            addEdge(a, b);
+        }
+        else if (s == points[b])
+        {
+            addEdge(p, b);
+            addEdge(b, a);
+        }
+        else
+        {
+            unsigned int idx = points.size();
+            points.push_back(s);
+            adjacent.push_back(std::vector<unsigned int>());
+            addEdge(p, idx);
+            addEdge(idx, a);
+            addEdge(idx, b);
+        }
+    }
+    return shortened;
+}
+
+void svGetRectilinearSteinerTree(std::vector<wxPoint>& points, std::vector<unsigned int>& parent)
+{
+    if (points.size() <= 2)
+    {
+        svGetRectilinearMST(points, parent);
+        return;
+    }
+
+    if (points.size() <= MAX_ITERATED_STEINER_PINS)
+    {
+        addIteratedSteinerPoints(points);
+        svGetRectilinearMST(points, parent);
+        return;
+    }
+
+    svGetRectilinearMST(points, parent);
+    std::vector< std::vector<unsigned int> > adjacent(points.size());
+    for (size_t k=1; k<points.size(); k++)
+    {
+        adjacent[k].push_back(parent[k]);
+        adjacent[parent[k]].push_back(k);
+    }
+    // the new edges may overlap other ones
+    while (addOverlapSteinerPoints(points, adjacent))
+        ;
+
+    // root the tree in the first point
+    parent.assign(points.size(), UINT_MAX);
+    std::vector<unsigned int> queue(1, 0);
+    for (size_t head=0; head<queue.size(); head++)
+    {
+        unsigned int i = queue[head];
+        for (size_t k=0; k<adjacent[i].size(); k++)
+        {
+            unsigned int j = adjacent[i][k];
+            if (j != 0 && parent[j] == UINT_MAX)
+            {
+                parent[j] = i;
+                queue.push_back(j);
+            }
+        }
+    }
+}
+
 // ----------------------------------------------------------------------------
 // svString
 // ----------------------------------------------------------------------------
@@ -319,16 +680,222 @@ bool svParserSPICE::load(svCircuitArray& ret, const std::string& filename)
     return true;
 }
 
+// ----------------------------------------------------------------------------
+// svOccupancyGrid
+// ----------------------------------------------------------------------------
+
+template<typename F>
+bool svOccupancyGrid::forEachTile(const wxRect& rc, F fn)
+{
+    if (rc.width <= 0 || rc.height <= 0)
+        return true;
+
+    // arithmetic shifts round towards minus infinity also for negative cells
+    for (int ty = rc.GetTop() >> TILE_SHIFT; ty <= rc.GetBottom() >> TILE_SHIFT; ty++)
+    {
+        int row0 = std::max(rc.GetTop(), ty << TILE_SHIFT) - (ty << TILE_SHIFT);
+        int row1 = std::min(rc.GetBottom(), (ty << TILE_SHIFT) + TILE_SIZE - 1) - (ty << TILE_SHIFT);
+        for (int tx = rc.GetLeft() >> TILE_SHIFT; tx <= rc.GetRight() >> TILE_SHIFT; tx++)
+        {
+            int col0 = std::max(rc.GetLeft(), tx << TILE_SHIFT) - (tx << TILE_SHIFT);
+            int col1 = std::min(rc.GetRight(), (tx << TILE_SHIFT) + TILE_SIZE - 1) - (tx << TILE_SHIFT);
+            unsigned long long mask = (~0ULL >> (TILE_SIZE - 1 - (col1 - col0))) << col0;
+            if (!fn(tx, ty, row0, row1, mask))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool svOccupancyGrid::isFree(const wxRect& rc) const
+{
+    return forEachTile(rc,
+        [this](int tx, int ty, int row0, int row1, unsigned long long mask) {
+            std::unordered_map<unsigned long long, Tile>::const_iterator it = m_tiles.find(getTileKey(tx, ty));
+            if (it == m_tiles.end())
+                return true;
+            for (int row=row0; row<=row1; row++)
+                if (it->second.rows[row] & mask)
+                    return false;
+            return true;
+        });
+}
+
+bool svOccupancyGrid::isFree(const wxRect& rc, const wxRect& excluded) const
+{
+    return forEachTile(rc,
+        [this, &excluded](int tx, int ty, int row0, int row1, unsigned long long mask) {
+            std::unordered_map<unsigned long long, Tile>::const_iterator it = m_tiles.find(getTileKey(tx, ty));
+            if (it == m_tiles.end())
+                return true;
+
+            // the bits of the excluded cells inside this tile
+            wxRect ex = wxRect(tx << TILE_SHIFT, ty << TILE_SHIFT, TILE_SIZE, TILE_SIZE).Intersect(excluded);
+            unsigned long long exMask = 0;
+            int exRow0 = 0, exRow1 = -1;
+            if (!ex.IsEmpty())
+            {
+                exMask = (~0ULL >> (TILE_SIZE - ex.width)) << (ex.GetLeft() - (tx << TILE_SHIFT));
+                exRow0 = ex.GetTop() - (ty << TILE_SHIFT);
+                exRow1 = ex.GetBottom() - (ty << TILE_SHIFT);
+            }
+
+            for (int row=row0; row<=row1; row++)
+            {
+                unsigned long long bits = it->second.rows[row] & mask;
+                if (row >= exRow0 && row <= exRow1)
+                    bits &= ~exMask;
+                if (bits)
+                    return false;
+            }
+            return true;
+        });
+}
+
+void svOccupancyGrid::occupy(const wxRect& rc)
+{
+    forEachTile(rc,
+        [this](int tx, int ty, int row0, int row1, unsigned long long mask) {
+            Tile& tile = m_tiles[getTileKey(tx, ty)];
+            for (int row=row0; row<=row1; row++)
+                tile.rows[row] |= mask;
+            return true;
+        });
+}
+
+void svOccupancyGrid::release(const wxRect& rc)
+{
+    forEachTile(rc,
+        [this](int tx, int ty, int row0, int row1, unsigned long long mask) {
+            std::unordered_map<unsigned long long, Tile>::iterator it = m_tiles.find(getTileKey(tx, ty));
+            if (it != m_tiles.end())
+                for (int row=row0; row<=row1; row++)
+                    it->second.rows[row] &= ~mask;
+            return true;
+        });
+}
+
+wxRect svOccupancyGrid::findFree(const wxRect& rc, int margin) const
+{
+    for (int r=0; ; r++)
+    {
+        for (int dy=-r; dy<=r; dy++)
+            for (int dx=-r; dx<=r; dx += (dy == -r || dy == r) ? 1 : 2*r)
+            {
+                wxRect candidate(rc.x + dx, rc.y + dy, rc.width, rc.height);
+                wxRect withMargin(candidate);
+                if (isFree(withMargin.Inflate(margin, margin)))
+                    return candidate;
+            }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// svRectIndex
+// ----------------------------------------------------------------------------
+
+void svRectIndex::insert(unsigned int id, const wxRect& rc)
+{
+    if (rc.IsEmpty())
+        return;
+
+    for (int ty = rc.GetTop() >> TILE_SHIFT; ty <= rc.GetBottom() >> TILE_SHIFT; ty++)
+        for (int tx = rc.GetLeft() >> TILE_SHIFT; tx <= rc.GetRight() >> TILE_SHIFT; tx++)
+            m_tiles[getTileKey(tx, ty)].push_back(id);
+}
+
+void svRectIndex::remove(unsigned int id, const wxRect& rc)
+{
+    if (rc.IsEmpty())
+        return;
+
+    for (int ty = rc.GetTop() >> TILE_SHIFT; ty <= rc.GetBottom() >> TILE_SHIFT; ty++)
+        for (int tx = rc.GetLeft() >> TILE_SHIFT; tx <= rc.GetRight() >> TILE_SHIFT; tx++)
+        {
+            std::unordered_map<unsigned long long, std::vector<unsigned int> >::iterator it =
+                m_tiles.find(getTileKey(tx, ty));
+            if (it == m_tiles.end())
+                continue;
+
+            std::vector<unsigned int>& ids = it->second;
+            std::vector<unsigned int>::iterator found = std::find(ids.begin(), ids.end(), id);
+            if (found != ids.end())
+            {
+                *found = ids.back();
+                ids.pop_back();
+            }
+            if (ids.empty())
+                m_tiles.erase(it);
+        }
+}
+
+void svRectIndex::query(const wxRect& rc, std::vector<unsigned int>& ids) const
+{
+    ids.clear();
+    if (rc.IsEmpty())
+        return;
+
+    for (int ty = rc.GetTop() >> TILE_SHIFT; ty <= rc.GetBottom() >> TILE_SHIFT; ty++)
+        for (int tx = rc.GetLeft() >> TILE_SHIFT; tx <= rc.GetRight() >> TILE_SHIFT; tx++)
+        {
+            std::unordered_map<unsigned long long, std::vector<unsigned int> >::const_iterator it =
+                m_tiles.find(getTileKey(tx, ty));
+            if (it != m_tiles.end())
+                ids.insert(ids.end(), it->second.begin(), it->second.end());
+        }
+
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
 // ----------------------------------------------------------------------------
 // svCircuit
 // ----------------------------------------------------------------------------
 
 void svCircuit::addExternalNode(const svNode& extNode)
 { 
-    m_nodes.insert(extNode); 
+    addNode(extNode); 
     addDevice(new svExternalPin(extNode));
 }
 
+void svCircuit::internNode(const svNode& name)
+{
+    m_nodeIndexes[name] = m_nodeNames.size();
+    m_nodeNames.push_back(name);
+    m_nodePins.push_back(svPinRefArray());
+    m_hyperGraphValid = false;
+}
+
+void svCircuit::rebuildNodeTable()
+{
+    std::vector<svNode> order;
+    order.swap(m_nodeNames);
+    m_nodeIndexes.clear();
+    m_nodePins.clear();
+    m_nodeNames.reserve(m_nodes.size());
+    for (size_t i=0; i<order.size(); i++)
+        if (m_nodes.count(order[i]) && !m_nodeIndexes.count(order[i]))
+            internNode(order[i]);
+    for (std::set<svNode>::const_iterator i = m_nodes.begin(); i != m_nodes.end(); i++)
+        if (!m_nodeIndexes.count(*i))
+            internNode(*i);
+
+    for (size_t i=0; i<m_devices.size(); i++)
+        indexDevice(i);
+    m_occupancyValid = false;
+}
+
+void svCircuit::indexDevice(unsigned int idx)
+{
+    const std::vector<svNode>& deviceNodes = m_devices[idx]->getNodes();
+    for (size_t j=0; j<deviceNodes.size(); j++)
+    {
+        addNode(deviceNodes[j]);        // in case it's a new node
+        m_nodePins[getNodeIndex(deviceNodes[j])].push_back(svPinRef(idx, j));
+    }
+}
+
 bool svCircuit::parseSPICESubCkt(const wxArrayString& lines, size_t startIdx, size_t endIdx)
 {
     release();
@@ -346,6 +913,33 @@ bool svCircuit::parseSPICESubCkt(const wxArrayString& lines, size_t startIdx, si
         if (comp_name == ".MODEL")
             continue;
 
+        // subcircuit instances have any number of nodes, followed by the name of
+        // the subcircuit and by optional parameters (PARAMS: NAME=VALUE ...)
+        if (comp_name.Upper()[0] == 'X')
+        {
+            size_t nameIdx = arr.size();
+            while (nameIdx > 0 && (arr[nameIdx-1].Contains("=") || arr[nameIdx-1].Upper() == "PARAMS:"))
+                nameIdx--;
+            if (nameIdx < 2)
+            {
+                wxLogError("At line %d: subcircuit instance '%s' needs one or more nodes and the subcircuit name",
+                           i, comp_name);
+                return false;
+            }
+
+            svSubcircuitInstance* inst = new svSubcircuitInstance(arr[nameIdx-1].Lower().ToStdString());
+            inst->setName(comp_name.substr(1).ToStdString());
+            for (size_t j=0; j<nameIdx-1; j++)
+            {
+                std::string nodeName = arr[j].Lower().ToStdString();
+                addNode(nodeName);
+                inst->addNode(nodeName);
+            }
+
+            addDevice(inst);
+            continue;
+        }
+
         // first letter of the component identifies it:
         svBaseDevice* dev = svDeviceFactory::getDeviceMatchingIdentifier(comp_name.Upper()[0]);
         if (!dev)
@@ -395,143 +989,202 @@ bool svCircuit::parseSPICESubCkt(const wxArrayString& lines, size_t startIdx, si
 
 svUGraph svCircuit::buildGraph() const
 {
-    if (m_nodes.empty())
-        return svUGraph(0);
-
-    // first, convert the std::set containing the circuit's nodes to a std::vector
-    // so that we can associate each circuit node with a number (the node's index) 
-    std::vector<svNode> circuitNodes;
-    for (std::set<svNode>::const_iterator i = m_nodes.begin(); i != m_nodes.end(); i++)
-        circuitNodes.push_back(*i);
+    typedef std::pair<unsigned int, unsigned int> svEdge;
+    std::vector<svEdge> edges;
 
-    wxASSERT(circuitNodes[0] == svGroundNode);
-    svUGraph ug(circuitNodes.size()-1 /* the node 0 (GND) does not need to be part of the graph */);
+    // the supply nets are global: they don't connect their devices
+    std::vector<bool> supply(m_nodeNames.size());
+    for (unsigned int i=0; i<m_nodeNames.size(); i++)
+        supply[i] = getSupplyNetKind(i) != SVSN_NONE;
 
-    // now create an "edge" in the graph for each device
+    // now create an "edge" in the graph between all nodes of each device
+    // (all nodes of the same device should be placed nearby...)
+    std::vector<unsigned int> deviceNodeIndexes;
     for (size_t i=0; i<m_devices.size(); i++)
     {
-        // all nodes of the same device should be placed nearby...
+        // resolve the device's nodes through the interned node table
         const std::vector<svNode>& deviceNodes = m_devices[i]->getNodes();
-        std::vector<int> deviceNodeIndexes;
+        deviceNodeIndexes.clear();
         for (size_t j=0; j<deviceNodes.size(); j++)
         {
-            if (deviceNodes[j] != svGroundNode)
+            unsigned int idx = getNodeIndex(deviceNodes[j]);
+            wxASSERT(idx != svInvalidNodeIndex);
+            if (!supply[idx])
+                deviceNodeIndexes.push_back(idx);
+        }
+
+        // each undirected edge is stored in both directions;
+        // devices with many pins are connected as a star to keep the
+        // number of edges linear in the number of pins
+        size_t n = deviceNodeIndexes.size();
+        size_t nCenters = n > MAX_CLIQUE_PINS ? 1 : n;
+        for (size_t j=0; j<nCenters; j++)
+        {
+            for (size_t k=j+1; k<n; k++)
             {
-                // find this node in the circuit's vector of nodes
-                std::vector<svNode>::const_iterator 
-                    result = find(circuitNodes.begin(), circuitNodes.end(), deviceNodes[j]);
-                wxASSERT(result != circuitNodes.end());
-                
-                deviceNodeIndexes.push_back(result - circuitNodes.begin() - 1);
+                if (deviceNodeIndexes[j] == deviceNodeIndexes[k])
+                    continue;       // e.g. a device with two pins shorted together
+                edges.push_back(svEdge(deviceNodeIndexes[j], deviceNodeIndexes[k]));
+                edges.push_back(svEdge(deviceNodeIndexes[k], deviceNodeIndexes[j]));
             }
         }
-
-        for (size_t j=0; j<deviceNodeIndexes.size(); j++)
-            for (size_t k=0; k<deviceNodeIndexes.size(); k++)
-                if (k != j)
-                    add_edge(deviceNodeIndexes[j], deviceNodeIndexes[k], ug);
     }
 
-    return ug;
+    // the CSR graph is built from the unsorted edge list with a counting
+    // sort, i.e. in O(nodes + edges)
+    return svUGraph(boost::edges_are_unsorted_multi_pass,
+                    edges.begin(), edges.end(), m_nodeNames.size());
 }
 
-const wxRect& svCircuit::placeDevices(svPlaceAlgorithm ag)
+svHyperGraph svCircuit::buildHyperGraph() const
 {
-    m_bb = wxRect(0,0,0,0);
+    svHyperGraph hg;
 
-    if (m_devices.size() == 0)
-        return m_bb;
+    // device => nets incidences
+    hg.m_deviceOffsets.reserve(m_devices.size()+1);
+    hg.m_deviceOffsets.push_back(0);
+    for (size_t i=0; i<m_devices.size(); i++)
+    {
+        const std::vector<svNode>& deviceNodes = m_devices[i]->getNodes();
+        for (size_t j=0; j<deviceNodes.size(); j++)
+            hg.m_deviceNets.push_back(getNodeIndex(deviceNodes[j]));
+        hg.m_deviceOffsets.push_back(hg.m_deviceNets.size());
+    }
 
-    switch (ag)
+    // net => devices incidences, directly from the connectivity index
+    hg.m_netOffsets.reserve(m_nodeNames.size()+1);
+    hg.m_netOffsets.push_back(0);
+    hg.m_netDevices.reserve(hg.m_deviceNets.size());
+    hg.m_netPins.reserve(hg.m_deviceNets.size());
+    hg.m_supplyNets.resize(m_nodeNames.size(), SVSN_NONE);
+    for (size_t i=0; i<m_nodeNames.size(); i++)
     {
-    case SVPA_PLACE_NON_OVERLAPPED:
+        const svPinRefArray& pins = m_nodePins[i];
+        for (size_t j=0; j<pins.size(); j++)
         {
-            wxPoint lastPt;
+            hg.m_netDevices.push_back(pins[j].device);
+            hg.m_netPins.push_back(pins[j].pin);
+        }
+        hg.m_netOffsets.push_back(hg.m_netDevices.size());
 
-            // first place all external pins in a row
-            std::vector<unsigned int> idx_external_pins;
-            for (unsigned int i=0; i<m_devices.size(); i++)
-                if (std::string(typeid(*m_devices[i]).name()) == std::string("class svExternalPin"))
-                {
-                    idx_external_pins.push_back(i);
-                    m_devices[i]->setGridPosition(wxRealPoint(idx_external_pins.size(), 0));
-                }
+        hg.m_supplyNets[i] = getSupplyNetKind(i);
+    }
 
-            // then place all other devices on a second row
-            lastPt.x = 1;
-            lastPt.y = 2;
-            for (unsigned int i=0; i<m_devices.size(); i++)
-            {
-                if (std::find(idx_external_pins.begin(), idx_external_pins.end(), i) != idx_external_pins.end())
-                    continue;
+    wxASSERT(hg.m_netDevices.size() == hg.m_deviceNets.size());
+    return hg;
+}
 
-                unsigned int w = m_devices[i]->getRightmostGridNodePosition() - 
-                                 m_devices[i]->getLeftmostGridNodePosition();
+const wxRect& svCircuit::placeDevices(svPlaceAlgorithm ag, svPlacementProgress* progress)
+{
+    m_bb = wxRect(0,0,0,0);
 
-                unsigned int center_offset_w = m_devices[i]->getRelativeGridNodePosition(0).x -
-                                               m_devices[i]->getLeftmostGridNodePosition();
+    if (m_devices.size() == 0)
+        return m_bb;
 
-                m_devices[i]->setGridPosition(lastPt + wxPoint(center_offset_w, 0));
+    m_progress = progress;
 
-                lastPt.x += w+1;
-            }
-        }
+    switch (ag)
+    {
+    case SVPA_PLACE_NON_OVERLAPPED:
+    case SVPA_PACK_BY_KIND:
+    case SVPA_PACK_BY_CLUSTER:
+        placeShelves(ag);
         break;
 
     case SVPA_KAMADA_KAWAI:
-        {
-            svUGraph graph = buildGraph();
-            //svUGraph::PositionMap map;
-            
-            typedef struct 
-            {
-                double x, y;
-            } point2D;
-
-            //typedef typename boost::graph_traits<Graph>::vertex_descriptor Vertex;
-//            boost::property_map<svUGraph, point2D> map;// = g�et(boost::vertex_index, graph);
-        //    boost::property_map<svUGraph, vertex_id_t>::type vertex_id_map; 
-//            circle_graph_layout(graph, map, 20.0);
-        }
+        placeKamadaKawai();
         break;
 
     case SVPA_HEURISTIC_1:
         {
-            // start placing the first device at the center of our virtual grid
-            // (we place it using its first node as reference)
-            for (unsigned int i=0; i<m_devices.size(); i++)
-                m_devices[i]->setGridPosition(wxPoint(0,0));
-
-            // now place other devices connected to the same nodes of the first device:
-            for (size_t j=0; j<m_devices[0]->getNodesCount(); j++)
+            const svHyperGraph& hg = getHyperGraph();
+            std::vector<bool> placed(m_devices.size(), false);
+            std::vector<unsigned int> queue;
+            svOccupancyGrid grid;
+
+            // places the given device in the free position closest to the given one
+            auto place = [&](unsigned int dev, const wxPoint& pos) {
+                wxRect cells = grid.findFree(getDeviceCells(dev, pos), 1);
+                m_devices[dev]->setGridPosition(cells.GetTopLeft() - m_devices[dev]->getRelativeBoundingBox().GetTopLeft());
+                grid.occupy(cells);
+                placed[dev] = true;
+                queue.push_back(dev);
+            };
+
+            // visit the devices breadth-first: each group of connected devices
+            // starts as close as possible to the center of our virtual grid
+            for (unsigned int first=0; first<m_devices.size(); first++)
             {
-                // TODO: verify the position is free
-                // TODO: cycle on the nodes, not on the devices! first place close together
-                //       all devices attached to the same node
+                if (placed[first])
+                    continue;
 
-                if (m_devices[0]->getNode(j) != svGroundNode)        // node 0 == GND
+                place(first, wxPoint(0,0));
+                for (size_t head=queue.size()-1; head<queue.size(); head++)
                 {
-                    unsigned int temp;
-                    for (size_t i=1; i<m_devices.size(); i++)
-                        if (m_devices[i]->isConnectedTo(m_devices[0]->getNode(j), &temp))
+                    unsigned int dev = queue[head];
+                    for (unsigned int j=0; j<hg.getDeviceDegree(dev); j++)
+                    {
+                        unsigned int net = hg.getDeviceNetsBegin(dev)[j];
+                        if (hg.isIgnoredNet(net))
+                            continue;
+
+                        // place the devices attached to this net to the right of this
+                        // device, with their pins aligned so that they can be easily
+                        // connected
+                        wxPoint pinPos = getPinPosition(svPinRef(dev, j));
+                        for (unsigned int k=0; k<hg.getNetDegree(net); k++)
                         {
-                            // place it to the right of the previous device so that it can be easily
-                            // connected...
-                            wxPoint pos = m_devices[0]->getGridPosition() + wxPoint(1,0);
-                            pos.x -= m_devices[i]->getLeftmostGridNodePosition();
-                            pos.y += m_devices[i]->getRelativeGridNodePosition(temp).y;
-                            m_devices[i]->setGridPosition(pos);
-                            break;
+                            svPinRef pin = hg.getNetPin(net, k);
+                            if (placed[pin.device])
+                                continue;
+
+                            svBaseDevice* other = m_devices[pin.device];
+                            wxPoint pos(m_devices[dev]->getGridPosition().x + m_devices[dev]->getRightmostGridNodePosition() + 2 -
+                                        other->getLeftmostGridNodePosition(),
+                                        pinPos.y - other->getRelativeGridNodePosition(pin.pin).y);
+                            place(pin.device, pos);
                         }
-                
-                    break;
+                    }
                 }
             }
-
-            // TODO: finish placement of other devices
         }
         break;
+
+    case SVPA_FORCE_DIRECTED:
+        placeForceDirected();
+        break;
+
+    case SVPA_MULTILEVEL:
+        placeMultilevel();
+        break;
+
+    case SVPA_QUADRATIC:
+        placeQuadratic();
+        break;
+
+    case SVPA_ANNEALING:
+        placeAnnealing();
+        break;
+
+    case SVPA_LAYERED:
+        placeLayered();
+        break;
+    }
+
+    // the layout is now legal: show it while it's being polished
+    if (m_progress)
+        publishProgress();
+
+    // the order of the devices in the shelves is the point of those algorithms
+    // (e.g. grouping the devices by kind): don't mix it up
+    bool shelves = ag == SVPA_PLACE_NON_OVERLAPPED || ag == SVPA_PACK_BY_KIND ||
+                   ag == SVPA_PACK_BY_CLUSTER;
+    if (!shelves)
+    {
+        optimizeRotations();
+        reduceCrossings();
     }
+    m_progress = NULL;
 
     // define the translation values to use to make all grid points positive:
     wxPoint offset;
@@ -551,6 +1204,14 @@ const wxRect& svCircuit::placeDevices(svPlaceAlgorithm ag)
 }
 
 void svCircuit::updateBoundingBox()
+{
+    m_occupancyValid = false;
+    m_airwiresValid.clear();
+    m_routesValid.clear();
+    computeBoundingBox();
+}
+
+void svCircuit::computeBoundingBox()
 {
     m_bb.x = m_bb.y = INT_MAX-1;
     for (size_t i=0; i<m_devices.size(); i++)
@@ -570,6 +1231,26 @@ void svCircuit::updateBoundingBox()
     m_bb.height -= m_bb.y;
 }
 
+void svCircuit::updateBoundingBoxFor(unsigned int dev, const wxRect& oldCells)
+{
+    // NB: m_bb is one cell smaller than the cells it covers
+    wxRect box(m_bb.GetTopLeft(), m_bb.GetTopLeft() + wxPoint(m_bb.width, m_bb.height));
+    wxRect cells = getDeviceCells(dev, m_devices[dev]->getGridPosition());
+
+    // the box shrinks only if the device leaves one of its sides
+    if ((oldCells.GetLeft() <= box.GetLeft() && cells.GetLeft() > oldCells.GetLeft()) ||
+        (oldCells.GetTop() <= box.GetTop() && cells.GetTop() > oldCells.GetTop()) ||
+        (oldCells.GetRight() >= box.GetRight() && cells.GetRight() < oldCells.GetRight()) ||
+        (oldCells.GetBottom() >= box.GetBottom() && cells.GetBottom() < oldCells.GetBottom()))
+    {
+        computeBoundingBox();
+        return;
+    }
+
+    box.Union(cells);
+    m_bb = wxRect(box.x, box.y, box.width - 1, box.height - 1);
+}
+
 void svCircuit::initGraphics(wxGraphicsContext*gc, unsigned int gridSize)
 {
     s_pathGround = gc->CreatePath();
@@ -578,16 +1259,43 @@ void svCircuit::initGraphics(wxGraphicsContext*gc, unsigned int gridSize)
     drawLine(s_pathGround, wxRealPoint(-w,0), wxRealPoint(w,0));
     drawLine(s_pathGround, wxRealPoint(-w*2/4,d), wxRealPoint(w*2/4,d));
     drawLine(s_pathGround, wxRealPoint(-w*1/4,2*d), wxRealPoint(w*1/4,2*d));
+
+    s_pathSupplyUp = gc->CreatePath();
+    drawLine(s_pathSupplyUp, wxRealPoint(0,0), wxRealPoint(0,-2*d));
+    drawLine(s_pathSupplyUp, wxRealPoint(-w/2,-2*d), wxRealPoint(w/2,-2*d));
+
+    s_pathSupplyDown = gc->CreatePath();
+    drawLine(s_pathSupplyDown, wxRealPoint(0,0), wxRealPoint(0,2*d));
+    drawLine(s_pathSupplyDown, wxRealPoint(-w/2,2*d), wxRealPoint(w/2,2*d));
 }
 
-void svCircuit::draw(wxGraphicsContext* gc, unsigned int gridSize, int selectedDevice) const
+void svCircuit::draw(wxGraphicsContext* gc, unsigned int gridSize, int selectedDevice,
+                     const wxRect& region) const
 {
+    // the region in grid coordinates (enlarged by a cell, which covers also
+    // the parts of the devices drawn out of their pins)
+    wxRect gridRegion;
+    if (!region.IsEmpty())
+        gridRegion = wxRect(wxPoint(int(floor(double(region.GetLeft())/gridSize)), int(floor(double(region.GetTop())/gridSize))),
+                            wxPoint(int(ceil(double(region.GetRight())/gridSize)), int(ceil(double(region.GetBottom())/gridSize))))
+                        .Inflate(1, 1);
+    auto isVisible = [&gridRegion](const wxRealPoint& a, const wxRealPoint& b) {
+        return gridRegion.IsEmpty() ||
+               (std::max(a.x, b.x) >= gridRegion.GetLeft() && std::min(a.x, b.x) <= gridRegion.GetRight() &&
+                std::max(a.y, b.y) >= gridRegion.GetTop() && std::min(a.y, b.y) <= gridRegion.GetBottom());
+    };
+
     // draw all the devices
+    const svHyperGraph& hg = getHyperGraph();
     wxPen normal(*wxBLACK, 2),
           selected(*wxRED, 2);
     gc->SetFont(*wxSWISS_FONT, *wxBLACK);
     for (size_t i=0; i<m_devices.size(); i++)
     {
+        if (!gridRegion.IsEmpty() &&
+            !getDeviceCells(i, m_devices[i]->getGridPosition()).Intersects(gridRegion))
+            continue;
+
         m_devices[i]->drawWithDesc(gc, gridSize, selectedDevice == (int)i ? selected : normal);
 
 #if 0
@@ -610,10 +1318,25 @@ void svCircuit::draw(wxGraphicsContext* gc, unsigned int gridSize, int selectedD
             m.Translate(nodePos.x, nodePos.y);
             gc->SetTransform(m);
 
-            if (m_devices[i]->getNode(j) == svGroundNode)
+            // the supply nets are not wired: each of their pins gets a symbol
+            unsigned int net = hg.getDeviceNetsBegin(i)[j];
+            switch (hg.getSupplyNetKind(net))
+            {
+            case SVSN_GROUND:
                 gc->StrokePath(s_pathGround);
-            else
+                break;
+            case SVSN_POSITIVE:
+                gc->StrokePath(s_pathSupplyUp);
+                gc->DrawText(m_devices[i]->getNode(j), gridSize/6.0, -gridSize/2.0, 0);
+                break;
+            case SVSN_NEGATIVE:
+                gc->StrokePath(s_pathSupplyDown);
+                gc->DrawText(m_devices[i]->getNode(j), gridSize/6.0, gridSize/5.0, 0);
+                break;
+            case SVSN_NONE:
                 gc->DrawText(m_devices[i]->getNode(j), 0, 0, 0);
+                break;
+            }
         }
     }
 
@@ -641,51 +1364,285 @@ void svCircuit::draw(wxGraphicsContext* gc, unsigned int gridSize, int selectedD
     gc->SetTransform(gc->CreateMatrix());
 
     unsigned int idx = 0;
-    for (std::set<svNode>::const_iterator i=m_nodes.begin(); i != m_nodes.end(); i++)
+    for (unsigned int i=0; i < m_nodeNames.size(); i++)
     {
-        if (*i != svGroundNode)
+        if (!hg.isIgnoredNet(i))
         {
             unsigned int penIdx = (idx++) % wirePens.size();
             gc->SetPen(wirePens[penIdx]);
 
-            // TO-OPTIMIZE: we may scan the device list and then each device's node and 
-            //              put the device's node relative position in an array indexed by
-            //              the node's name (single pass on each device's node and we have
-            //              the data organized as we need).
-            std::vector<wxPoint> arrConnectedNodes = getDeviceNodesConnectedTo(*i);
-#if 0
-            for (size_t j=0; j<arrConnectedNodes.size(); j++)
-                for (size_t k=0; k<arrConnectedNodes.size(); k++)
-                    if (k != j)
-                        drawLine(gc, arrConnectedNodes[j]*gridSize, arrConnectedNodes[k]*gridSize);
-#elif 1
-            // TODO: we should find the spanning tree over the graph formed by the nodes in arrConnectedNodes
-            for (size_t j=1; j<arrConnectedNodes.size(); j++)
-                drawLine(gc, arrConnectedNodes[j-1]*gridSize, arrConnectedNodes[j]*gridSize);
-#else
-            for (size_t j=1; j<arrConnectedNodes.size(); j++)
+            // the nets whose pins didn't move since they were routed are drawn
+            // with their wires, with a dot where a wire branches off another one
+            if (isRouted(i))
             {
-                wxRealPoint tmppt(arrConnectedNodes[j]*gridSize);
-
-                tmppt.x = arrConnectedNodes[j-1].x*gridSize;
-                drawLine(gc, arrConnectedNodes[j-1]*gridSize, tmppt);
-                drawLine(gc, tmppt, arrConnectedNodes[j]*gridSize);
+                const svRoute& route = m_routes[i];
+                for (size_t j=0; j<route.wires.size(); j++)
+                    if (isVisible(route.wires[j].from, route.wires[j].to))
+                        drawLine(gc, route.wires[j].from*gridSize, route.wires[j].to*gridSize);
+
+                gc->SetBrush(wxBrush(wirePens[penIdx].GetColour()));
+                for (size_t j=0; j<route.junctions.size(); j++)
+                    if (isVisible(route.junctions[j], route.junctions[j]))
+                        gc->DrawEllipse(route.junctions[j].x*gridSize - 4, route.junctions[j].y*gridSize - 4, 8, 8);
+                continue;
             }
-#endif
+
+            // the spanning tree is cached: this is O(pins attached to this node)
+            // unless some of them moved
+            const svAirwireArray& airwires = getAirwires(i);
+            for (size_t j=0; j<airwires.size(); j++)
+                if (isVisible(wxRealPoint(airwires[j].from), wxRealPoint(airwires[j].to)))
+                    drawLine(gc, airwires[j].from*gridSize, airwires[j].to*gridSize);
         }
     }
 }
 
 std::vector<wxPoint> svCircuit::getDeviceNodesConnectedTo(const svNode& node) const
 {
+    unsigned int idx = getNodeIndex(node);
+    if (idx == svInvalidNodeIndex)
+        return std::vector<wxPoint>();
+    return getDeviceNodesConnectedTo(idx);
+}
+
+std::vector<wxPoint> svCircuit::getDeviceNodesConnectedTo(unsigned int nodeIdx) const
+{
+    const svPinRefArray& pins = m_nodePins[nodeIdx];
+
     std::vector<wxPoint> ret;
-    for (size_t i = 0; i < m_devices.size(); i++)
+    ret.reserve(pins.size());
+    for (size_t i = 0; i < pins.size(); i++)
+        ret.push_back(getPinPosition(pins[i]));
+    return ret;
+}
+
+svSupplyNet svCircuit::getSupplyNetKind(unsigned int idx) const
+{
+    if (m_nodeNames[idx] == svGroundNode)
+        return SVSN_GROUND;
+    if (m_nodePins[idx].size() < SUPPLY_MIN_PINS &&
+        m_supplyNodes.find(m_nodeNames[idx]) == m_supplyNodes.end())
+        return SVSN_NONE;
+
+    // strip the path of the subcircuit instance (if any) and the trailing '!'
+    // which marks the global nets in some netlisters
+    wxString name = wxString(m_nodeNames[idx]).Upper().AfterLast('.');
+    if (name.EndsWith("!"))
+        name.RemoveLast();
+
+    for (unsigned int i=0; i < WXSIZEOF(g_supplyNets); i++)
     {
-        wxPoint pt = m_devices[i]->getRelativeGridNodePosition(node);
-        if (pt != svInvalidPoint)
-            ret.push_back(m_devices[i]->getGridPosition() + pt);
+        wxString rest;
+        if (name.StartsWith(g_supplyNets[i].name, &rest) &&
+            (rest.empty() || rest[0] == '_' || wxIsdigit(rest[0])))
+            return g_supplyNets[i].kind;
     }
-    return ret;
+
+    return SVSN_NONE;
+}
+
+wxPoint svCircuit::getPinPosition(const svPinRef& pin) const
+{
+    const svBaseDevice* dev = m_devices[pin.device];
+    return dev->getGridPosition() + dev->getRelativeGridNodePosition(pin.pin);
+}
+
+const svAirwireArray& svCircuit::getAirwires(unsigned int nodeIdx) const
+{
+    if (m_airwiresValid.size() != m_nodeNames.size())
+    {
+        m_airwires.resize(m_nodeNames.size());
+        m_airwiresValid.assign(m_nodeNames.size(), false);
+    }
+
+    if (!m_airwiresValid[nodeIdx])
+    {
+        std::vector<wxPoint> pins = getDeviceNodesConnectedTo(nodeIdx);
+        std::vector<unsigned int> parent;
+        svGetRectilinearSteinerTree(pins, parent);
+
+        svAirwireArray& airwires = m_airwires[nodeIdx];
+        airwires.clear();
+        for (size_t k=1; k<pins.size(); k++)
+            airwires.push_back(svAirwire(pins[parent[k]], pins[k]));
+        m_airwiresValid[nodeIdx] = true;
+    }
+
+    return m_airwires[nodeIdx];
+}
+
+wxRect svCircuit::getNetBoundingBox(unsigned int nodeIdx) const
+{
+    wxRect bb;
+    if (getHyperGraph().isIgnoredNet(nodeIdx))
+        return bb;          // see draw()
+
+    auto addPoint = [&bb](const wxRealPoint& pt) {
+        wxRect rc(wxPoint(int(floor(pt.x)), int(floor(pt.y))), wxPoint(int(ceil(pt.x)), int(ceil(pt.y))));
+        bb = bb.IsEmpty() ? rc : bb.Union(rc);
+    };
+    if (isRouted(nodeIdx))
+    {
+        const svRoute& route = m_routes[nodeIdx];
+        for (size_t j=0; j<route.wires.size(); j++)
+        {
+            addPoint(route.wires[j].from);
+            addPoint(route.wires[j].to);
+        }
+        return bb;
+    }
+
+    const svAirwireArray& airwires = getAirwires(nodeIdx);
+    for (size_t j=0; j<airwires.size(); j++)
+    {
+        addPoint(wxRealPoint(airwires[j].from));
+        addPoint(wxRealPoint(airwires[j].to));
+    }
+    return bb;
+}
+
+void svCircuit::invalidateAirwires(unsigned int dev)
+{
+    const std::vector<svNode>& deviceNodes = m_devices[dev]->getNodes();
+    for (size_t j=0; j<deviceNodes.size(); j++)
+    {
+        unsigned int idx = getNodeIndex(deviceNodes[j]);
+        if (!m_airwiresValid.empty())
+            m_airwiresValid[idx] = false;
+        if (!m_routesValid.empty())
+            m_routesValid[idx] = false;
+    }
+}
+
+void svCircuit::invalidateRoutesThrough(unsigned int dev)
+{
+    if (m_routesValid.empty())
+        return;
+
+    // the wires of the other nets can't even touch the border of the cells,
+    // where the pins of the device are
+    wxRect cells = getDeviceCells(dev, m_devices[dev]->getGridPosition());
+    std::vector<unsigned int> nets;
+    m_routeIndex.query(cells, nets);
+    for (size_t n=0; n<nets.size(); n++)
+    {
+        unsigned int net = nets[n];
+        if (!m_routesValid[net])
+            continue;
+
+        const std::vector<svWire>& wires = m_routes[net].wires;
+        for (size_t j=0; j<wires.size(); j++)
+            if (std::max(wires[j].from.x, wires[j].to.x) >= cells.GetLeft() &&
+                std::min(wires[j].from.x, wires[j].to.x) <= cells.GetRight() &&
+                std::max(wires[j].from.y, wires[j].to.y) >= cells.GetTop() &&
+                std::min(wires[j].from.y, wires[j].to.y) <= cells.GetBottom())
+            {
+                m_routesValid[net] = false;
+                break;
+            }
+    }
+}
+
+const svOccupancyGrid& svCircuit::getOccupancy() const
+{
+    if (!m_occupancyValid)
+    {
+        m_occupancy.clear();
+        m_occupancyOverlaps = false;
+        m_deviceIndex.clear();
+        for (size_t i=0; i<m_devices.size(); i++)
+        {
+            wxRect cells = getDeviceCells(i, m_devices[i]->getGridPosition());
+            if (!m_occupancy.isFree(cells))
+                m_occupancyOverlaps = true;
+            m_occupancy.occupy(cells);
+            m_deviceIndex.insert(i, cells);
+        }
+        m_occupancyValid = true;
+    }
+
+    return m_occupancy;
+}
+
+wxRect svCircuit::getDeviceCells(unsigned int dev, const wxPoint& pos) const
+{
+    wxRect bb = m_devices[dev]->getRelativeBoundingBox();
+    bb.Offset(pos);
+    return bb;
+}
+
+bool svCircuit::isFreeFor(unsigned int dev, const wxPoint& pos) const
+{
+    return areCellsFreeFor(dev, getDeviceCells(dev, pos),
+                           getDeviceCells(dev, m_devices[dev]->getGridPosition()));
+}
+
+bool svCircuit::areCellsFreeFor(unsigned int dev, const wxRect& cells, const wxRect& ownCells) const
+{
+    getOccupancy();
+
+    // the cells of the device itself must not be considered...
+    wxRect around = wxRect(cells).Inflate(1, 1);
+    if (!m_occupancyOverlaps)
+        return m_occupancy.isFree(around, ownCells);
+
+    // ...but the grid can't tell them from the ones of the devices overlapping it
+    for (unsigned int i=0; i<m_devices.size(); i++)
+        if (i != dev && getDeviceCells(i, m_devices[i]->getGridPosition()).Intersects(around))
+            return false;
+    return true;
+}
+
+void svCircuit::updateOccupancy(unsigned int dev, const wxRect& oldCells)
+{
+    if (!m_occupancyValid)
+        return;     // it will be built when needed
+
+    wxRect newCells = getDeviceCells(dev, m_devices[dev]->getGridPosition());
+    m_deviceIndex.remove(dev, oldCells);
+    m_deviceIndex.insert(dev, newCells);
+
+    // releasing the old cells would free also the ones of the devices
+    // overlapping them: build the grid again (when needed)
+    if (m_occupancyOverlaps || !m_occupancy.isFree(newCells, oldCells))
+    {
+        m_occupancyValid = false;
+        return;
+    }
+
+    m_occupancy.release(oldCells);
+    m_occupancy.occupy(newCells);
+}
+
+void svCircuit::moveDevice(unsigned int dev, const wxPoint& pos)
+{
+    wxRect oldCells = getDeviceCells(dev, m_devices[dev]->getGridPosition());
+    m_devices[dev]->setGridPosition(pos);
+    updateOccupancy(dev, oldCells);
+    invalidateAirwires(dev);
+    invalidateRoutesThrough(dev);
+    updateBoundingBoxFor(dev, oldCells);
+}
+
+bool svCircuit::rotateDevice(unsigned int dev)
+{
+    // don't rotate the device over other ones (unless it already overlaps
+    // some of them)
+    wxPoint pos = m_devices[dev]->getGridPosition();
+    wxRect oldCells = getDeviceCells(dev, pos);
+    bool wasFree = areCellsFreeFor(dev, oldCells, oldCells);
+    m_devices[dev]->rotateClockwise();
+    if (wasFree && !areCellsFreeFor(dev, getDeviceCells(dev, pos), oldCells))
+    {
+        m_devices[dev]->rotateCounterClockwise();
+        return false;
+    }
+
+    updateOccupancy(dev, oldCells);
+    invalidateAirwires(dev);
+    invalidateRoutesThrough(dev);
+    updateBoundingBoxFor(dev, oldCells);
+    return true;
 }
 
 void svCircuit::assign(const svCircuit& tocopy)
@@ -693,7 +1650,16 @@ void svCircuit::assign(const svCircuit& tocopy)
     release();
     m_name = tocopy.m_name;
     m_nodes = tocopy.m_nodes;
+    m_supplyNodes = tocopy.m_supplyNodes;
+    m_nodeNames = tocopy.m_nodeNames;
+    m_nodeIndexes = tocopy.m_nodeIndexes;
+    m_nodePins = tocopy.m_nodePins;
+    m_hyperGraph = tocopy.m_hyperGraph;
+    m_hyperGraphValid = tocopy.m_hyperGraphValid;
+    m_occupancyValid = false;
     m_bb = tocopy.m_bb;
+    m_editSeq = tocopy.m_editSeq;
+    m_progress = NULL;
     for (size_t i = 0; i < tocopy.m_devices.size(); i++)
         m_devices.push_back(tocopy.m_devices[i]->clone());
 }
@@ -705,7 +1671,23 @@ void svCircuit::release()
     m_devices.clear();
     m_name.clear();
     m_nodes.clear();
+    m_supplyNodes.clear();
+    m_nodeNames.clear();
+    m_nodeIndexes.clear();
+    m_nodePins.clear();
+    m_hyperGraph = svHyperGraph();
+    m_hyperGraphValid = false;
+    m_occupancy.clear();
+    m_occupancyValid = false;
+    m_occupancyOverlaps = false;
+    m_airwires.clear();
+    m_airwiresValid.clear();
+    m_deviceIndex.clear();
+    m_routes.clear();
+    m_routesValid.clear();
+    m_routeIndex.clear();
     m_bb = wxRect(0, 0, 0, 0);
+    m_editSeq = 0;
 }
 
 int svCircuit::hitTest(const wxPoint& gridPt, unsigned int gridSize, unsigned int tolerance) const
@@ -719,3 +1701,62 @@ int svCircuit::hitTest(const wxPoint& gridPt, unsigned int gridSize, unsigned in
     }
     return wxNOT_FOUND;
 }
+
+bool svCircuit::saveNVS(const std::string& filename) const
+{
+    std::ofstream ofs(filename.c_str());
+    if (ofs.fail())
+    {
+        wxLogError("Error while saving the NVS file '%s'", filename);
+        return false;
+    }
+
+    try {
+        boost::archive::text_oarchive oa(ofs);
+        svDeviceFactory::registerAllDevicesForSerialization(oa);
+
+        // write class instance to archive
+        oa << *this;
+    }
+    catch (const boost::archive::archive_exception& e)
+    {
+        // NOTE: this is typically a logic error in the program!
+        wxLogError("Error while exporting in NVS format: %s", e.what());
+        return false;
+    }
+
+    ofs.close();
+    if (ofs.fail())
+    {
+        wxLogError("Error while writing the NVS file '%s'", filename);
+        return false;
+    }
+
+    return true;
+}
+
+bool svCircuit::loadNVS(const std::string& filename)
+{
+    std::ifstream ifs(filename.c_str());
+    if (ifs.fail())
+    {
+        wxLogError("Error while trying to open the NVS file '%s'", filename);
+        return false;
+    }
+
+    try {
+        boost::archive::text_iarchive ia(ifs);
+        svDeviceFactory::registerAllDevicesForSerialization(ia);
+
+        // read class state from archive
+        release();
+        ia >> *this;
+    } 
+    catch (const boost::archive::archive_exception& e)
+    {
+        wxLogError("Error while importing the NVS file: %s", e.what());
+        return false;
+    }
+
+    return true;
+}
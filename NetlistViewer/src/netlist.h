@@ -16,19 +16,26 @@
  
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 #include <vector>
 #include <string>
 #include <set>
+#include <algorithm>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 
 #include <wx/graphics.h>
 
 #include <boost/functional/hash.hpp>
-#include <boost/graph/adjacency_matrix.hpp>
+#include <boost/graph/compressed_sparse_row_graph.hpp>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/serialization/set.hpp>
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/base_object.hpp>
+#include <boost/serialization/version.hpp>
 
 // ----------------------------------------------------------------------------
 // typedefs & enums
@@ -37,11 +44,69 @@
 class svBaseDevice;
 class svCircuit;
 
-typedef boost::adjacency_matrix<boost::undirectedS> svUGraph;
+//! The connectivity graph of a circuit.
+//! Boost's CSR graph only supports directed graphs; undirected graphs are obtained
+//! storing each edge in both directions.
+typedef boost::compressed_sparse_row_graph<boost::directedS,
+            boost::no_property, boost::no_property, boost::no_property,
+            unsigned int /* vertex index */, unsigned int /* edge index */> svUGraph;
 typedef std::string svNode;
 typedef std::vector<svBaseDevice*> svBaseDeviceArray;
 typedef std::vector<svCircuit> svCircuitArray;
 
+//! A reference to a pin of a device of a circuit.
+struct svPinRef
+{
+    //! The index of the device in svCircuit::getDevices().
+    unsigned int device;
+
+    //! The index of the pin (i.e. of the node) in svBaseDevice::getNodes().
+    unsigned int pin;
+
+    svPinRef(unsigned int d = 0, unsigned int p = 0)
+        { device = d; pin = p; }
+};
+
+typedef std::vector<svPinRef> svPinRefArray;
+
+//! A straight connection between two points (in grid coordinates) of a net.
+struct svAirwire
+{
+    wxPoint from, to;
+
+    svAirwire(const wxPoint& a = wxPoint(), const wxPoint& b = wxPoint())
+        : from(a), to(b) {}
+};
+
+typedef std::vector<svAirwire> svAirwireArray;
+
+//! A straight piece of wire; its ends are in grid coordinates, but they may
+//! lie between the grid points (see svCircuit::routeNets()).
+struct svWire
+{
+    wxRealPoint from, to;
+
+    svWire(const wxRealPoint& a = wxRealPoint(), const wxRealPoint& b = wxRealPoint())
+        : from(a), to(b) {}
+
+    //! Returns the smallest rectangle of grid cells containing this wire.
+    wxRect getCells() const
+        {
+            return wxRect(wxPoint(int(floor(std::min(from.x, to.x))), int(floor(std::min(from.y, to.y)))),
+                          wxPoint(int(ceil(std::max(from.x, to.x))), int(ceil(std::max(from.y, to.y)))));
+        }
+};
+
+//! The orthogonal wires of a net, as computed by svCircuit::routeNets().
+struct svRoute
+{
+    //! The wires: each one is either horizontal or vertical.
+    std::vector<svWire> wires;
+
+    //! The points where a wire branches off another one.
+    std::vector<wxRealPoint> junctions;
+};
+
 enum svRotation
 {
     SVR_0 = 0,      //!< no rotation.
@@ -52,15 +117,32 @@ enum svRotation
 
 enum svPlaceAlgorithm
 {
-    SVPA_PLACE_NON_OVERLAPPED,
-    SVPA_KAMADA_KAWAI,
-    SVPA_HEURISTIC_1
+    SVPA_PLACE_NON_OVERLAPPED, //!< Packs the devices in rows.
+    SVPA_KAMADA_KAWAI,      //!< Kamada-Kawai (stress minimization) placement.
+    SVPA_HEURISTIC_1,
+    SVPA_FORCE_DIRECTED,    //!< Force-directed placement using a Barnes-Hut quadtree.
+    SVPA_MULTILEVEL,        //!< Multilevel placement, for very large circuits.
+    SVPA_QUADRATIC,         //!< Analytical placement minimizing the quadratic wirelength.
+    SVPA_ANNEALING,         //!< Simulated annealing (with parallel tempering) placement.
+    SVPA_PACK_BY_KIND,      //!< Packs the devices in rows, grouped by kind.
+    SVPA_PACK_BY_CLUSTER,   //!< Packs the devices in rows, grouped by connectivity.
+    SVPA_LAYERED            //!< Layered placement, following the signal flow.
+};
+
+//! The kinds of supply nets (see svCircuit::getSupplyNetKind).
+enum svSupplyNet
+{
+    SVSN_NONE,              //!< Not a supply net.
+    SVSN_GROUND,            //!< The ground, or a net named like it (e.g. AGND).
+    SVSN_POSITIVE,          //!< A positive supply, e.g. VCC or VDD.
+    SVSN_NEGATIVE           //!< A negative supply, e.g. VEE or VSS.
 };
 
 // globals:
 
 extern wxPoint svInvalidPoint;
 extern svNode svGroundNode;
+extern unsigned int svInvalidNodeIndex;
 
 // ----------------------------------------------------------------------------
 // helper functions
@@ -79,6 +161,19 @@ static void drawLine(wxGraphicsContext* gc, const wxRealPoint& pt1, const wxReal
     gc->StrokeLine(pt1.x, pt1.y, pt2.x, pt2.y);
 }
 
+//! Computes a rectilinear minimum spanning tree of the given points, in
+//! O(k log k) time for k points. Fills @a parent with the parent of each point
+//! in the tree, rooted in the first point (whose parent is @c UINT_MAX).
+void svGetRectilinearMST(const std::vector<wxPoint>& points, std::vector<unsigned int>& parent);
+
+//! Computes a rectilinear Steiner tree of the given points, i.e. a spanning tree
+//! which can also pass through other points (the Steiner points, appended to
+//! @a points): this is about 9% shorter than the minimum spanning tree of
+//! scattered points. Small sets of points use the iterated 1-Steiner heuristic, the other
+//! ones join the overlapping edges of their MST, in O(k log k) time for k points.
+//! Fills @a parent like svGetRectilinearMST().
+void svGetRectilinearSteinerTree(std::vector<wxPoint>& points, std::vector<unsigned int>& parent);
+
 //! Graphic helper; optimized rotation for a rectangle around origin.
 static wxRect2DDouble rotateRect(const wxRect2DDouble& r, svRotation rot)
 {
@@ -158,6 +253,265 @@ public:
 
 
 
+// ----------------------------------------------------------------------------
+// svHyperGraph
+// ----------------------------------------------------------------------------
+
+//! The connectivity of a circuit represented as a hypergraph.
+//! Devices and nodes (nets) are two distinct classes of vertices and each
+//! device pin is an incidence between a device and a net; thus, unlike the
+//! graph returned by svCircuit::buildGraph(), the size of this structure is
+//! linear in the number of pins whatever the fan-out of the nets is.
+//! Both the device => nets and the net => devices incidences are stored
+//! in compressed sparse row (CSR) format.
+//! Devices and nets are identified by their index in svCircuit::getDevices()
+//! and in the interned node table of the circuit, respectively.
+class svHyperGraph
+{
+    friend class svCircuit;
+
+    //! For each device, the offset of its first pin in m_deviceNets.
+    //! Contains one more element than the number of devices.
+    std::vector<unsigned int> m_deviceOffsets;
+
+    //! For each pin, in device order, the net it's attached to.
+    std::vector<unsigned int> m_deviceNets;
+
+    //! For each net, the offset of its first pin in m_netDevices.
+    //! Contains one more element than the number of nets.
+    std::vector<unsigned int> m_netOffsets;
+
+    //! For each pin, in net order, the device it belongs to.
+    std::vector<unsigned int> m_netDevices;
+
+    //! For each pin, in net order, the index of the pin inside its device.
+    std::vector<unsigned int> m_netPins;
+
+    //! For each net, its kind of supply (see svCircuit::getSupplyNetKind):
+    //! the supply nets are global nets which should not attract the devices
+    //! attached to them.
+    std::vector<svSupplyNet> m_supplyNets;
+
+public:
+    svHyperGraph() {}
+
+    size_t getDevicesCount() const
+        { return m_deviceOffsets.empty() ? 0 : m_deviceOffsets.size()-1; }
+    size_t getNetsCount() const
+        { return m_netOffsets.empty() ? 0 : m_netOffsets.size()-1; }
+    size_t getPinsCount() const
+        { return m_deviceNets.size(); }
+
+    //! Returns the number of pins of the given device.
+    unsigned int getDeviceDegree(unsigned int dev) const
+        { return m_deviceOffsets[dev+1] - m_deviceOffsets[dev]; }
+
+    //! Returns the number of pins attached to the given net.
+    unsigned int getNetDegree(unsigned int net) const
+        { return m_netOffsets[net+1] - m_netOffsets[net]; }
+
+    //! Returns the range of nets attached to the pins of the given device
+    //! (in pin order: the same net may appear more than once).
+    const unsigned int* getDeviceNetsBegin(unsigned int dev) const
+        { return m_deviceNets.data() + m_deviceOffsets[dev]; }
+    const unsigned int* getDeviceNetsEnd(unsigned int dev) const
+        { return m_deviceNets.data() + m_deviceOffsets[dev+1]; }
+
+    //! Returns the range of devices attached to the given net
+    //! (a device appears once for each of its pins attached to the net).
+    const unsigned int* getNetDevicesBegin(unsigned int net) const
+        { return m_netDevices.data() + m_netOffsets[net]; }
+    const unsigned int* getNetDevicesEnd(unsigned int net) const
+        { return m_netDevices.data() + m_netOffsets[net+1]; }
+
+    //! Returns the i-th pin attached to the given net.
+    svPinRef getNetPin(unsigned int net, unsigned int i) const
+        {
+            unsigned int off = m_netOffsets[net] + i;
+            return svPinRef(m_netDevices[off], m_netPins[off]);
+        }
+
+    //! Returns true if the given net is global (the ground or a supply net, see
+    //! svCircuit::getSupplyNetKind) and thus should be ignored by the placement,
+    //! partitioning and routing algorithms.
+    bool isIgnoredNet(unsigned int net) const
+        { return m_supplyNets[net] != SVSN_NONE; }
+
+    //! Returns the kind of supply of the given net, as
+    //! svCircuit::getSupplyNetKind() does, but in constant time.
+    svSupplyNet getSupplyNetKind(unsigned int net) const
+        { return m_supplyNets[net]; }
+
+    //! Returns the number of bytes used by this hypergraph.
+    size_t getMemoryUsage() const
+        {
+            return (m_deviceOffsets.size() + m_deviceNets.size() + m_netOffsets.size() +
+                    m_netDevices.size() + m_netPins.size())*sizeof(unsigned int) +
+                   m_supplyNets.size()*sizeof(svSupplyNet);
+        }
+};
+
+
+// ----------------------------------------------------------------------------
+// svOccupancyGrid
+// ----------------------------------------------------------------------------
+
+//! A sparse bitmap of the occupied cells of the (unbounded) grid where the devices
+//! are placed. The cells are grouped in square tiles, which are allocated only
+//! when one of their cells gets occupied: memory is proportional to the occupied
+//! area, not to the extent of the grid. Testing or changing a rectangle of cells
+//! takes constant (expected) time for rectangles smaller than a tile.
+//! Occupied cells are not reference-counted: releasing a rectangle frees all its
+//! cells, even those which were occupied also by other rectangles.
+class svOccupancyGrid
+{
+    enum { TILE_SHIFT = 6, TILE_SIZE = 1 << TILE_SHIFT };
+
+    //! A TILE_SIZE x TILE_SIZE block of cells: one bit per cell.
+    struct Tile
+    {
+        unsigned long long rows[TILE_SIZE];
+
+        Tile()
+            { memset(rows, 0, sizeof(rows)); }
+    };
+
+    std::unordered_map<unsigned long long, Tile> m_tiles;
+
+    static unsigned long long getTileKey(int tx, int ty)
+        { return ((unsigned long long)(unsigned int)tx << 32) | (unsigned int)ty; }
+
+    //! Calls <tt>fn(tx, ty, row0, row1, mask)</tt> for each tile intersecting
+    //! @a rc: the rows [row0, row1] of the tile intersect @a rc in the bits of @a mask.
+    //! Stops (returning false) as soon as @a fn returns false.
+    template<typename F>
+    static bool forEachTile(const wxRect& rc, F fn);
+
+public:
+    svOccupancyGrid() {}
+
+    //! Frees all cells.
+    void clear()
+        { m_tiles.clear(); }
+
+    //! Returns true if no cell of the given rectangle is occupied.
+    bool isFree(const wxRect& rc) const;
+
+    //! @overload
+    //! The cells of @a excluded are considered free.
+    bool isFree(const wxRect& rc, const wxRect& excluded) const;
+
+    //! Marks the cells of the given rectangle as occupied.
+    void occupy(const wxRect& rc);
+
+    //! Marks the cells of the given rectangle as free.
+    void release(const wxRect& rc);
+
+    //! Returns the translation of @a rc closest to it (searching along square
+    //! rings of growing size) which is free, together with @a margin cells
+    //! all around it.
+    wxRect findFree(const wxRect& rc, int margin = 0) const;
+
+    //! Returns the number of bytes used by this grid.
+    size_t getMemoryUsage() const
+        { return m_tiles.size()*(sizeof(Tile) + sizeof(unsigned long long)); }
+};
+
+
+// ----------------------------------------------------------------------------
+// svRectIndex
+// ----------------------------------------------------------------------------
+
+//! A sparse spatial index of rectangles of grid cells (e.g. the cells of the
+//! devices or the wires of the nets), each one tagged with an integer id: each
+//! rectangle is listed in the square tiles it intersects, so that the ids found
+//! in an area cost as much as the tiles of that area and not as the whole index.
+//! The same id can be inserted with several rectangles.
+class svRectIndex
+{
+    enum { TILE_SHIFT = 4 };
+
+    std::unordered_map<unsigned long long, std::vector<unsigned int> > m_tiles;
+
+    static unsigned long long getTileKey(int tx, int ty)
+        { return ((unsigned long long)(unsigned int)tx << 32) | (unsigned int)ty; }
+
+public:
+    svRectIndex() {}
+
+    //! Removes all rectangles.
+    void clear()
+        { m_tiles.clear(); }
+
+    //! Adds the given rectangle, tagged with @a id.
+    void insert(unsigned int id, const wxRect& rc);
+
+    //! Removes the given rectangle, which was inserted with the same @a id.
+    void remove(unsigned int id, const wxRect& rc);
+
+    //! Sets @a ids to the ids of the rectangles which may intersect @a rc (i.e.
+    //! which share some tile with it), sorted and without duplicates.
+    void query(const wxRect& rc, std::vector<unsigned int>& ids) const;
+};
+
+
+// ----------------------------------------------------------------------------
+// svPlacementProgress
+// ----------------------------------------------------------------------------
+
+//! The minimum interval (in milliseconds) between two snapshots published
+//! by a placement (see svPlacementProgress).
+#define SV_PLACEMENT_SNAPSHOT_INTERVAL      100
+
+//! The progress of a placement running in a secondary thread (see
+//! svCircuit::placeDevices): the placement algorithms periodically publish a
+//! snapshot of the layout they're improving, which the main thread can show
+//! while waiting, and stop early (keeping the layout reached so far) when asked.
+//! Snapshots are not legalized: their devices may overlap.
+class svPlacementProgress
+{
+    //! Set by the main thread to stop the placement.
+    std::atomic<bool> m_stopRequested;
+
+    //! The time when the next snapshot is due; used by the placement thread only.
+    std::chrono::steady_clock::time_point m_nextSnapshot;
+
+    //! The last snapshot published and its sequence number (starting from one).
+    std::vector<wxPoint> m_positions;
+    std::vector<svRotation> m_rotations;
+    unsigned long m_snapshotSeq;
+
+    //! Protects the last snapshot.
+    mutable std::mutex m_mutex;
+
+public:
+    svPlacementProgress()
+        { reset(); }
+
+    //! Prepares this object for a new placement.
+    void reset();
+
+    //! Asks the placement to stop as soon as possible.
+    void requestStop()
+        { m_stopRequested = true; }
+    bool isStopRequested() const
+        { return m_stopRequested; }
+
+    //! Returns true if the placement should publish a new snapshot; the first
+    //! snapshot is due at once.
+    bool isSnapshotDue() const
+        { return std::chrono::steady_clock::now() >= m_nextSnapshot; }
+
+    //! Publishes the given layout (in the order of svCircuit::getDevices).
+    void publish(const std::vector<wxPoint>& positions, const std::vector<svRotation>& rotations);
+
+    //! Copies the last snapshot and returns true if it's newer than the one
+    //! with the given sequence number, which is then updated.
+    bool getSnapshot(std::vector<wxPoint>& positions, std::vector<svRotation>& rotations,
+                     unsigned long& seq) const;
+};
+
+
 // ----------------------------------------------------------------------------
 // svCircuit
 // ----------------------------------------------------------------------------
@@ -173,6 +527,62 @@ class svCircuit
     //! Each node is connected to one or more device nodes.
     std::set<svNode> m_nodes;
 
+    //! The nodes which are supply nets whatever the number of their pins (see
+    //! getSupplyNetKind), e.g. the supply nets of the circuit this one is a
+    //! sheet of.
+    std::set<svNode> m_supplyNodes;
+
+    //! The interned node table: the nodes of m_nodes in the order they were
+    //! added, so that each node can be identified by an integer index.
+    //! The order is saved in NVS files, so the indexes survive a save/load.
+    std::vector<svNode> m_nodeNames;
+
+    //! Maps each node name to its index in m_nodeNames.
+    std::unordered_map<svNode, unsigned int> m_nodeIndexes;
+
+    //! The connectivity index: for each node (indexed like m_nodeNames),
+    //! the device pins attached to it.
+    std::vector<svPinRefArray> m_nodePins;
+
+    //! The hypergraph returned by getHyperGraph(); built only when needed.
+    mutable svHyperGraph m_hyperGraph;
+
+    //! True if m_hyperGraph is up to date with m_devices.
+    mutable bool m_hyperGraphValid;
+
+    //! The cells covered by the devices, returned by getOccupancy(); built only
+    //! when needed.
+    mutable svOccupancyGrid m_occupancy;
+
+    //! True if m_occupancy is up to date with the positions of the devices.
+    mutable bool m_occupancyValid;
+
+    //! True if some devices overlap (e.g. in a layout loaded from a NVS file):
+    //! then m_occupancy can't tell the cells of one of them from the others'.
+    mutable bool m_occupancyOverlaps;
+
+    //! The cells of each device, indexed by their position; built and kept
+    //! up to date together with m_occupancy.
+    mutable svRectIndex m_deviceIndex;
+
+    //! The airwires of each net (indexed like m_nodeNames), returned by
+    //! getAirwires(); computed only when needed.
+    mutable std::vector<svAirwireArray> m_airwires;
+
+    //! For each net, true if its entry of m_airwires is up to date with the
+    //! positions of its pins. Empty when all of them are out of date.
+    mutable std::vector<bool> m_airwiresValid;
+
+    //! The routes of the nets (indexed like m_nodeNames) computed by routeNets().
+    std::vector<svRoute> m_routes;
+
+    //! For each net, true if its entry of m_routes is up to date with the
+    //! positions of its pins. Empty when no net is routed.
+    std::vector<bool> m_routesValid;
+
+    //! The cells of the wires of m_routes, tagged with their nets.
+    svRectIndex m_routeIndex;
+
     //! The bounding box for the grid where the devices of this circuit are placed.
     //! This member variable is updated only by the placeDevices() function.
     wxRect m_bb;
@@ -181,28 +591,168 @@ class svCircuit
     //! Each device has two or more nodes connected with the elements of the m_nodes array.
     std::vector<svBaseDevice*> m_devices;
 
-    //! The ground symbol.
-    static wxGraphicsPath s_pathGround;
+    //! The sequence number of the last layout edit applied to this circuit.
+    //! Used by svEditJournal to know which journaled edits are already part of
+    //! a saved NVS file.
+    unsigned long m_editSeq;
+
+    //! The progress of the running placeDevices() call, if any.
+    svPlacementProgress* m_progress;
+
+    //! The ground symbol and the symbols of the positive and negative supplies.
+    static wxGraphicsPath s_pathGround, s_pathSupplyUp, s_pathSupplyDown;
 
     void assign(const svCircuit& tocopy);
     void release();
 
+    //! Updates m_bb from the positions of the devices.
+    void computeBoundingBox();
+
+    //! Updates m_bb after the given device, which covered @a oldCells, has been
+    //! moved or rotated: all devices are considered only if the box shrinks.
+    void updateBoundingBoxFor(unsigned int dev, const wxRect& oldCells);
+
+    //! Replaces the route of the given net, keeping m_routeIndex up to date.
+    void setRoute(unsigned int net, const svRoute& route);
+
+    //! Adds the given node to the interned node table (if not already there).
+    void internNode(const svNode& name);
+
+    //! Marks as out of date the airwires and the routes of the nets attached
+    //! to the given device.
+    void invalidateAirwires(unsigned int dev);
+
+    //! Marks as out of date the routes of the nets with some wire running
+    //! through the cells of the given device, e.g. after it was moved there.
+    void invalidateRoutesThrough(unsigned int dev);
+
+    //! Updates m_occupancy after the given device, which covered @a oldCells,
+    //! has been moved or rotated.
+    void updateOccupancy(unsigned int dev, const wxRect& oldCells);
+
+    //! Returns true if the given device, covering now @a ownCells, can cover
+    //! @a cells without overlapping (or touching) any other device.
+    bool areCellsFreeFor(unsigned int dev, const wxRect& cells, const wxRect& ownCells) const;
+
+    //! Rebuilds the interned node table from m_nodes, keeping the order of the
+    //! nodes already in m_nodeNames, and then the connectivity index from
+    //! m_devices.
+    void rebuildNodeTable();
+
+    //! Adds the pins of the given device to the connectivity index.
+    void indexDevice(unsigned int idx);
+
+private:     // placement algorithms (see placement.cpp)
+
+    //! Places the devices with a force-directed algorithm: nets attract the
+    //! devices attached to them while all devices repel each other; the
+    //! repulsion is approximated with a Barnes-Hut quadtree.
+    void placeForceDirected();
+
+    //! Packs the devices in rows (shelves) whose width gives the layout the
+    //! aspect ratio of a screen; the external pins go in the first rows.
+    //! The devices can be grouped by kind (SVPA_PACK_BY_KIND) or by connectivity
+    //! (SVPA_PACK_BY_CLUSTER, in breadth-first order); otherwise they're sorted
+    //! by decreasing height, which wastes less space between the rows.
+    //! Takes O(n log n) time.
+    void placeShelves(svPlaceAlgorithm ag);
+
+    //! Places the devices in columns (layers) from left to right, following the
+    //! signal flow from the input pins to the output pins (Sugiyama-style):
+    //! each device goes in the layer given by its breadth-first distance from
+    //! the inputs, then the layers are sorted to reduce the crossings between
+    //! adjacent layers. Takes near-linear time.
+    void placeLayered();
+
+    //! Places the devices with the Kamada-Kawai algorithm, i.e. minimizing the
+    //! stress between their distances on the grid and their distances in the
+    //! circuit graph. Its cost is quadratic in the number of devices: large
+    //! circuits are placed with placeForceDirected() instead.
+    void placeKamadaKawai();
+
+    //! Places the devices with a multilevel algorithm: the device graph is
+    //! coarsened by heavy-edge matching, the coarsest graph is placed and then
+    //! each level is uncoarsened and refined locally. Its cost is linear in the
+    //! number of pins.
+    void placeMultilevel();
+
+    //! Places the devices minimizing the quadratic wirelength, with the external
+    //! pins as fixed points: the sparse linear systems are solved with a parallel
+    //! conjugate gradient solver, alternated with spreading steps which anchor
+    //! each device to a position in a less dense region of the layout.
+    void placeQuadratic();
+
+    //! Improves the quadratic placement with simulated annealing: several replicas
+    //! at different temperatures run in parallel and periodically exchange their
+    //! configurations (parallel tempering). The result depends only on the
+    //! number of threads. Large circuits are placed with placeQuadratic() only.
+    void placeAnnealing();
+
+    //! Moves each device to the free grid position closest to the given
+    //! (real-valued) position of its center, so that devices do not overlap.
+    void legalizePlacement(const std::vector<wxRealPoint>& centers);
+
+    //! Returns true if the running placement should publish a snapshot
+    //! (see svPlacementProgress).
+    bool isSnapshotDue() const
+        { return m_progress && m_progress->isSnapshotDue(); }
+
+    //! Returns true if the running placement has been asked to stop: the
+    //! algorithms then skip to their legalization.
+    bool isPlacementStopped() const
+        { return m_progress && m_progress->isStopRequested(); }
+
+    //! Publishes a snapshot of the running placement with the devices at the
+    //! given positions, or centered on the given points (the first ones, if
+    //! there are more points than devices), or where they are now.
+    void publishProgress(const std::vector<wxPoint>& positions);
+    void publishProgress(const std::vector<wxRealPoint>& centers);
+    void publishProgress();
+
+    //! Rotates the devices to shorten the connections to the other pins of
+    //! their nets, preferring the rotations with higher predisposition
+    //! (see svBaseDevice::getRotationPredisposition); devices which share no
+    //! net are handled in parallel. Rotations which would make a device touch
+    //! another one are discarded. Does not move the devices.
+    void optimizeRotations();
+
+    //! Reduces the crossings between the airwires mirroring single devices
+    //! (i.e. rotating them by 180 degrees) and swapping close devices of the
+    //! same size, as long as the crossings and the length of the airwires
+    //! involved decrease. Regions which share no net are improved in parallel.
+    //! Does not change the cells occupied by the devices.
+    void reduceCrossings();
+
 private:     // serialization functions
 
     friend class boost::serialization::access;
 
     template<class Archive>
-    void serialize(Archive & ar, const unsigned int WXUNUSED(version))
+    void serialize(Archive & ar, const unsigned int version)
     {
         ar & m_name;
-        ar & m_nodes;
+        if (version >= 3)
+            ar & m_nodeNames;
+        else
+            ar & m_nodes;
         ar & m_bb;
         ar & m_devices;
+        if (version >= 1)
+            ar & m_editSeq;
+        if (version >= 2)
+            ar & m_supplyNodes;
+
+        if (Archive::is_loading::value)
+        {
+            if (version >= 3)
+                m_nodes.insert(m_nodeNames.begin(), m_nodeNames.end());
+            rebuildNodeTable();
+        }
     }
 
 public:
     svCircuit(const std::string& name = "") 
-        { m_name = name; }
+        { m_name = name; m_editSeq = 0; m_hyperGraphValid = false; m_occupancyValid = false; m_occupancyOverlaps = false; m_progress = NULL; }
 
     svCircuit(const svCircuit& tocopy) 
     {
@@ -229,22 +779,210 @@ public:     // node & device management functions
 
     //! Adds an internal node to this subcircuit (unless a node with the same name already exists!).
     void addNode(const svNode& name)
-        { m_nodes.insert(name); }
+        {
+            if (m_nodes.insert(name).second)
+                internNode(name);
+        }
+
+    //! Makes the given node a supply net, if it's named like one, even when
+    //! it's attached to few pins (see getSupplyNetKind()).
+    void addSupplyNode(const svNode& name)
+        {
+            m_supplyNodes.insert(name);
+            m_hyperGraphValid = false;
+        }
 
     //! Adds the given device to this subcircuit.
     //! Note that this object will take the ownership of the given pointer.
+    //! The nodes of the device must have been already set.
     void addDevice(svBaseDevice* dev)
-        { m_devices.push_back(dev); }
+        {
+            m_devices.push_back(dev);
+            indexDevice(m_devices.size()-1);
+            m_hyperGraphValid = false;
+            m_occupancyValid = false;
+            m_airwiresValid.clear();
+            m_routesValid.clear();
+        }
 
     const std::set<svNode>& getNodes() const
         { return m_nodes; }
+
+    //! Returns the index of the given node in the interned node table or
+    //! ::svInvalidNodeIndex if the node is not part of this circuit.
+    //! Node indexes go from 0 to getNodesCount()-1.
+    unsigned int getNodeIndex(const svNode& node) const
+        {
+            std::unordered_map<svNode, unsigned int>::const_iterator it = m_nodeIndexes.find(node);
+            return it == m_nodeIndexes.end() ? svInvalidNodeIndex : it->second;
+        }
+
+    //! Returns the name of the node with the given index.
+    const svNode& getNodeName(unsigned int idx) const
+        { return m_nodeNames[idx]; }
+
+    //! Returns the number of nodes of this circuit.
+    size_t getNodesCount() const
+        { return m_nodeNames.size(); }
+
+    //! Returns the device pins attached to the node with the given index.
+    const svPinRefArray& getNodePins(unsigned int idx) const
+        { return m_nodePins[idx]; }
+
+    //! Returns the kind of supply of the node with the given index, i.e.
+    //! ::SVSN_GROUND for svGroundNode and, for the nodes attached to many
+    //! pins (or given to addSupplyNode()), the kind suggested by their name
+    //! (e.g. ::SVSN_POSITIVE for VDD, VCC_1 or X1.VDD!).
+    //! Supply nets are not wired, nor do they attract their devices: draw()
+    //! shows a supply symbol at each of their pins.
+    svSupplyNet getSupplyNetKind(unsigned int idx) const;
+
     const std::vector<svBaseDevice*>& getDevices() const
         { return m_devices; }
 
     //! Returns an array of positions of the device nodes connected with the
     //! the given one.
+    //! This function takes O(pins attached to the node) time.
     std::vector<wxPoint> getDeviceNodesConnectedTo(const svNode& node) const;
 
+    //! @overload
+    //! Takes the index of the node in the interned node table.
+    std::vector<wxPoint> getDeviceNodesConnectedTo(unsigned int nodeIdx) const;
+
+    //! Returns the absolute grid position of the given device pin.
+    wxPoint getPinPosition(const svPinRef& pin) const;
+
+    //! Returns the number of crossings between the airwires, approximating each
+    //! net with the minimum spanning tree of its pins (draw() shows instead a
+    //! Steiner tree, which has about the same crossings).
+    size_t getAirwireCrossingsCount() const;
+
+public:     // occupancy functions
+
+    //! Returns the grid cells covered by the devices of this circuit, rebuilding
+    //! them only if they're out of date (i.e. after updateBoundingBox()).
+    const svOccupancyGrid& getOccupancy() const;
+
+    //! Returns the grid cells covered by the given device when placed at @a pos.
+    wxRect getDeviceCells(unsigned int dev, const wxPoint& pos) const;
+
+    //! Returns true if the given device can be moved to @a pos without
+    //! overlapping (or touching) any other device.
+    bool isFreeFor(unsigned int dev, const wxPoint& pos) const;
+
+    //! Moves the given device to @a pos, updating the occupancy grid and
+    //! the bounding box of the circuit.
+    void moveDevice(unsigned int dev, const wxPoint& pos);
+
+    //! Rotates the given device clockwise by 90 degrees, updating the occupancy
+    //! grid and the bounding box of the circuit.
+    //! Returns false, without rotating it, if the rotated device would overlap
+    //! (or touch) other devices while it doesn't now.
+    bool rotateDevice(unsigned int dev);
+
+public:     // connectivity queries (see connectivity.cpp)
+
+    //! Returns the hypergraph of this circuit, building it only if it's
+    //! out of date. The returned reference is valid until the next change
+    //! of the circuit connectivity.
+    const svHyperGraph& getHyperGraph() const;
+
+    //! Returns the fan-out of the node with the given index, i.e. the number
+    //! of device pins attached to it.
+    unsigned int getNodeFanout(unsigned int nodeIdx) const
+        { return m_nodePins[nodeIdx].size(); }
+
+    //! Computes the connected components of this circuit; ignored nets
+    //! (see svHyperGraph::isIgnoredNet) do not connect the devices attached to them.
+    //! Fills @a deviceComponent with the component index of each device and
+    //! returns the number of components. Components are numbered in the order
+    //! of their first device.
+    //! This function uses all available cores (through a concurrent union-find).
+    unsigned int getConnectedComponents(std::vector<unsigned int>& deviceComponent) const;
+
+    //! Returns the shortest path between the two given pins as the list of
+    //! the pins it goes through: @a from, then the pins where the path enters
+    //! and leaves each device it crosses, and finally @a to. If the path crosses
+    //! the device of @a from, @a from is the pin where it enters it.
+    //! Ignored nets are never crossed: if @a from lies on one, the path leaves
+    //! it through the device of @a from. Returns an empty array if the two pins
+    //! are not connected.
+    //! This function uses all available cores (through a level-synchronous BFS).
+    svPinRefArray getShortestPath(const svPinRef& from, const svPinRef& to) const;
+
+    //! Returns the index of the device with the given SPICE name (e.g. "R1"; the
+    //! comparison is case-insensitive) or wxNOT_FOUND.
+    int findDevice(const std::string& spiceName) const;
+
+    //! Parses a pin reference in the form "DEVICE:PIN" (e.g. "M3:1", with
+    //! the pin index being zero-based). Returns false if it's not valid.
+    bool findPin(const std::string& desc, svPinRef& ret) const;
+
+    //! Returns a human-readable description of the given pin.
+    std::string getPinDescription(const svPinRef& pin) const;
+
+    //! Returns a hash of the structure of this circuit, which depends neither on
+    //! the names and the values of the devices nor on their order: circuits with
+    //! the same topology (like the members of an op-amp family) get the same hash.
+    //! If @a deviceLabels is given, it's filled with a label for each device
+    //! which depends only on its kind and on its neighbourhood; sorting by label
+    //! the devices of two circuits with the same hash matches their devices.
+    //! This function uses all available cores.
+    unsigned long long getStructuralHash(std::vector<unsigned long long>* deviceLabels = NULL) const;
+
+public:     // partitioning functions (see partition.cpp)
+
+    //! Partitions the devices of this circuit in @a nSheets parts of about the
+    //! same area, cutting as few nets as possible (with a multilevel recursive
+    //! bisection refined with the Fiduccia-Mattheyses heuristic).
+    //! Fills @a deviceSheet with the part of each device and returns the number
+    //! of nets cut by the partition (ignored nets excluded).
+    //! This function uses all available cores.
+    size_t partition(unsigned int nSheets, std::vector<unsigned int>& deviceSheet) const;
+
+    //! Splits this circuit in @a nSheets schematic sheets (see partition()),
+    //! returned in @a sheets: each one has copies of the devices of its part and
+    //! an svOffSheetConnector for each cut net, telling which sheets the net
+    //! continues on. The sheets are not placed.
+    void splitIntoSheets(unsigned int nSheets, svCircuitArray& sheets) const;
+
+public:     // routing functions (see router.cpp)
+
+    //! Routes the given nets (all of them if @a nets is empty) with orthogonal
+    //! wires on the grid, avoiding the devices; the wires can also run halfway
+    //! between the grid points, so that two of them fit between two devices
+    //! placed side by side. The wires are searched with A*,
+    //! with costs for their length, their bends and the nets they cross; the
+    //! nets sharing some wire are then ripped up and rerouted, making the
+    //! shared parts more expensive at each iteration.
+    //! The routes of the other nets are kept, and sharing their wires costs
+    //! like sharing the wires of another rerouted net.
+    //! The nets which lie in different parts of the circuit are routed in
+    //! parallel. Returns the number of nets which still share some wire.
+    size_t routeNets(const std::vector<unsigned int>& nets = std::vector<unsigned int>());
+
+    //! Routes again only the nets whose routes are out of date, i.e. the nets
+    //! of the devices moved by moveDevice() or rotateDevice() and the nets
+    //! whose wires run through their new cells; does nothing if routeNets()
+    //! was never called (or the routes were discarded).
+    //! If @a damaged is given, it's set to the area (in grid coordinates)
+    //! covered by the old and the new wires of these nets.
+    //! Returns the number of these nets which still share some wire.
+    size_t rerouteDirtyNets(wxRect* damaged = NULL);
+
+    //! Returns true if the node with the given index has an up-to-date route,
+    //! i.e. it was routed by routeNets() and its pins didn't move since then.
+    bool isRouted(unsigned int nodeIdx) const
+        { return nodeIdx < m_routesValid.size() && m_routesValid[nodeIdx]; }
+
+    //! Returns the route of the node with the given index (see isRouted()).
+    const svRoute& getRoute(unsigned int nodeIdx) const
+        { return m_routes[nodeIdx]; }
+
+    //! Discards all routes: the nets are drawn again with their airwires.
+    void clearRoutes()
+        { m_routes.clear(); m_routesValid.clear(); m_routeIndex.clear(); }
+
 public:     // misc functions
 
     void setName(const std::string& name)
@@ -252,12 +990,32 @@ public:     // misc functions
     std::string getName() const
         { return m_name; }
 
-    //! FIXME
+    //! Returns the sequence number of the last layout edit applied to this circuit.
+    unsigned long getEditSeq() const
+        { return m_editSeq; }
+    void setEditSeq(unsigned long seq)
+        { m_editSeq = seq; }
+
+    //! Builds the connectivity graph of this circuit: each node of the circuit
+    //! is a vertex (whose index is the one returned by getNodeIndex()) and
+    //! nodes attached to the same device are connected by an edge.
+    //! The ground and the other supply nets (see getSupplyNetKind()) are not
+    //! connected to any other node.
+    //! Parallel edges are kept: their multiplicity tells how many devices
+    //! connect the two nodes. Building the graph takes O(pins) time and memory.
     svUGraph buildGraph() const;
 
+    //! Builds the hypergraph of this circuit, whose size is linear in the number
+    //! of pins. Placement and partitioning algorithms should use this structure
+    //! rather than buildGraph(). Building it takes O(pins) time.
+    svHyperGraph buildHyperGraph() const;
+
     //! Updates the devices' positions (in the virtual grid) using the 
     //! specified algorithm. Returns the bounding box of the circuit.
-    const wxRect& placeDevices(svPlaceAlgorithm ag);
+    //! If @a progress is given, the placement publishes there snapshots of its
+    //! progress and stops early when asked to: this function can then run in a
+    //! secondary thread, with the main thread showing the snapshots.
+    const wxRect& placeDevices(svPlaceAlgorithm ag, svPlacementProgress* progress = NULL);
 
 public:     // drawing functions
 
@@ -270,15 +1028,28 @@ public:     // drawing functions
     const wxRect& getBoundingBox() const
         { return m_bb; }
 
+    //! Returns the airwires drawn for the node with the given index: a rectilinear
+    //! Steiner tree of its pins (see svGetRectilinearSteinerTree()). The tree is
+    //! cached and computed again only after the pins of the node moved (i.e. after
+    //! moveDevice() or updateBoundingBox()); computing it takes O(k log k) time
+    //! for k pins.
+    const svAirwireArray& getAirwires(unsigned int nodeIdx) const;
+
+    //! Returns the smallest rectangle (in grid coordinates) containing the route
+    //! or the airwires which draw() shows for the node with the given index.
+    wxRect getNetBoundingBox(unsigned int nodeIdx) const;
+
     static void initGraphics(wxGraphicsContext* gc, unsigned int gridSpacing);
 
     static void releaseGraphics()
-        { s_pathGround.UnRef(); }
+        { s_pathGround.UnRef(); s_pathSupplyUp.UnRef(); s_pathSupplyDown.UnRef(); }
 
     //! Draws this circuit on the given DC, with the given grid size
-    //! (in pixels).
+    //! (in pixels). If @a region (in pixels) is not empty, only the devices
+    //! and the wires which lie in it are drawn: the labels next to them are
+    //! not considered, thus the caller must enlarge it by their size.
     void draw(wxGraphicsContext* gc, unsigned int gridSpacing, 
-              int selectedDevice = wxNOT_FOUND) const;
+              int selectedDevice = wxNOT_FOUND, const wxRect& region = wxRect()) const;
 
     //! Returns the index of the first device whose (absolute) center point
     //! lies in the given rectangle.
@@ -289,8 +1060,84 @@ public:     // parser functions
     //! Parses the given lines as a SPICE description of a SUBCKT.
     bool parseSPICESubCkt(const wxArrayString& lines, 
                           size_t startIdx, size_t endIdx);
+
+public:     // NVS functions
+
+    //! Saves this circuit in the native NetlistViewer format (NVS).
+    //! This function can be safely called from a secondary thread.
+    bool saveNVS(const std::string& filename) const;
+
+    //! Loads this circuit from a file in the native NetlistViewer format (NVS).
+    bool loadNVS(const std::string& filename);
 };
 
+BOOST_CLASS_VERSION(svCircuit, 3)
+
+
+
+// ----------------------------------------------------------------------------
+// svLayoutStore
+// ----------------------------------------------------------------------------
+
+//! The layouts of the circuits placed so far, keyed by their structural hash
+//! (see svCircuit::getStructuralHash): a circuit with the same topology of a
+//! stored one (e.g. another member of the same op-amp family) takes its layout
+//! at once instead of being placed again.
+//! All functions can be called concurrently by several threads.
+class svLayoutStore
+{
+    //! A stored layout; the devices are sorted by their structural labels.
+    struct Layout
+    {
+        std::vector<unsigned long long> labels;
+        std::vector<wxPoint> positions;
+        std::vector<svRotation> rotations;
+    };
+
+    //! The stored layouts, keyed by the hash of their circuits.
+    std::unordered_map<unsigned long long, Layout> m_layouts;
+
+    //! Protects m_layouts.
+    mutable std::mutex m_mutex;
+
+public:
+    svLayoutStore() {}
+
+    //! Stores the current layout of the given circuit, replacing the one of
+    //! the circuit with the same structure, if any.
+    void store(const svCircuit& ckt);
+
+    //! Gives to the given circuit the stored layout of a circuit with the same
+    //! structure and returns true; returns false if there's none.
+    bool apply(svCircuit& ckt) const;
+
+    //! Returns the number of stored layouts.
+    size_t size() const;
+
+    //! Removes all stored layouts.
+    void clear();
+};
+
+
+
+// ----------------------------------------------------------------------------
+// hierarchical placement
+// ----------------------------------------------------------------------------
+
+//! Places the given subcircuit definitions bottom-up over their hierarchy: each
+//! definition is placed once, after the definitions it instantiates, and its
+//! instances (see svSubcircuitInstance) then become single macro devices with its
+//! layout in the definitions which contain them. The definitions which don't
+//! depend on each other are placed in parallel.
+//! If @a store is given, the definitions with the structure of a stored layout
+//! take it instead of being placed, and the others are stored once placed.
+//! If @a maxTopLevelDevices is nonzero, the top-level definitions with more
+//! devices are left unplaced (e.g. to be split into sheets by the caller).
+//! Returns the index of the top-level definition, i.e. the first one which
+//! is not instantiated by the others.
+size_t svPlaceHierarchy(svCircuitArray& circuits, svPlaceAlgorithm ag,
+                        svLayoutStore* store = NULL, size_t maxTopLevelDevices = 0);
+
 
 
 // ----------------------------------------------------------------------------
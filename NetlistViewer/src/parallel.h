@@ -0,0 +1,135 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        parallel.h
+// Purpose:     helpers for the multi-threaded algorithms
+// Author:      Francesco Montorsi
+// Created:     18/10/2026
+// Copyright:   (c) 2026 Francesco Montorsi
+// Licence:     GPL licence
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+// ----------------------------------------------------------------------------
+// headers
+// ----------------------------------------------------------------------------
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+// ----------------------------------------------------------------------------
+// constants
+// ----------------------------------------------------------------------------
+
+//! Ranges shorter than this are processed by svParallelFor() in the calling
+//! thread: spawning threads would cost more than the work itself.
+#define SV_PARALLEL_MIN_CHUNK       2048
+
+// ----------------------------------------------------------------------------
+// helper functions
+// ----------------------------------------------------------------------------
+
+//! Returns the number of threads to use for the parallel algorithms.
+inline unsigned int svGetThreadsCount()
+{
+    unsigned int n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+//! Splits the range [0, n) in (at most) @a nThreads contiguous chunks and calls
+//! <tt>fn(begin, end, threadIdx)</tt> for each of them, in parallel.
+//! If @a nThreads is zero, svGetThreadsCount() threads are used.
+//! The function returns when all chunks have been processed.
+template<typename F>
+void svParallelFor(size_t n, F fn, unsigned int nThreads = 0,
+                   size_t minChunk = SV_PARALLEL_MIN_CHUNK)
+{
+    if (nThreads == 0)
+        nThreads = svGetThreadsCount();
+    nThreads = (unsigned int)std::min<size_t>(nThreads, (n + minChunk - 1)/std::max<size_t>(minChunk, 1));
+    if (nThreads <= 1)
+    {
+        if (n > 0)
+            fn(size_t(0), n, 0u);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    size_t chunk = (n + nThreads - 1)/nThreads;
+    for (unsigned int t=1; t<nThreads; t++)
+    {
+        size_t begin = t*chunk, end = std::min(n, begin + chunk);
+        if (begin < end)
+            threads.push_back(std::thread(fn, begin, end, t));
+    }
+
+    fn(size_t(0), std::min(n, chunk), 0u);     // the calling thread does its share
+
+    for (size_t t=0; t<threads.size(); t++)
+        threads[t].join();
+}
+
+// ----------------------------------------------------------------------------
+// svConcurrentUnionFind
+// ----------------------------------------------------------------------------
+
+//! A lock-free union-find (disjoint-set) structure which can be updated by
+//! multiple threads at the same time.
+//! Roots are always linked under the root with the smaller index, so that the
+//! final representative of each set is its smallest element; finds use path
+//! halving done with compare-and-swap operations.
+class svConcurrentUnionFind
+{
+    std::vector< std::atomic<unsigned int> > m_parent;
+
+public:
+    svConcurrentUnionFind(size_t n)
+        : m_parent(n)
+        {
+            for (size_t i=0; i<n; i++)
+                m_parent[i].store((unsigned int)i, std::memory_order_relaxed);
+        }
+
+    size_t size() const
+        { return m_parent.size(); }
+
+    //! Returns the representative of the set containing @a x.
+    unsigned int find(unsigned int x)
+        {
+            while (true)
+            {
+                unsigned int p = m_parent[x].load(std::memory_order_relaxed);
+                if (p == x)
+                    return x;
+
+                unsigned int gp = m_parent[p].load(std::memory_order_relaxed);
+                if (p != gp)
+                    m_parent[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+                x = gp;
+            }
+        }
+
+    //! Merges the sets containing @a a and @a b.
+    void unite(unsigned int a, unsigned int b)
+        {
+            while (true)
+            {
+                a = find(a);
+                b = find(b);
+                if (a == b)
+                    return;
+                if (a < b)
+                    std::swap(a, b);
+
+                // link the root with the larger index under the other one;
+                // if another thread changed the parent of 'a' meanwhile, retry
+                unsigned int expected = a;
+                if (m_parent[a].compare_exchange_strong(expected, b, std::memory_order_acq_rel))
+                    return;
+            }
+        }
+};
+
+#endif      // _PARALLEL_H_
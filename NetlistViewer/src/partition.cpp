@@ -0,0 +1,619 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        partition.cpp
+// Purpose:     partitioning of the circuits in schematic sheets
+// Author:      Francesco Montorsi
+// Created:     18/10/2026
+// Copyright:   (c) 2026 Francesco Montorsi
+// Licence:     GPL licence
+/////////////////////////////////////////////////////////////////////////////
+
+// ============================================================================
+// declarations
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// headers
+// ----------------------------------------------------------------------------
+
+#include <wx/wx.h>
+
+#include <limits.h>
+#include <math.h>
+#include <algorithm>
+#include <queue>
+#include <random>
+
+#include "netlist.h"
+#include "devices.h"
+#include "parallel.h"
+
+// ----------------------------------------------------------------------------
+// constants
+// ----------------------------------------------------------------------------
+
+// the seed of the random number generators, so that the partitions are
+// reproducible:
+#define PARTITION_SEED              42
+
+// the nets with more pins than this (supplies, clocks, resets) are cut
+// anyway: they're ignored by the partitioning
+#define PARTITION_MAX_NET_DEGREE    64
+
+// the maximum imbalance between the parts: each part may weigh this fraction
+// more than its share of the total area
+#define PARTITION_IMBALANCE         0.05
+
+// the coarsening stops at this number of vertices (or when it doesn't reduce
+// the hypergraph anymore); the coarsest hypergraph is bisected this number of
+// times (in parallel) from different seeds, keeping the best bisection
+#define PARTITION_COARSEST_VERTICES 160
+#define PARTITION_INITIAL_TRIES     8
+
+// the FM refinement does at most this number of passes, and gives up a pass
+// after this number of moves which don't improve the best cut found
+#define PARTITION_FM_PASSES         8
+#define PARTITION_FM_MAX_USELESS    256
+
+
+// ============================================================================
+// implementation
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// helper classes
+// ----------------------------------------------------------------------------
+
+//! A hypergraph being partitioned: its vertices are devices or clusters of
+//! devices, weighted by their area. Both the net => vertices and the
+//! vertex => nets incidences are stored in CSR format (see svHyperGraph).
+struct svPartitionGraph
+{
+    std::vector<unsigned int> weights;
+    std::vector<unsigned int> netOffsets, netVertices;
+    std::vector<unsigned int> vertexOffsets, vertexNets;
+
+    svPartitionGraph()
+        { netOffsets.push_back(0); }
+
+    size_t getVerticesCount() const
+        { return weights.size(); }
+    size_t getNetsCount() const
+        { return netOffsets.size() - 1; }
+
+    //! Adds a net connecting the given vertices (which must be distinct).
+    void addNet(const std::vector<unsigned int>& vertices)
+        {
+            netVertices.insert(netVertices.end(), vertices.begin(), vertices.end());
+            netOffsets.push_back(netVertices.size());
+        }
+
+    //! Builds the vertex => nets incidences from the net => vertices ones.
+    void buildVertexNets()
+        {
+            vertexOffsets.assign(getVerticesCount() + 1, 0);
+            for (size_t k=0; k<netVertices.size(); k++)
+                vertexOffsets[netVertices[k] + 1]++;
+            for (size_t v=0; v<getVerticesCount(); v++)
+                vertexOffsets[v+1] += vertexOffsets[v];
+
+            vertexNets.resize(netVertices.size());
+            std::vector<unsigned int> next(vertexOffsets.begin(), vertexOffsets.end() - 1);
+            for (size_t net=0; net<getNetsCount(); net++)
+                for (unsigned int k=netOffsets[net]; k<netOffsets[net+1]; k++)
+                    vertexNets[next[netVertices[k]]++] = net;
+        }
+
+    unsigned long long getTotalWeight() const
+        {
+            unsigned long long total = 0;
+            for (size_t v=0; v<weights.size(); v++)
+                total += weights[v];
+            return total;
+        }
+};
+
+//! Returns the number of nets of @a g cut by the given bisection.
+static size_t getCut(const svPartitionGraph& g, const std::vector<unsigned char>& side)
+{
+    size_t cut = 0;
+    for (size_t net=0; net<g.getNetsCount(); net++)
+        for (unsigned int k=g.netOffsets[net]+1; k<g.netOffsets[net+1]; k++)
+            if (side[g.netVertices[k]] != side[g.netVertices[g.netOffsets[net]]])
+            {
+                cut++;
+                break;
+            }
+    return cut;
+}
+
+// ----------------------------------------------------------------------------
+// multilevel bisection
+// ----------------------------------------------------------------------------
+
+//! Returns @a fine with the vertices matched in pairs merged; the pairs are
+//! chosen visiting the vertices in random order and matching each one with the
+//! unmatched neighbour sharing the most (small) nets with it, unless the pair
+//! would weigh more than @a maxWeight.
+//! Fills @a coarseOf with the coarse vertex of each fine vertex.
+static svPartitionGraph coarsenGraph(const svPartitionGraph& fine, std::vector<unsigned int>& coarseOf,
+                                     unsigned long long maxWeight, std::mt19937& rng)
+{
+    size_t n = fine.getVerticesCount();
+    std::vector<unsigned int> order(n);
+    for (size_t v=0; v<n; v++)
+        order[v] = v;
+    std::shuffle(order.begin(), order.end(), rng);
+
+    const unsigned int unmatched = UINT_MAX;
+    std::vector<unsigned int> mate(n, unmatched), touched;
+    std::vector<float> rating(n, 0);
+    for (size_t i=0; i<n; i++)
+    {
+        unsigned int v = order[i];
+        if (mate[v] != unmatched)
+            continue;
+
+        for (unsigned int e=fine.vertexOffsets[v]; e<fine.vertexOffsets[v+1]; e++)
+        {
+            unsigned int net = fine.vertexNets[e];
+            unsigned int degree = fine.netOffsets[net+1] - fine.netOffsets[net];
+            for (unsigned int k=fine.netOffsets[net]; k<fine.netOffsets[net+1]; k++)
+            {
+                unsigned int u = fine.netVertices[k];
+                if (u == v || mate[u] != unmatched ||
+                    fine.weights[u] + fine.weights[v] > maxWeight)
+                    continue;
+                if (rating[u] == 0)
+                    touched.push_back(u);
+                rating[u] += 1.0f/(degree - 1);
+            }
+        }
+
+        unsigned int best = v;
+        for (size_t k=0; k<touched.size(); k++)
+            if (best == v || rating[touched[k]] > rating[best])
+                best = touched[k];
+        for (size_t k=0; k<touched.size(); k++)
+            rating[touched[k]] = 0;
+        touched.clear();
+
+        mate[v] = best;
+        mate[best] = v;
+    }
+
+    svPartitionGraph coarse;
+    coarseOf.assign(n, unmatched);
+    for (size_t v=0; v<n; v++)
+    {
+        if (coarseOf[v] != unmatched)
+            continue;
+
+        coarseOf[v] = coarseOf[mate[v]] = coarse.weights.size();
+        coarse.weights.push_back(fine.weights[v] + (mate[v] != v ? fine.weights[mate[v]] : 0));
+    }
+
+    // the nets whose pins all fall in the same coarse vertex disappear
+    std::vector<unsigned int> vertices;
+    for (size_t net=0; net<fine.getNetsCount(); net++)
+    {
+        vertices.clear();
+        for (unsigned int k=fine.netOffsets[net]; k<fine.netOffsets[net+1]; k++)
+            vertices.push_back(coarseOf[fine.netVertices[k]]);
+        std::sort(vertices.begin(), vertices.end());
+        vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+        if (vertices.size() > 1)
+            coarse.addNet(vertices);
+    }
+    coarse.buildVertexNets();
+
+    return coarse;
+}
+
+//! Improves the given bisection of @a g with the Fiduccia-Mattheyses heuristic:
+//! each pass moves (once) the vertices with the highest gain, even if negative,
+//! as long as the side they go to doesn't weigh more than @a maxWeight, and then
+//! undoes the moves done after the smallest cut found.
+static void refineBisection(const svPartitionGraph& g, std::vector<unsigned char>& side,
+                            const unsigned long long maxWeight[2])
+{
+    size_t n = g.getVerticesCount(), nNets = g.getNetsCount();
+    std::vector<unsigned int> count(2*nNets);
+    std::vector<int> gain(n);
+    std::vector<unsigned char> locked(n);
+    std::vector<unsigned int> moves;
+
+    for (unsigned int pass=0; pass<PARTITION_FM_PASSES; pass++)
+    {
+        unsigned long long weight[2] = { 0, 0 };
+        for (size_t v=0; v<n; v++)
+            weight[side[v]] += g.weights[v];
+
+        std::fill(count.begin(), count.end(), 0);
+        for (size_t net=0; net<nNets; net++)
+            for (unsigned int k=g.netOffsets[net]; k<g.netOffsets[net+1]; k++)
+                count[2*net + side[g.netVertices[k]]]++;
+
+        // the gain of a vertex is the decrease of the cut obtained moving it;
+        // the heaps of the two sides are updated lazily: the entries whose
+        // gain is out of date are skipped
+        std::priority_queue< std::pair<int, unsigned int> > heap[2];
+        for (size_t v=0; v<n; v++)
+        {
+            int gv = 0;
+            for (unsigned int e=g.vertexOffsets[v]; e<g.vertexOffsets[v+1]; e++)
+            {
+                unsigned int net = g.vertexNets[e];
+                if (count[2*net + side[v]] == 1)
+                    gv++;
+                if (count[2*net + 1 - side[v]] == 0)
+                    gv--;
+            }
+            gain[v] = gv;
+            heap[side[v]].push(std::make_pair(gv, (unsigned int)v));
+        }
+        std::fill(locked.begin(), locked.end(), 0);
+
+        auto changeGain = [&](unsigned int u, int delta) {
+            if (locked[u])
+                return;
+            gain[u] += delta;
+            heap[side[u]].push(std::make_pair(gain[u], u));
+        };
+
+        moves.clear();
+        int totalGain = 0, bestGain = 0;
+        size_t bestMoves = 0;
+        unsigned long long bestImbalance = std::max(weight[0], weight[1]);
+        while (moves.size() - bestMoves < PARTITION_FM_MAX_USELESS)
+        {
+            // drop the stale entries, then move from the side with the best
+            // gain among the moves which keep (or improve) the balance
+            for (int s=0; s<2; s++)
+                while (!heap[s].empty() &&
+                       (locked[heap[s].top().second] || gain[heap[s].top().second] != heap[s].top().first))
+                    heap[s].pop();
+
+            int from = -1;
+            for (int s=0; s<2; s++)
+            {
+                if (heap[s].empty())
+                    continue;
+                unsigned int v = heap[s].top().second;
+                bool feasible = weight[1-s] + g.weights[v] <= maxWeight[1-s] || weight[s] > maxWeight[s];
+                if (feasible && (from < 0 || heap[s].top().first > heap[from].top().first))
+                    from = s;
+            }
+            if (from < 0)
+                break;
+
+            unsigned int v = heap[from].top().second;
+            heap[from].pop();
+            int to = 1 - from;
+            locked[v] = 1;
+            totalGain += gain[v];
+            weight[from] -= g.weights[v];
+            weight[to] += g.weights[v];
+            side[v] = to;
+            moves.push_back(v);
+
+            // update the gains of the vertices sharing a net with v
+            for (unsigned int e=g.vertexOffsets[v]; e<g.vertexOffsets[v+1]; e++)
+            {
+                unsigned int net = g.vertexNets[e];
+                const unsigned int* first = &g.netVertices[g.netOffsets[net]];
+                const unsigned int* last = &g.netVertices[0] + g.netOffsets[net+1];
+
+                if (count[2*net + to] == 0)
+                    for (const unsigned int* u = first; u != last; u++)
+                        changeGain(*u, +1);
+                else if (count[2*net + to] == 1)
+                    for (const unsigned int* u = first; u != last; u++)
+                        if (side[*u] == to && *u != v)
+                            changeGain(*u, -1);
+
+                count[2*net + from]--;
+                count[2*net + to]++;
+
+                if (count[2*net + from] == 0)
+                    for (const unsigned int* u = first; u != last; u++)
+                        changeGain(*u, -1);
+                else if (count[2*net + from] == 1)
+                    for (const unsigned int* u = first; u != last; u++)
+                        if (side[*u] == from)
+                            changeGain(*u, +1);
+            }
+
+            unsigned long long imbalance = std::max(weight[0], weight[1]);
+            if (totalGain > bestGain || (totalGain == bestGain && imbalance < bestImbalance))
+            {
+                bestGain = totalGain;
+                bestMoves = moves.size();
+                bestImbalance = imbalance;
+            }
+        }
+
+        // undo the moves done after the best cut
+        for (size_t k=bestMoves; k<moves.size(); k++)
+            side[moves[k]] ^= 1;
+
+        if (bestMoves == 0)
+            break;
+    }
+}
+
+//! Bisects @a g (whose vertices must all be connected by its nets, directly or
+//! not, for the best results) by growing the first side breadth-first from a
+//! random vertex until it weighs @a target.
+static void growBisection(const svPartitionGraph& g, std::vector<unsigned char>& side,
+                          unsigned long long target, std::mt19937& rng)
+{
+    size_t n = g.getVerticesCount();
+    side.assign(n, 1);
+
+    std::vector<unsigned char> visited(n, 0);
+    std::vector<unsigned int> queue;
+    std::uniform_int_distribution<unsigned int> anyVertex(0, n-1);
+    unsigned long long weight = 0;
+    size_t head = 0;
+    while (weight < target)
+    {
+        if (head == queue.size())
+        {
+            // start (again) from a random unvisited vertex
+            unsigned int seed = anyVertex(rng);
+            while (visited[seed])
+                seed = (seed + 1) % n;
+            visited[seed] = 1;
+            queue.push_back(seed);
+        }
+
+        unsigned int v = queue[head++];
+        side[v] = 0;
+        weight += g.weights[v];
+        for (unsigned int e=g.vertexOffsets[v]; e<g.vertexOffsets[v+1]; e++)
+        {
+            unsigned int net = g.vertexNets[e];
+            for (unsigned int k=g.netOffsets[net]; k<g.netOffsets[net+1]; k++)
+                if (!visited[g.netVertices[k]])
+                {
+                    visited[g.netVertices[k]] = 1;
+                    queue.push_back(g.netVertices[k]);
+                }
+        }
+    }
+}
+
+//! Returns a bisection of @a g where the first side has about the given
+//! fraction of its total weight, computed with a multilevel scheme: the
+//! hypergraph is coarsened, the coarsest one is bisected several times (in
+//! parallel) and the best bisection is projected back, level by level, and
+//! refined with the FM heuristic at each level.
+//! Each side may weigh up to @a imbalance more than its share.
+static std::vector<unsigned char> bisectGraph(const svPartitionGraph& g, double fraction,
+                                              double imbalance, unsigned int seed)
+{
+    unsigned long long total = g.getTotalWeight();
+    unsigned long long heaviest = 0;
+    for (size_t v=0; v<g.getVerticesCount(); v++)
+        heaviest = std::max<unsigned long long>(heaviest, g.weights[v]);
+
+    unsigned long long maxWeight[2];
+    maxWeight[0] = std::max<unsigned long long>(fraction*total*(1 + imbalance), fraction*total + heaviest);
+    maxWeight[1] = std::max<unsigned long long>((1 - fraction)*total*(1 + imbalance), (1 - fraction)*total + heaviest);
+
+    // coarsen: the clusters must be small enough to keep the balance
+    std::mt19937 rng(seed);
+    std::vector<svPartitionGraph> levels(1, g);
+    std::vector< std::vector<unsigned int> > coarseOf;
+    unsigned long long maxClusterWeight = std::max<unsigned long long>(heaviest, total*imbalance/2);
+    while (levels.back().getVerticesCount() > PARTITION_COARSEST_VERTICES)
+    {
+        coarseOf.push_back(std::vector<unsigned int>());
+        svPartitionGraph coarse = coarsenGraph(levels.back(), coarseOf.back(), maxClusterWeight, rng);
+        if (coarse.getVerticesCount() > 0.9*levels.back().getVerticesCount())
+        {
+            coarseOf.pop_back();
+            break;
+        }
+        levels.push_back(coarse);
+    }
+
+    // bisect the coarsest hypergraph from several seeds
+    const svPartitionGraph& coarsest = levels.back();
+    std::vector< std::vector<unsigned char> > tries(PARTITION_INITIAL_TRIES);
+    std::vector<size_t> cuts(PARTITION_INITIAL_TRIES);
+    svParallelFor(PARTITION_INITIAL_TRIES,
+        [&](size_t begin, size_t end, unsigned int) {
+            for (size_t t=begin; t<end; t++)
+            {
+                std::mt19937 tryRng(seed + t + 1);
+                growBisection(coarsest, tries[t], fraction*total, tryRng);
+                refineBisection(coarsest, tries[t], maxWeight);
+                cuts[t] = getCut(coarsest, tries[t]);
+            }
+        }, 0, 1);
+    std::vector<unsigned char> side = tries[std::min_element(cuts.begin(), cuts.end()) - cuts.begin()];
+
+    // project and refine
+    for (size_t l=levels.size()-1; l>0; l--)
+    {
+        std::vector<unsigned char> fineSide(levels[l-1].getVerticesCount());
+        for (size_t v=0; v<fineSide.size(); v++)
+            fineSide[v] = side[coarseOf[l-1][v]];
+        side.swap(fineSide);
+        refineBisection(levels[l-1], side, maxWeight);
+    }
+
+    return side;
+}
+
+// ----------------------------------------------------------------------------
+// svCircuit - partitioning
+// ----------------------------------------------------------------------------
+
+size_t svCircuit::partition(unsigned int nSheets, std::vector<unsigned int>& deviceSheet) const
+{
+    const svHyperGraph& hg = getHyperGraph();
+    size_t nDevices = m_devices.size();
+    deviceSheet.assign(nDevices, 0);
+    if (nSheets < 2 || nDevices < 2)
+        return 0;
+
+    // recursive bisection: each part is a range of sheets and it's split in
+    // two parts with half the sheets each; the parts of the same depth are
+    // independent and are bisected in parallel
+    struct Part
+    {
+        std::vector<unsigned int> devices;
+        unsigned int firstSheet, nSheets;
+    };
+    std::vector<Part> parts(1), next;
+    parts[0].firstSheet = 0;
+    parts[0].nSheets = nSheets;
+    for (unsigned int i=0; i<nDevices; i++)
+        parts[0].devices.push_back(i);
+
+    // the imbalances of the bisections multiply: each one gets its share
+    unsigned int depth = 0;
+    while ((1u << depth) < nSheets)
+        depth++;
+    double imbalance = pow(1 + PARTITION_IMBALANCE, 1.0/depth) - 1;
+
+    std::vector<unsigned int> local(nDevices);
+    while (!parts.empty())
+    {
+        std::vector< std::vector<unsigned char> > sides(parts.size());
+        for (size_t p=0; p<parts.size(); p++)
+            for (size_t k=0; k<parts[p].devices.size(); k++)
+                local[parts[p].devices[k]] = k;
+
+        svParallelFor(parts.size(),
+            [&](size_t begin, size_t end, unsigned int) {
+                std::vector<unsigned int> vertices;
+                std::vector<size_t> seen(hg.getNetsCount(), parts.size());     // the part which added each net last
+                for (size_t p=begin; p<end; p++)
+                {
+                    const Part& part = parts[p];
+                    if (part.nSheets < 2 || part.devices.size() < 2)
+                        continue;
+
+                    // the hypergraph of the devices of this part, with the
+                    // pieces of the nets which lie in this part
+                    svPartitionGraph g;
+                    for (size_t k=0; k<part.devices.size(); k++)
+                    {
+                        wxRect bb = m_devices[part.devices[k]]->getRelativeBoundingBox();
+                        g.weights.push_back((bb.width + 1)*(bb.height + 1));
+                    }
+                    for (size_t k=0; k<part.devices.size(); k++)
+                    {
+                        unsigned int dev = part.devices[k];
+                        for (const unsigned int* net = hg.getDeviceNetsBegin(dev); net != hg.getDeviceNetsEnd(dev); net++)
+                        {
+                            unsigned int degree = hg.getNetDegree(*net);
+                            if (hg.isIgnoredNet(*net) || degree < 2 || degree > PARTITION_MAX_NET_DEGREE ||
+                                seen[*net] == p)
+                                continue;       // each net is added by its first device in this part
+                            seen[*net] = p;
+
+                            vertices.clear();
+                            for (const unsigned int* other = hg.getNetDevicesBegin(*net); other != hg.getNetDevicesEnd(*net); other++)
+                                if (local[*other] < part.devices.size() && part.devices[local[*other]] == *other)
+                                    vertices.push_back(local[*other]);
+                            std::sort(vertices.begin(), vertices.end());
+                            vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+                            if (vertices.size() > 1)
+                                g.addNet(vertices);
+                        }
+                    }
+                    g.buildVertexNets();
+
+                    double fraction = double(part.nSheets/2)/part.nSheets;
+                    sides[p] = bisectGraph(g, fraction, imbalance, PARTITION_SEED + part.firstSheet);
+                }
+            }, 0, 1);
+
+        next.clear();
+        for (size_t p=0; p<parts.size(); p++)
+        {
+            if (sides[p].empty())
+                continue;
+
+            Part halves[2];
+            halves[0].firstSheet = parts[p].firstSheet;
+            halves[0].nSheets = parts[p].nSheets/2;
+            halves[1].firstSheet = parts[p].firstSheet + halves[0].nSheets;
+            halves[1].nSheets = parts[p].nSheets - halves[0].nSheets;
+            for (size_t k=0; k<parts[p].devices.size(); k++)
+            {
+                unsigned int dev = parts[p].devices[k];
+                halves[sides[p][k]].devices.push_back(dev);
+                deviceSheet[dev] = halves[sides[p][k]].firstSheet;
+            }
+            next.push_back(halves[0]);
+            next.push_back(halves[1]);
+        }
+        parts.swap(next);
+    }
+
+    // the cut nets, including the ones ignored above
+    size_t cut = 0;
+    for (unsigned int net=0; net<hg.getNetsCount(); net++)
+    {
+        if (hg.isIgnoredNet(net) || hg.getNetDegree(net) < 2)
+            continue;
+
+        unsigned int first = deviceSheet[*hg.getNetDevicesBegin(net)];
+        for (const unsigned int* dev = hg.getNetDevicesBegin(net); dev != hg.getNetDevicesEnd(net); dev++)
+            if (deviceSheet[*dev] != first)
+            {
+                cut++;
+                break;
+            }
+    }
+    return cut;
+}
+
+void svCircuit::splitIntoSheets(unsigned int nSheets, svCircuitArray& sheets) const
+{
+    std::vector<unsigned int> deviceSheet;
+    partition(nSheets, deviceSheet);
+
+    sheets.clear();
+    sheets.resize(nSheets);
+    for (unsigned int s=0; s<nSheets; s++)
+        sheets[s].setName(wxString::Format("%s [%u/%u]", m_name, s+1, nSheets).ToStdString());
+    for (size_t i=0; i<m_devices.size(); i++)
+        sheets[deviceSheet[i]].addDevice(m_devices[i]->clone());
+
+    // each sheet gets an off-sheet connector for each of its cut nets, which
+    // tells where the net continues
+    const svHyperGraph& hg = getHyperGraph();
+    std::vector<unsigned int> netSheets;
+    for (unsigned int net=0; net<hg.getNetsCount(); net++)
+    {
+        netSheets.clear();
+        for (const unsigned int* dev = hg.getNetDevicesBegin(net); dev != hg.getNetDevicesEnd(net); dev++)
+            netSheets.push_back(deviceSheet[*dev]);
+        std::sort(netSheets.begin(), netSheets.end());
+        netSheets.erase(std::unique(netSheets.begin(), netSheets.end()), netSheets.end());
+
+        // the supply nets have their own symbol on each sheet, even where
+        // only a few of their pins are
+        if (hg.isIgnoredNet(net))
+        {
+            for (size_t k=0; k<netSheets.size(); k++)
+                sheets[netSheets[k]].addSupplyNode(m_nodeNames[net]);
+            continue;
+        }
+        if (netSheets.size() < 2)
+            continue;
+
+        for (size_t k=0; k<netSheets.size(); k++)
+        {
+            std::vector<unsigned int> others(netSheets);
+            others.erase(others.begin() + k);
+            sheets[netSheets[k]].addDevice(new svOffSheetConnector(m_nodeNames[net], others));
+        }
+    }
+}
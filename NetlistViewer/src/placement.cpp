@@ -0,0 +1,3191 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        placement.cpp
+// Purpose:     placement algorithms for the devices of a circuit
+// Author:      Francesco Montorsi
+// Created:     18/10/2026
+// Copyright:   (c) 2026 Francesco Montorsi
+// Licence:     GPL licence
+/////////////////////////////////////////////////////////////////////////////
+
+// ============================================================================
+// declarations
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// headers
+// ----------------------------------------------------------------------------
+
+#include <wx/wx.h>
+
+#include <math.h>
+#include <limits.h>
+#include <float.h>
+#include <algorithm>
+#include <random>
+#include <map>
+
+#include "netlist.h"
+#include "devices.h"
+#include "parallel.h"
+
+// ----------------------------------------------------------------------------
+// constants
+// ----------------------------------------------------------------------------
+
+// the distance (in grid units) between two connected devices which the
+// placement algorithms try to obtain:
+#define IDEAL_DEVICE_DISTANCE       4.0
+
+// the ratio between the width and the height of the layouts obtained by
+// packing the devices in rows (the one of most screens):
+#define SHELF_ASPECT_RATIO          (4.0/3.0)
+
+// the layered placement ignores the nets with more pins than this (supplies
+// and biases, which say nothing about the signal flow); it does this number of
+// crossing reduction sweeps and of vertical alignment passes and leaves this
+// number of free cells between the columns of devices:
+#define LAYERED_MAX_NET_DEGREE      8
+#define LAYERED_SWEEPS              12
+#define LAYERED_ALIGN_PASSES        4
+#define LAYERED_COLUMN_SPACING      4
+
+// the number of iterations of the force-directed placement:
+#define FD_ITERATIONS               50
+
+// the Barnes-Hut accuracy parameter: a quadtree cell is approximated with its
+// center of mass when its size divided by its distance is below this value
+#define FD_THETA                    1.2
+
+// the strength of the repulsion between devices, relative to the attraction of
+// the nets; the legalization step takes care of the overlaps, so it can be low
+// (a layout more compact than the ideal one is cheap to legalize)
+#define FD_REPULSION                0.1
+
+// the maximum number of devices in a leaf of the quadtree:
+#define FD_LEAF_SIZE                8
+
+// the Kamada-Kawai placement stores the distances between all pairs of
+// devices: above this number of devices, force-directed placement is used
+#define KK_MAX_DEVICES              2000
+
+// the maximum number of (stress majorization) iterations of the Kamada-Kawai
+// placement and the relative decrease of the stress below which it stops:
+#define KK_MAX_ITERATIONS           300
+#define KK_TOLERANCE                1e-3
+
+// the multilevel placement coarsens the circuit until it has at most this
+// number of vertices; nets with more pins than ML_MAX_NET_DEGREE are ignored
+// while coarsening (they say little about which devices should be merged):
+#define ML_COARSEST_VERTICES        256
+#define ML_MAX_NET_DEGREE           16
+
+// the number of refinement sweeps done for the coarsest level and for each
+// one of the other levels of the multilevel placement:
+#define ML_COARSEST_SWEEPS          100
+#define ML_REFINE_SWEEPS            16
+
+// in each refinement sweep a vertex moves by this fraction of the distance
+// from the (weighted) center of its neighbours:
+#define ML_ATTRACTION               0.25
+
+// the fraction of the layout area covered by the vertices (with their margin)
+// at the end of the refinement, and the (average) number of vertices in each
+// tile of the layout: vertices of nearby tiles repel each other, tiles are
+// refined in parallel
+#define ML_MAX_DENSITY              0.6
+#define ML_TILE_VERTICES            16
+
+// the quadratic placement models the nets with more pins than this as stars
+// instead of cliques:
+#define QP_MAX_CLIQUE_DEGREE        8
+
+// the number of spreading iterations of the quadratic placement, and the weight
+// of the anchors to the spread positions (multiplied by the iteration number):
+#define QP_ITERATIONS               20
+#define QP_ANCHOR_WEIGHT            0.01
+
+// the weight which ties each device to the origin in the quadratic placement: it
+// only makes the problem well-posed when some devices are not connected
+// (even indirectly) to any external pin
+#define QP_REGULARIZATION           1e-4
+
+// the maximum number of iterations of the conjugate gradient solver and the
+// relative residual at which it stops:
+#define QP_MAX_CG_ITERATIONS        500
+#define QP_CG_TOLERANCE             1e-4
+
+// the annealing placement is used for circuits with at most this number of
+// devices (quadratic placement is used for larger ones); it starts from the
+// quadratic placement, on an area enlarged by this fraction on each side:
+#define SA_MAX_DEVICES              20000
+#define SA_AREA_MARGIN              0.1
+
+// the number of replicas of the annealing placement (one per thread, within
+// these bounds): each one runs at a different temperature
+#define SA_MIN_REPLICAS             4
+#define SA_MAX_REPLICAS             16
+
+// the number of moves tried for each device by each replica, split into this
+// number of rounds; the replicas exchange their configurations after each round
+#define SA_MOVES_PER_DEVICE         500
+#define SA_ROUNDS                   100
+
+// the ratio between the highest and the lowest temperature of the replicas and
+// the factor by which all temperatures decrease during the whole annealing:
+#define SA_TEMPERATURE_RANGE        100.0
+#define SA_COOLING_RANGE            100.0
+
+// the number of moves used to estimate the initial temperatures:
+#define SA_PROBE_MOVES              10000
+
+// the fraction of the moves which place a device next to a connected device
+// (instead of moving it randomly):
+#define SA_NEIGHBOUR_MOVES          0.3
+
+// the cost of each grid cell covered by two devices, in wirelength units:
+#define SA_OVERLAP_PENALTY          4.0
+
+// the rotation optimization ignores the nets with more pins than this when
+// looking for independent devices; it does at most this number of passes:
+#define ROTATION_MAX_NET_DEGREE     16
+#define ROTATION_PASSES             4
+
+// the crossing reduction indexes the airwires with cells of this size, groups
+// the cells in square regions of at least this many cells per side (each
+// region is improved by a single thread), tries to swap each device only with this
+// number of the devices closer than this and does at most this number of
+// rounds; each crossing costs as much as this length of airwires; devices
+// whose airwires pass through cells crossed by more than this number of
+// airwires (on average) are skipped:
+#define CROSSING_CELL_SIZE          8
+#define CROSSING_REGION_CELLS       4
+#define CROSSING_SWAP_CANDIDATES    8
+#define CROSSING_MAX_CELL_SEGMENTS  32
+#define CROSSING_SWAP_DISTANCE      8
+#define CROSSING_ROUNDS             4
+#define CROSSING_WEIGHT             8.0
+
+// the legalization spreads the dense regions of the layout until the devices
+// (with their margin) cover at most this fraction of their area, so that free
+// grid positions are always found close to the ideal ones:
+#define LEGALIZE_MAX_DENSITY        1.0
+
+// the (average) number of devices in each bin used to find the dense regions
+// of the layout, and the maximum number of spreading passes:
+#define LEGALIZE_BIN_POINTS         16
+#define LEGALIZE_SPREAD_PASSES      4
+
+// the seed for the initial random positions (placement must be deterministic):
+#define PLACEMENT_SEED              1
+
+
+// ============================================================================
+// implementation
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// svQuadTree
+// ----------------------------------------------------------------------------
+
+//! A Barnes-Hut quadtree over a set of points with unit mass.
+//! The tree is built by recursively partitioning an array of point indexes,
+//! so that the points of each cell are contiguous in that array.
+class svQuadTree
+{
+    struct Cell
+    {
+        double cx, cy;          // center of mass
+        double size;            // the side of the (square) cell
+        unsigned int mass;      // number of points
+        unsigned int first;     // index of the first point in m_points
+        int children[4];        // -1 if the child is empty or this is a leaf
+    };
+
+    const std::vector<wxRealPoint>& m_pos;
+    std::vector<unsigned int> m_points;
+    std::vector<Cell> m_cells;
+
+    // the coordinates of the points in the order of m_points, so that the
+    // points of each leaf are contiguous in memory
+    std::vector<double> m_x, m_y;
+
+    int build(unsigned int first, unsigned int last, double x0, double y0, double size, unsigned int depth)
+        {
+            int idx = m_cells.size();
+            m_cells.push_back(Cell());
+
+            Cell c;
+            c.size = size;
+            c.mass = last - first;
+            c.first = first;
+            c.cx = c.cy = 0;
+            for (unsigned int i=first; i<last; i++)
+            {
+                c.cx += m_pos[m_points[i]].x;
+                c.cy += m_pos[m_points[i]].y;
+            }
+            c.cx /= c.mass;
+            c.cy /= c.mass;
+            std::fill(c.children, c.children+4, -1);
+
+            // very deep trees happen only with (almost) coincident points:
+            // just keep them all in a single leaf
+            if (c.mass > FD_LEAF_SIZE && depth < 48)
+            {
+                double half = size/2, xm = x0 + half, ym = y0 + half;
+                std::vector<unsigned int>::iterator begin = m_points.begin() + first,
+                                                    end = m_points.begin() + last;
+                const std::vector<wxRealPoint>& pos = m_pos;
+                std::vector<unsigned int>::iterator midY =
+                    std::partition(begin, end, [&pos, ym](unsigned int p) { return pos[p].y < ym; });
+                std::vector<unsigned int>::iterator midX0 =
+                    std::partition(begin, midY, [&pos, xm](unsigned int p) { return pos[p].x < xm; });
+                std::vector<unsigned int>::iterator midX1 =
+                    std::partition(midY, end, [&pos, xm](unsigned int p) { return pos[p].x < xm; });
+
+                unsigned int bounds[5] = { first,
+                                           unsigned(midX0 - m_points.begin()),
+                                           unsigned(midY - m_points.begin()),
+                                           unsigned(midX1 - m_points.begin()),
+                                           last };
+                for (int q=0; q<4; q++)
+                    if (bounds[q] < bounds[q+1])
+                        c.children[q] = build(bounds[q], bounds[q+1],
+                                              q % 2 ? xm : x0, q < 2 ? y0 : ym, half, depth+1);
+            }
+
+            m_cells[idx] = c;
+            return idx;
+        }
+
+public:
+    svQuadTree(const std::vector<wxRealPoint>& pos)
+        : m_pos(pos)
+        {
+            if (pos.empty())
+                return;
+
+            double x0 = pos[0].x, y0 = pos[0].y, x1 = x0, y1 = y0;
+            for (size_t i=1; i<pos.size(); i++)
+            {
+                x0 = std::min(x0, pos[i].x);
+                y0 = std::min(y0, pos[i].y);
+                x1 = std::max(x1, pos[i].x);
+                y1 = std::max(y1, pos[i].y);
+            }
+
+            m_points.resize(pos.size());
+            for (size_t i=0; i<pos.size(); i++)
+                m_points[i] = i;
+
+            m_cells.reserve(2*pos.size()/FD_LEAF_SIZE + 1);
+            build(0, pos.size(), x0, y0, std::max(x1 - x0, y1 - y0) + 1e-6, 0);
+
+            m_x.resize(pos.size());
+            m_y.resize(pos.size());
+            for (size_t i=0; i<pos.size(); i++)
+            {
+                m_x[i] = pos[m_points[i]].x;
+                m_y[i] = pos[m_points[i]].y;
+            }
+        }
+
+    //! Returns the repulsive force exerted on the point @a p by all other points,
+    //! for a force equal to k2/distance.
+    wxRealPoint getRepulsion(unsigned int p, double k2) const
+        {
+            wxRealPoint f(0, 0);
+            if (m_cells.empty())
+                return f;
+
+            const double px = m_pos[p].x, py = m_pos[p].y;
+            const double theta2 = FD_THETA*FD_THETA;
+
+            int stack[4*64];
+            int top = 0;
+            stack[top++] = 0;
+            while (top > 0)
+            {
+                const Cell& c = m_cells[stack[--top]];
+                double dx = px - c.cx, dy = py - c.cy;
+                double d2 = dx*dx + dy*dy;
+
+                bool leaf = c.children[0] < 0 && c.children[1] < 0 &&
+                            c.children[2] < 0 && c.children[3] < 0;
+                if (!leaf && c.size*c.size < theta2*d2)
+                {
+                    // far enough: the whole cell acts as a single body
+                    f.x += k2*c.mass*dx/d2;
+                    f.y += k2*c.mass*dy/d2;
+                }
+                else if (leaf)
+                {
+                    for (unsigned int i=c.first; i<c.first+c.mass; i++)
+                    {
+                        unsigned int q = m_points[i];
+                        if (q == p)
+                            continue;
+
+                        dx = px - m_x[i];
+                        dy = py - m_y[i];
+                        d2 = dx*dx + dy*dy;
+                        if (d2 < 1e-9)
+                        {
+                            // coincident points: push them apart in a
+                            // deterministic direction
+                            dx = p < q ? 1e-3 : -1e-3;
+                            d2 = 1e-6;
+                        }
+                        f.x += k2*dx/d2;
+                        f.y += k2*dy/d2;
+                    }
+                }
+                else
+                {
+                    for (int q=0; q<4; q++)
+                        if (c.children[q] >= 0)
+                            stack[top++] = c.children[q];
+                }
+            }
+
+            return f;
+        }
+};
+
+// ----------------------------------------------------------------------------
+// svWeightedGraph
+// ----------------------------------------------------------------------------
+
+//! An undirected graph with weighted vertices and edges, stored in CSR format.
+//! Used by the multilevel placement to represent the coarsened circuits.
+struct svWeightedGraph
+{
+    std::vector<unsigned int> offsets;      //!< One more element than the vertices.
+    std::vector<unsigned int> adjacency;    //!< The neighbours of each vertex.
+    std::vector<float> weights;             //!< The weight of each element of adjacency.
+    std::vector<float> area;                //!< The area of each vertex, in grid cells.
+
+    size_t getVerticesCount() const
+        { return area.size(); }
+};
+
+typedef std::vector< std::pair<unsigned int, float> > svWeightedEdgeArray;
+
+//! Sorts the given edges of vertex @a v by neighbour, merges the parallel
+//! edges summing their weights and removes the self-loops.
+static void mergeEdges(unsigned int v, svWeightedEdgeArray& edges)
+{
+    std::sort(edges.begin(), edges.end());
+
+    size_t n = 0;
+    for (size_t i=0; i<edges.size(); i++)
+    {
+        if (edges[i].first == v)
+            continue;
+        if (n > 0 && edges[n-1].first == edges[i].first)
+            edges[n-1].second += edges[i].second;
+        else
+            edges[n++] = edges[i];
+    }
+    edges.resize(n);
+}
+
+//! Builds the edges of @a g, which has @a n vertices; <tt>fn(v, edges)</tt>
+//! must append to @a edges the weighted neighbours of the vertex @a v
+//! (possibly more than once). Runs in parallel over the vertices.
+template<typename F>
+static void buildAdjacency(svWeightedGraph& g, size_t n, F fn)
+{
+    // first pass: count the neighbours of each vertex
+    g.offsets.assign(n+1, 0);
+    svParallelFor(n,
+        [&](size_t begin, size_t end, unsigned int) {
+            svWeightedEdgeArray edges;
+            for (size_t v=begin; v<end; v++)
+            {
+                edges.clear();
+                fn(v, edges);
+                mergeEdges(v, edges);
+                g.offsets[v+1] = edges.size();
+            }
+        });
+
+    for (size_t v=0; v<n; v++)
+        g.offsets[v+1] += g.offsets[v];
+
+    // second pass: store them
+    g.adjacency.resize(g.offsets[n]);
+    g.weights.resize(g.offsets[n]);
+    svParallelFor(n,
+        [&](size_t begin, size_t end, unsigned int) {
+            svWeightedEdgeArray edges;
+            for (size_t v=begin; v<end; v++)
+            {
+                edges.clear();
+                fn(v, edges);
+                mergeEdges(v, edges);
+                for (size_t i=0; i<edges.size(); i++)
+                {
+                    g.adjacency[g.offsets[v] + i] = edges[i].first;
+                    g.weights[g.offsets[v] + i] = edges[i].second;
+                }
+            }
+        });
+}
+
+//! Coarsens @a fine by heavy-edge matching: each vertex is merged with the
+//! unmatched neighbour it's most strongly connected to. Fills @a coarseOf with
+//! the coarse vertex of each fine vertex and returns the coarse graph.
+static svWeightedGraph coarsenGraph(const svWeightedGraph& fine, std::vector<unsigned int>& coarseOf,
+                                    std::mt19937& rng)
+{
+    size_t n = fine.getVerticesCount();
+
+    // visit the vertices in random order, to avoid the bias of the netlist order
+    std::vector<unsigned int> order(n);
+    for (size_t v=0; v<n; v++)
+        order[v] = v;
+    std::shuffle(order.begin(), order.end(), rng);
+
+    const unsigned int unmatched = UINT_MAX;
+    std::vector<unsigned int> mate(n, unmatched);
+    for (size_t i=0; i<n; i++)
+    {
+        unsigned int v = order[i];
+        if (mate[v] != unmatched)
+            continue;
+
+        unsigned int best = v;
+        float bestWeight = 0;
+        for (unsigned int e=fine.offsets[v]; e<fine.offsets[v+1]; e++)
+        {
+            unsigned int u = fine.adjacency[e];
+            if (mate[u] == unmatched && fine.weights[e] > bestWeight)
+            {
+                best = u;
+                bestWeight = fine.weights[e];
+            }
+        }
+
+        mate[v] = best;
+        mate[best] = v;
+    }
+
+    // number the coarse vertices in the order of their first fine vertex
+    svWeightedGraph coarse;
+    std::vector<unsigned int> members;      // the fine vertices of each coarse vertex, in pairs
+    coarseOf.assign(n, unmatched);
+    for (size_t v=0; v<n; v++)
+    {
+        if (coarseOf[v] != unmatched)
+            continue;
+
+        coarseOf[v] = coarseOf[mate[v]] = coarse.area.size();
+        coarse.area.push_back(fine.area[v] + (mate[v] != v ? fine.area[mate[v]] : 0));
+        members.push_back(v);
+        members.push_back(mate[v]);
+    }
+
+    buildAdjacency(coarse, coarse.area.size(),
+        [&](unsigned int c, svWeightedEdgeArray& edges) {
+            for (int m=0; m<2; m++)
+            {
+                unsigned int v = members[2*c + m];
+                for (unsigned int e=fine.offsets[v]; e<fine.offsets[v+1]; e++)
+                    edges.push_back(std::make_pair(coarseOf[fine.adjacency[e]], fine.weights[e]));
+
+                if (members[2*c + 1] == v)
+                    break;      // not matched
+            }
+        });
+
+    return coarse;
+}
+
+//! Improves the layout @a pos of the vertices of @a g: each vertex is moved
+//! towards the (weighted) center of its neighbours, and pushed away from the
+//! vertices it overlaps with.
+//! The layout is split in tiles, colored like a checkerboard with 4 colors:
+//! the tiles of the same color are not adjacent and are refined in parallel.
+//! Overlaps are searched only in the 3x3 tiles around each vertex.
+//! The given function is called after each sweep: the refinement stops when
+//! it returns false.
+template<typename F>
+static void refineLayout(const svWeightedGraph& g, std::vector<wxRealPoint>& pos, unsigned int sweeps,
+                         F afterSweep)
+{
+    size_t n = g.getVerticesCount();
+    if (n == 0)
+        return;
+
+    // the diameter each vertex should occupy
+    std::vector<double> diameter(n);
+    double maxDiameter = 0, totalArea = 0;
+    for (size_t v=0; v<n; v++)
+    {
+        diameter[v] = sqrt(g.area[v]/ML_MAX_DENSITY);
+        maxDiameter = std::max(maxDiameter, diameter[v]);
+        totalArea += g.area[v]/ML_MAX_DENSITY;
+    }
+
+    std::vector<unsigned int> tileOf(n), tileOffsets, tileVertices(n);
+    std::vector<wxRealPoint> snapshot;
+    for (unsigned int sweep=0; sweep<sweeps; sweep++)
+    {
+        wxRealPoint tl = pos[0], br = pos[0];
+        for (size_t v=1; v<n; v++)
+        {
+            tl.x = std::min(tl.x, pos[v].x);
+            tl.y = std::min(tl.y, pos[v].y);
+            br.x = std::max(br.x, pos[v].x);
+            br.y = std::max(br.y, pos[v].y);
+        }
+
+        // the attraction of the nets shrinks the layout: spread it so that
+        // vertices have the room they need (overlaps are then solved locally)
+        double layoutArea = (br.x - tl.x + maxDiameter)*(br.y - tl.y + maxDiameter);
+        if (layoutArea < totalArea)
+        {
+            double scale = sqrt(totalArea/layoutArea);
+            wxRealPoint center = (tl + br)/2.0;
+            for (size_t v=0; v<n; v++)
+                pos[v] = center + (pos[v] - center)*scale;
+            tl = center + (tl - center)*scale;
+            br = center + (br - center)*scale;
+        }
+
+        // assign the vertices to the tiles
+        double side = std::max(maxDiameter, sqrt((br.x - tl.x)*(br.y - tl.y)*ML_TILE_VERTICES/n));
+        unsigned int nx = (unsigned int)((br.x - tl.x)/side) + 1,
+                     ny = (unsigned int)((br.y - tl.y)/side) + 1;
+
+        tileOffsets.assign(nx*ny + 1, 0);
+        for (size_t v=0; v<n; v++)
+        {
+            unsigned int tx = std::min(nx-1, (unsigned int)((pos[v].x - tl.x)/side)),
+                         ty = std::min(ny-1, (unsigned int)((pos[v].y - tl.y)/side));
+            tileOf[v] = ty*nx + tx;
+            tileOffsets[tileOf[v] + 1]++;
+        }
+        for (size_t t=0; t<nx*ny; t++)
+            tileOffsets[t+1] += tileOffsets[t];
+        std::vector<unsigned int> fill(tileOffsets.begin(), tileOffsets.end()-1);
+        for (size_t v=0; v<n; v++)
+            tileVertices[fill[tileOf[v]]++] = v;
+
+        for (unsigned int color=0; color<4; color++)
+        {
+            // vertices of other tiles are read from a snapshot, so that each
+            // thread writes only the vertices of its own tiles
+            snapshot = pos;
+
+            std::vector<unsigned int> tiles;
+            for (unsigned int ty=color/2; ty<ny; ty+=2)
+                for (unsigned int tx=color%2; tx<nx; tx+=2)
+                    tiles.push_back(ty*nx + tx);
+
+            svParallelFor(tiles.size(),
+                [&](size_t begin, size_t end, unsigned int) {
+                    for (size_t i=begin; i<end; i++)
+                    {
+                        unsigned int t = tiles[i], tx = t % nx, ty = t / nx;
+                        for (unsigned int k=tileOffsets[t]; k<tileOffsets[t+1]; k++)
+                        {
+                            unsigned int v = tileVertices[k];
+
+                            // move towards the center of the neighbours...
+                            wxRealPoint center(0, 0), p = pos[v];
+                            double sw = 0;
+                            for (unsigned int e=g.offsets[v]; e<g.offsets[v+1]; e++)
+                            {
+                                unsigned int u = g.adjacency[e];
+                                center += (tileOf[u] == t ? pos[u] : snapshot[u])*g.weights[e];
+                                sw += g.weights[e];
+                            }
+                            if (sw > 0)
+                                p += (center/sw - p)*ML_ATTRACTION;
+
+                            // ...but away from the overlapping vertices
+                            for (unsigned int y=(ty > 0 ? ty-1 : 0); y<=std::min(ty+1, ny-1); y++)
+                                for (unsigned int x=(tx > 0 ? tx-1 : 0); x<=std::min(tx+1, nx-1); x++)
+                                {
+                                    unsigned int other = y*nx + x;
+                                    for (unsigned int h=tileOffsets[other]; h<tileOffsets[other+1]; h++)
+                                    {
+                                        unsigned int u = tileVertices[h];
+                                        if (u == v)
+                                            continue;
+
+                                        const wxRealPoint& q = other == t ? pos[u] : snapshot[u];
+                                        double dx = p.x - q.x, dy = p.y - q.y;
+                                        double d = sqrt(dx*dx + dy*dy), r = (diameter[u] + diameter[v])/2;
+                                        if (d >= r)
+                                            continue;
+                                        if (d < 1e-6)
+                                        {
+                                            // coincident vertices: split them in a deterministic direction
+                                            dx = v < u ? 1 : -1;
+                                            dy = 0;
+                                            d = 1;
+                                        }
+                                        p.x += dx/d*(r - d)/2;
+                                        p.y += dy/d*(r - d)/2;
+                                    }
+                                }
+
+                            pos[v] = p;
+                        }
+                    }
+                }, 0, 1 /* each tile is a good amount of work */);
+        }
+
+        if (!afterSweep())
+            break;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// layout spreading
+// ----------------------------------------------------------------------------
+
+//! Spreads the dense regions of a layout (where the total area of the points,
+//! with the given areas, is above LEGALIZE_MAX_DENSITY times the area of the region)
+//! so that the legalization always finds free grid positions close to the ideal ones.
+//! The layout is divided in bins; each pass widens the over-full bins of each row
+//! and heightens the over-full bins of each column, and distributes their points
+//! by rank (so that even coincident points get separated). The sparse regions
+//! are never shrunk, so the relative positions are kept.
+static void spreadLayout(std::vector<wxRealPoint>& pos, const std::vector<double>& area)
+{
+    size_t n = pos.size();
+    if (n == 0)
+        return;
+
+    // a layout too dense as a whole is first scaled uniformly around its center,
+    // so that the passes below only need to fix the local densities
+    wxRealPoint tl = pos[0], br = pos[0];
+    double totalArea = 0;
+    for (size_t i=0; i<n; i++)
+    {
+        tl.x = std::min(tl.x, pos[i].x);
+        tl.y = std::min(tl.y, pos[i].y);
+        br.x = std::max(br.x, pos[i].x);
+        br.y = std::max(br.y, pos[i].y);
+        totalArea += area[i];
+    }
+
+    double layoutArea = (br.x - tl.x + 1)*(br.y - tl.y + 1);
+    if (totalArea > LEGALIZE_MAX_DENSITY*layoutArea)
+    {
+        double scale = sqrt(totalArea/(LEGALIZE_MAX_DENSITY*layoutArea));
+        wxRealPoint center = (tl + br)/2.0;
+        for (size_t i=0; i<n; i++)
+            pos[i] = center + (pos[i] - center)*scale;
+    }
+
+    auto coord = [](wxRealPoint& p, unsigned int dir) -> double& { return dir == 0 ? p.x : p.y; };
+    std::vector<unsigned int> binOffsets, binPoints(n), binOf(n);
+    std::vector<wxRealPoint> spread;
+    for (unsigned int pass=0; pass<LEGALIZE_SPREAD_PASSES; pass++)
+    {
+        tl = br = pos[0];
+        for (size_t i=0; i<n; i++)
+        {
+            tl.x = std::min(tl.x, pos[i].x);
+            tl.y = std::min(tl.y, pos[i].y);
+            br.x = std::max(br.x, pos[i].x);
+            br.y = std::max(br.y, pos[i].y);
+        }
+
+        double side = std::max(1.0, sqrt((br.x - tl.x + 1)*(br.y - tl.y + 1)*LEGALIZE_BIN_POINTS/n));
+        size_t nx = size_t((br.x - tl.x)/side) + 1, ny = size_t((br.y - tl.y)/side) + 1;
+        std::vector<double> binArea(nx*ny, 0);
+        binOffsets.assign(binArea.size() + 1, 0);
+        for (size_t i=0; i<n; i++)
+        {
+            size_t bx = std::min(nx - 1, size_t((pos[i].x - tl.x)/side));
+            size_t by = std::min(ny - 1, size_t((pos[i].y - tl.y)/side));
+            binOf[i] = by*nx + bx;
+            binArea[binOf[i]] += area[i];
+            binOffsets[binOf[i] + 1]++;
+        }
+        for (size_t bin=0; bin<binArea.size(); bin++)
+            binOffsets[bin+1] += binOffsets[bin];
+        std::vector<unsigned int> fill(binOffsets.begin(), binOffsets.end()-1);
+        for (size_t i=0; i<n; i++)
+            binPoints[fill[binOf[i]]++] = i;
+
+        double capacity = LEGALIZE_MAX_DENSITY*side*side;
+        if (*std::max_element(binArea.begin(), binArea.end()) <= capacity)
+            break;
+
+        // both directions are computed from the same bins, so that the layout
+        // is spread in the same way along x and y: since each one removes the
+        // square root of the excess density of a bin, together they remove it all
+        spread = pos;
+        for (unsigned int dir=0; dir<2; dir++)
+        {
+            size_t nAlong = dir == 0 ? nx : ny, nLines = dir == 0 ? ny : nx;
+            double origin = dir == 0 ? tl.x : tl.y;
+            for (size_t line=0; line<nLines; line++)
+            {
+                // the new extent of each bin of this line
+                std::vector<double> binStart(nAlong), binWidth(nAlong);
+                double lineWidth = 0;
+                for (size_t k=0; k<nAlong; k++)
+                {
+                    size_t bin = dir == 0 ? line*nx + k : k*nx + line;
+                    binStart[k] = lineWidth;
+                    binWidth[k] = side*std::max(1.0, sqrt(binArea[bin]/capacity));
+                    lineWidth += binWidth[k];
+                }
+
+                // keep the center of the line where it was
+                double offset = origin + (nAlong*side - lineWidth)/2;
+                for (size_t k=0; k<nAlong; k++)
+                {
+                    size_t bin = dir == 0 ? line*nx + k : k*nx + line;
+                    unsigned int* first = &binPoints[0] + binOffsets[bin];
+                    unsigned int* last = &binPoints[0] + binOffsets[bin+1];
+                    if (binArea[bin] <= capacity)
+                    {
+                        // move the points together with their bin
+                        for (unsigned int* i = first; i != last; i++)
+                            coord(spread[*i], dir) = offset + binStart[k] + coord(pos[*i], dir) - origin - k*side;
+                        continue;
+                    }
+
+                    std::sort(first, last,
+                              [&](unsigned int i, unsigned int j) {
+                                  return coord(pos[i], dir) < coord(pos[j], dir) ||
+                                         (coord(pos[i], dir) == coord(pos[j], dir) && i < j);
+                              });
+
+                    double cumulated = 0;
+                    for (unsigned int* i = first; i != last; i++)
+                    {
+                        coord(spread[*i], dir) = offset + binStart[k] + (cumulated + area[*i]/2)/binArea[bin]*binWidth[k];
+                        cumulated += area[*i];
+                    }
+                }
+            }
+        }
+
+        pos.swap(spread);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// svSparseMatrix
+// ----------------------------------------------------------------------------
+
+//! Returns the sum of the values returned by <tt>fn(begin, end)</tt> for the
+//! chunks of [0, n), which are processed in parallel. The partial sums are added
+//! in a fixed order, so the result depends only on the number of threads.
+template<typename F>
+static double parallelSum(size_t n, F fn)
+{
+    unsigned int nThreads = svGetThreadsCount();
+    std::vector<double> partial(nThreads, 0);
+    svParallelFor(n,
+        [&](size_t begin, size_t end, unsigned int threadIdx) {
+            partial[threadIdx] = fn(begin, end);
+        }, nThreads);
+
+    double sum = 0;
+    for (unsigned int t=0; t<nThreads; t++)
+        sum += partial[t];
+    return sum;
+}
+
+//! A symmetric, positive definite sparse matrix: the diagonal is stored apart
+//! from the other elements, which are stored by rows (CSR format).
+class svSparseMatrix
+{
+public:
+    std::vector<unsigned int> offsets;      //!< One more element than the rows.
+    std::vector<unsigned int> columns;      //!< The column of each element.
+    std::vector<double> values;             //!< The off-diagonal elements.
+    std::vector<double> diagonal;           //!< The diagonal elements.
+
+    size_t getRowsCount() const
+        { return diagonal.size(); }
+
+    //! Solves <tt>A*x = b</tt> with the conjugate gradient method, preconditioned
+    //! with the diagonal (Jacobi). @a x must contain the initial guess.
+    //! Stops when the (preconditioned) residual is @a tolerance times smaller than
+    //! @a b or after @a maxIterations iterations; returns the iterations done.
+    unsigned int solve(const std::vector<double>& b, std::vector<double>& x,
+                       unsigned int maxIterations, double tolerance) const
+    {
+        size_t n = getRowsCount();
+        std::vector<double> r(n), z(n), p(n), ap(n);
+
+        double bz = parallelSum(n,
+            [&](size_t begin, size_t end) {
+                double sum = 0;
+                for (size_t i=begin; i<end; i++)
+                    sum += b[i]*b[i]/diagonal[i];
+                return sum;
+            });
+        if (bz == 0)
+        {
+            x.assign(n, 0);
+            return 0;
+        }
+
+        double rz = parallelSum(n,
+            [&](size_t begin, size_t end) {
+                double sum = 0;
+                for (size_t i=begin; i<end; i++)
+                {
+                    r[i] = b[i] - multiplyRow(i, x);
+                    z[i] = r[i]/diagonal[i];
+                    p[i] = z[i];
+                    sum += r[i]*z[i];
+                }
+                return sum;
+            });
+
+        for (unsigned int it=0; it<maxIterations; it++)
+        {
+            if (rz <= tolerance*tolerance*bz)
+                return it;
+
+            double pap = parallelSum(n,
+                [&](size_t begin, size_t end) {
+                    double sum = 0;
+                    for (size_t i=begin; i<end; i++)
+                    {
+                        ap[i] = multiplyRow(i, p);
+                        sum += p[i]*ap[i];
+                    }
+                    return sum;
+                });
+
+            double alpha = rz/pap;
+            double rzNew = parallelSum(n,
+                [&](size_t begin, size_t end) {
+                    double sum = 0;
+                    for (size_t i=begin; i<end; i++)
+                    {
+                        x[i] += alpha*p[i];
+                        r[i] -= alpha*ap[i];
+                        z[i] = r[i]/diagonal[i];
+                        sum += r[i]*z[i];
+                    }
+                    return sum;
+                });
+
+            double beta = rzNew/rz;
+            rz = rzNew;
+            svParallelFor(n,
+                [&](size_t begin, size_t end, unsigned int) {
+                    for (size_t i=begin; i<end; i++)
+                        p[i] = z[i] + beta*p[i];
+                });
+        }
+
+        return maxIterations;
+    }
+
+private:
+    double multiplyRow(size_t i, const std::vector<double>& x) const
+    {
+        double sum = diagonal[i]*x[i];
+        for (unsigned int k=offsets[i]; k<offsets[i+1]; k++)
+            sum += values[k]*x[columns[k]];
+        return sum;
+    }
+};
+
+// ----------------------------------------------------------------------------
+// svAnnealer
+// ----------------------------------------------------------------------------
+
+//! One replica of the annealing placement: the positions of the devices, how
+//! many devices cover each cell of the layout area and the wirelength of each
+//! net, so that a move can be scored looking only at the moved device.
+struct svAnnealingState
+{
+    std::vector<wxPoint> positions;
+    std::vector<unsigned short> coverage;
+    std::vector<int> netLength;
+    long wirelength;
+    long overlaps;              //!< The cells covered by more than one device.
+
+    double getCost() const
+        { return wirelength + SA_OVERLAP_PENALTY*overlaps; }
+};
+
+//! Simulated annealing of the device positions on a fixed area of the grid.
+//! The footprint of each device is its bounding box, enlarged by one cell to
+//! the right and to the bottom: footprints which do not overlap leave at least
+//! one free cell between the devices. The cost of a placement is its
+//! (half-perimeter) wirelength plus a penalty for each cell covered twice.
+//! This class holds only the data shared by all replicas, so that different
+//! threads can move the devices of different replicas at the same time.
+class svAnnealer
+{
+    wxRect m_area;                              //!< The area where the devices are placed.
+    std::vector<wxRect> m_footprints;           //!< Relative to the device positions.
+    std::vector<unsigned int> m_netOffsets;     //!< One more element than the nets.
+    std::vector<unsigned int> m_netDevices;     //!< The device of each pin of each net.
+    std::vector<wxPoint> m_netPinOffsets;       //!< The position of each pin relative to its device.
+    std::vector<unsigned int> m_deviceOffsets;  //!< One more element than the devices.
+    std::vector<unsigned int> m_deviceNets;     //!< The (distinct) nets of each device.
+
+public:
+    svAnnealer(const svBaseDeviceArray& devices, const svHyperGraph& hg, const wxRect& area)
+        : m_area(area)
+    {
+        for (size_t i=0; i<devices.size(); i++)
+        {
+            wxRect bb = devices[i]->getRelativeBoundingBox();
+            m_footprints.push_back(wxRect(bb.x, bb.y, bb.width + 1, bb.height + 1));
+        }
+
+        // only the nets which contribute to the wirelength are stored
+        std::vector< std::vector<unsigned int> > netsOf(devices.size());
+        m_netOffsets.push_back(0);
+        for (size_t net=0; net<hg.getNetsCount(); net++)
+        {
+            if (hg.isIgnoredNet(net) || hg.getNetDegree(net) < 2)
+                continue;
+
+            for (unsigned int k=0; k<hg.getNetDegree(net); k++)
+            {
+                svPinRef pin = hg.getNetPin(net, k);
+                m_netDevices.push_back(pin.device);
+                m_netPinOffsets.push_back(devices[pin.device]->getRelativeGridNodePosition(pin.pin));
+                if (netsOf[pin.device].empty() || netsOf[pin.device].back() != m_netOffsets.size() - 1)
+                    netsOf[pin.device].push_back(m_netOffsets.size() - 1);
+            }
+            m_netOffsets.push_back(m_netDevices.size());
+        }
+
+        m_deviceOffsets.push_back(0);
+        for (size_t i=0; i<devices.size(); i++)
+        {
+            m_deviceNets.insert(m_deviceNets.end(), netsOf[i].begin(), netsOf[i].end());
+            m_deviceOffsets.push_back(m_deviceNets.size());
+        }
+    }
+
+    size_t getDevicesCount() const
+        { return m_footprints.size(); }
+
+    //! Initializes @a state with the given positions.
+    void init(svAnnealingState& state, const std::vector<wxPoint>& positions) const
+    {
+        state.positions = positions;
+        state.coverage.assign(m_area.width*m_area.height, 0);
+        state.overlaps = 0;
+        for (size_t i=0; i<positions.size(); i++)
+            state.overlaps += cover(state, i, 1);
+
+        state.netLength.resize(m_netOffsets.size() - 1);
+        state.wirelength = 0;
+        for (size_t net=0; net<state.netLength.size(); net++)
+        {
+            state.netLength[net] = getNetLength(state, net);
+            state.wirelength += state.netLength[net];
+        }
+    }
+
+    //! Proposes a random move of a random device of @a state and accepts it with
+    //! the Metropolis criterion at the given temperature. The devices are moved
+    //! at most @a window cells away, or next to a device they are connected to.
+    //! Returns the change of the cost.
+    double move(svAnnealingState& state, double temperature, int window, std::mt19937& rng) const
+    {
+        std::uniform_int_distribution<unsigned int> anyDevice(0, getDevicesCount() - 1);
+        std::uniform_real_distribution<double> probability(0, 1);
+        unsigned int dev = anyDevice(rng);
+        wxPoint oldPos = state.positions[dev], newPos;
+
+        unsigned int nNets = m_deviceOffsets[dev+1] - m_deviceOffsets[dev];
+        if (nNets > 0 && probability(rng) < SA_NEIGHBOUR_MOVES)
+        {
+            unsigned int net = m_deviceNets[m_deviceOffsets[dev] + rng() % nNets];
+            unsigned int pin = m_netOffsets[net] + rng() % (m_netOffsets[net+1] - m_netOffsets[net]);
+            std::uniform_int_distribution<int> offset(-int(IDEAL_DEVICE_DISTANCE), int(IDEAL_DEVICE_DISTANCE));
+            newPos = state.positions[m_netDevices[pin]] + wxPoint(offset(rng), offset(rng));
+        }
+        else
+        {
+            std::uniform_int_distribution<int> offset(-window, window);
+            newPos = oldPos + wxPoint(offset(rng), offset(rng));
+        }
+
+        // keep the footprint inside the area
+        const wxRect& fp = m_footprints[dev];
+        newPos.x = std::max(m_area.GetLeft() - fp.GetLeft(), std::min(m_area.GetRight() - fp.GetRight(), newPos.x));
+        newPos.y = std::max(m_area.GetTop() - fp.GetTop(), std::min(m_area.GetBottom() - fp.GetBottom(), newPos.y));
+        if (newPos == oldPos)
+            return 0;
+
+        long overlapsDelta = cover(state, dev, -1);
+        state.positions[dev] = newPos;
+        overlapsDelta += cover(state, dev, 1);
+
+        long lengthDelta = 0;
+        for (unsigned int k=m_deviceOffsets[dev]; k<m_deviceOffsets[dev+1]; k++)
+        {
+            unsigned int net = m_deviceNets[k];
+            lengthDelta += getNetLength(state, net) - state.netLength[net];
+        }
+
+        double delta = lengthDelta + SA_OVERLAP_PENALTY*overlapsDelta;
+        if (delta > 0 && probability(rng) >= exp(-delta/temperature))
+        {
+            // rejected: undo the move
+            cover(state, dev, -1);
+            state.positions[dev] = oldPos;
+            cover(state, dev, 1);
+            return 0;
+        }
+
+        for (unsigned int k=m_deviceOffsets[dev]; k<m_deviceOffsets[dev+1]; k++)
+        {
+            unsigned int net = m_deviceNets[k];
+            state.netLength[net] = getNetLength(state, net);
+        }
+        state.wirelength += lengthDelta;
+        state.overlaps += overlapsDelta;
+        return delta;
+    }
+
+private:
+    //! Adds @a sign to the coverage of the footprint of @a dev; returns the
+    //! change of the number of cells covered more than once.
+    long cover(svAnnealingState& state, unsigned int dev, int sign) const
+    {
+        wxRect fp = m_footprints[dev];
+        fp.Offset(state.positions[dev] - m_area.GetTopLeft());
+
+        long delta = 0;
+        for (int y=fp.GetTop(); y<=fp.GetBottom(); y++)
+        {
+            unsigned short* cell = &state.coverage[y*m_area.width + fp.GetLeft()];
+            for (int x=0; x<fp.width; x++, cell++)
+            {
+                if (sign > 0)
+                    delta += (*cell)++ > 0;
+                else
+                    delta -= --(*cell) > 0;
+            }
+        }
+        return delta;
+    }
+
+    int getNetLength(const svAnnealingState& state, unsigned int net) const
+    {
+        wxPoint tl(INT_MAX, INT_MAX), br(INT_MIN, INT_MIN);
+        for (unsigned int k=m_netOffsets[net]; k<m_netOffsets[net+1]; k++)
+        {
+            wxPoint pt = state.positions[m_netDevices[k]] + m_netPinOffsets[k];
+            tl.x = std::min(tl.x, pt.x);
+            tl.y = std::min(tl.y, pt.y);
+            br.x = std::max(br.x, pt.x);
+            br.y = std::max(br.y, pt.y);
+        }
+        return (br.x - tl.x) + (br.y - tl.y);
+    }
+};
+
+// ----------------------------------------------------------------------------
+// svAirwireIndex
+// ----------------------------------------------------------------------------
+
+//! The airwires of a circuit, indexed by a uniform grid of cells so that their
+//! crossings can be counted without testing all the pairs of segments.
+//! Each net is approximated by a rectilinear minimum spanning tree of its pins
+//! (svCircuit::draw() shows a slightly shorter Steiner tree), rooted in its
+//! first pin: the segment which joins the k-th pin of a net (k > 0) to its
+//! parent is identified by the index of that pin in the net order of
+//! svHyperGraph. The trees are computed when the index is built: moving the
+//! pins later changes the segments, not the trees.
+class svAirwireIndex
+{
+    const svCircuit& m_circuit;
+    const svHyperGraph& m_hg;
+
+    wxRect m_area;
+    int m_cols, m_rows;
+
+    std::vector<wxPoint> m_from, m_to;      // the ends of each segment
+    std::vector<unsigned int> m_net;        // the net of each segment
+    std::vector<unsigned int> m_parent;     // the pin where each segment starts
+    std::vector<unsigned int> m_childOffsets, m_children;   // the segments starting in each pin
+    std::vector<bool> m_valid;              // false for the first pin of each net
+    std::vector< std::vector<unsigned int> > m_cells;
+
+    static long long orientation(const wxPoint& a, const wxPoint& b, const wxPoint& c)
+        { return (long long)(b.x - a.x)*(c.y - a.y) - (long long)(b.y - a.y)*(c.x - a.x); }
+
+public:
+    svAirwireIndex(const svCircuit& ckt, const wxRect& area)
+        : m_circuit(ckt), m_hg(ckt.getHyperGraph()), m_area(area)
+    {
+        m_cols = (area.width + CROSSING_CELL_SIZE - 1)/CROSSING_CELL_SIZE + 1;
+        m_rows = (area.height + CROSSING_CELL_SIZE - 1)/CROSSING_CELL_SIZE + 1;
+        m_cells.resize(size_t(m_cols)*m_rows);
+
+        size_t nPins = m_hg.getPinsCount();
+        m_from.resize(nPins, svInvalidPoint);
+        m_to.resize(nPins, svInvalidPoint);
+        m_net.resize(nPins);
+        m_parent.resize(nPins, UINT_MAX);
+        m_valid.resize(nPins, false);
+
+        // the trees of the nets are independent: compute them in parallel
+        svParallelFor(m_hg.getNetsCount(),
+            [this](size_t begin, size_t end, unsigned int) {
+                std::vector<wxPoint> pins;
+                std::vector<unsigned int> parent;
+                for (size_t net=begin; net<end; net++)
+                {
+                    size_t first = getFirstSegment(net);
+                    if (m_hg.isIgnoredNet(net) || m_hg.getNetDegree(net) < 2)
+                        continue;
+
+                    pins.clear();
+                    for (unsigned int k=0; k<m_hg.getNetDegree(net); k++)
+                        pins.push_back(m_circuit.getPinPosition(m_hg.getNetPin(net, k)));
+                    svGetRectilinearMST(pins, parent);
+                    for (unsigned int k=1; k<m_hg.getNetDegree(net); k++)
+                        m_parent[first + k] = first + parent[k];
+                }
+            }, 0, 64);
+
+        m_childOffsets.assign(nPins + 1, 0);
+        for (size_t s=0; s<nPins; s++)
+            if (m_parent[s] != UINT_MAX)
+                m_childOffsets[m_parent[s] + 1]++;
+        for (size_t s=0; s<nPins; s++)
+            m_childOffsets[s + 1] += m_childOffsets[s];
+        m_children.resize(m_childOffsets[nPins]);
+        std::vector<unsigned int> next(m_childOffsets.begin(), m_childOffsets.end() - 1);
+        for (size_t s=0; s<nPins; s++)
+            if (m_parent[s] != UINT_MAX)
+                m_children[next[m_parent[s]]++] = s;
+
+        for (unsigned int net=0; net<m_hg.getNetsCount(); net++)
+        {
+            size_t first = getFirstSegment(net);
+            for (unsigned int k=0; k<m_hg.getNetDegree(net); k++)
+            {
+                m_net[first + k] = net;
+                if (m_parent[first + k] != UINT_MAX)
+                {
+                    m_valid[first + k] = true;
+                    update(first + k);
+                }
+            }
+        }
+    }
+
+    //! Returns the index of the first pin of the given net (which does not
+    //! end any segment).
+    size_t getFirstSegment(unsigned int net) const
+        { return m_hg.getNetDevicesBegin(net) - m_hg.getNetDevicesBegin(0); }
+
+    bool isValid(size_t s) const
+        { return m_valid[s]; }
+
+    //! Calls fn(s) for each segment ending in the given pin (in the net order).
+    template<typename F>
+    void forEachSegmentOf(size_t pin, F fn) const
+    {
+        if (m_valid[pin])
+            fn(pin);
+        for (unsigned int k=m_childOffsets[pin]; k<m_childOffsets[pin + 1]; k++)
+            fn(m_children[k]);
+    }
+    unsigned int getNet(size_t s) const
+        { return m_net[s]; }
+    double getLength(size_t s) const
+        { return sqrt(double(m_to[s].x - m_from[s].x)*(m_to[s].x - m_from[s].x) +
+                      double(m_to[s].y - m_from[s].y)*(m_to[s].y - m_from[s].y)); }
+
+    int getCellColumn(double x) const
+        { return std::min(std::max(int(floor((x - m_area.x)/CROSSING_CELL_SIZE)), 0), m_cols - 1); }
+    int getCellRow(double y) const
+        { return std::min(std::max(int(floor((y - m_area.y)/CROSSING_CELL_SIZE)), 0), m_rows - 1); }
+
+    //! Returns the index of the cell containing the given point.
+    size_t getCellIndex(const wxPoint& pt) const
+        { return size_t(getCellRow(pt.y))*m_cols + getCellColumn(pt.x); }
+
+    //! Returns the range of cells covered by the bounding box of the given segment.
+    wxRect getCellRange(size_t s) const
+    {
+        int c0 = getCellColumn(std::min(m_from[s].x, m_to[s].x)), c1 = getCellColumn(std::max(m_from[s].x, m_to[s].x));
+        int r0 = getCellRow(std::min(m_from[s].y, m_to[s].y)), r1 = getCellRow(std::max(m_from[s].y, m_to[s].y));
+        return wxRect(wxPoint(c0, r0), wxPoint(c1, r1));
+    }
+
+    //! Calls fn(cell) for each cell crossed by the given segment: for each
+    //! column of cells, only the rows spanned by the segment are visited.
+    template<typename F>
+    void forEachCell(size_t s, F fn) const
+    {
+        const wxPoint& a = m_from[s];
+        const wxPoint& b = m_to[s];
+        int c0 = getCellColumn(std::min(a.x, b.x)), c1 = getCellColumn(std::max(a.x, b.x));
+        for (int c=c0; c<=c1; c++)
+        {
+            double y0 = a.y, y1 = b.y;
+            if (a.x != b.x)
+            {
+                double x0 = std::max<double>(std::min(a.x, b.x), m_area.x + c*CROSSING_CELL_SIZE);
+                double x1 = std::min<double>(std::max(a.x, b.x), m_area.x + (c + 1)*CROSSING_CELL_SIZE);
+                y0 = a.y + (x0 - a.x)*(b.y - a.y)/(b.x - a.x);
+                y1 = a.y + (x1 - a.x)*(b.y - a.y)/(b.x - a.x);
+            }
+
+            int r1 = getCellRow(std::max(y0, y1));
+            for (int r=getCellRow(std::min(y0, y1)); r<=r1; r++)
+                fn(size_t(r)*m_cols + c);
+        }
+    }
+
+    //! Returns the segments passing through the given cell.
+    const std::vector<unsigned int>& getCell(size_t cell) const
+        { return m_cells[cell]; }
+    size_t getCellsCount() const
+        { return m_cells.size(); }
+
+    //! Recomputes the ends of the given segment from the current positions of
+    //! its pins and moves it to the cells it crosses now.
+    void update(size_t s)
+    {
+        if (!m_valid[s])
+            return;
+
+        if (m_from[s] != svInvalidPoint)
+            forEachCell(s, [this, s](size_t cell) {
+                std::vector<unsigned int>& v = m_cells[cell];
+                v.erase(std::find(v.begin(), v.end(), s));
+            });
+
+        size_t first = getFirstSegment(m_net[s]);
+        m_from[s] = m_circuit.getPinPosition(m_hg.getNetPin(m_net[s], m_parent[s] - first));
+        m_to[s] = m_circuit.getPinPosition(m_hg.getNetPin(m_net[s], s - first));
+        forEachCell(s, [this, s](size_t cell) { m_cells[cell].push_back(s); });
+    }
+
+    //! Returns true if the two segments cross (touching ends don't count)
+    //! and the crossing point is inside the given cell: each crossing is thus
+    //! counted only once, even if the two segments share several cells.
+    bool crosses(size_t s, size_t t, size_t cell) const
+    {
+        const wxPoint &a = m_from[s], &b = m_to[s], &c = m_from[t], &d = m_to[t];
+        long long d1 = orientation(c, d, a), d2 = orientation(c, d, b);
+        long long d3 = orientation(a, b, c), d4 = orientation(a, b, d);
+        if (!(((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) &&
+              ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0))))
+            return false;
+
+        double f = double(d1)/double(d1 - d2);
+        double x = a.x + f*(b.x - a.x), y = a.y + f*(b.y - a.y);
+        return size_t(getCellRow(y))*m_cols + getCellColumn(x) == cell;
+    }
+
+    //! Returns the number of crossings between segments of different nets.
+    //! The segments of each cell are swept from left to right, keeping the
+    //! list of the ones which overlap the sweep line; the cells are swept
+    //! in parallel.
+    size_t getCrossingsCount() const
+    {
+        std::vector<size_t> counts(svGetThreadsCount(), 0);
+        svParallelFor(m_cells.size(),
+            [&](size_t begin, size_t end, unsigned int threadIdx) {
+                std::vector<unsigned int> sorted, active;
+                for (size_t cell=begin; cell<end; cell++)
+                {
+                    sorted = m_cells[cell];
+                    std::sort(sorted.begin(), sorted.end(),
+                              [this](unsigned int s, unsigned int t) {
+                                  return std::min(m_from[s].x, m_to[s].x) < std::min(m_from[t].x, m_to[t].x);
+                              });
+
+                    active.clear();
+                    for (size_t k=0; k<sorted.size(); k++)
+                    {
+                        unsigned int s = sorted[k];
+                        int left = std::min(m_from[s].x, m_to[s].x);
+
+                        size_t n = 0;
+                        for (size_t j=0; j<active.size(); j++)
+                        {
+                            unsigned int t = active[j];
+                            if (std::max(m_from[t].x, m_to[t].x) < left)
+                                continue;       // left behind by the sweep line
+                            active[n++] = t;
+                            if (m_net[s] != m_net[t] && crosses(s, t, cell))
+                                counts[threadIdx]++;
+                        }
+                        active.resize(n);
+                        active.push_back(s);
+                    }
+                }
+            }, 0, 64);
+
+        size_t total = 0;
+        for (size_t i=0; i<counts.size(); i++)
+            total += counts[i];
+        return total;
+    }
+};
+
+// ----------------------------------------------------------------------------
+// svPlacementProgress
+// ----------------------------------------------------------------------------
+
+void svPlacementProgress::reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopRequested = false;
+    m_nextSnapshot = std::chrono::steady_clock::now();
+    m_positions.clear();
+    m_rotations.clear();
+    m_snapshotSeq = 0;
+}
+
+void svPlacementProgress::publish(const std::vector<wxPoint>& positions,
+                                  const std::vector<svRotation>& rotations)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_positions = positions;
+        m_rotations = rotations;
+        m_snapshotSeq++;
+    }
+    m_nextSnapshot = std::chrono::steady_clock::now() +
+                     std::chrono::milliseconds(SV_PLACEMENT_SNAPSHOT_INTERVAL);
+}
+
+bool svPlacementProgress::getSnapshot(std::vector<wxPoint>& positions, std::vector<svRotation>& rotations,
+                                      unsigned long& seq) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_snapshotSeq == seq)
+        return false;
+
+    positions = m_positions;
+    rotations = m_rotations;
+    seq = m_snapshotSeq;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// svCircuit - placement progress
+// ----------------------------------------------------------------------------
+
+void svCircuit::publishProgress(const std::vector<wxPoint>& positions)
+{
+    // like placeDevices(), make all grid points positive
+    size_t nDevices = m_devices.size();
+    wxPoint offset;
+    for (size_t i=0; i<nDevices; i++)
+    {
+        offset.x = std::min(offset.x, positions[i].x + m_devices[i]->getLeftmostGridNodePosition());
+        offset.y = std::min(offset.y, positions[i].y + m_devices[i]->getTopmostGridNodePosition());
+    }
+    offset = wxPoint(2,2) + offset*(-1);
+
+    std::vector<wxPoint> snapshot(nDevices);
+    std::vector<svRotation> rotations(nDevices);
+    for (size_t i=0; i<nDevices; i++)
+    {
+        snapshot[i] = positions[i] + offset;
+        rotations[i] = m_devices[i]->getRotation();
+    }
+    m_progress->publish(snapshot, rotations);
+}
+
+void svCircuit::publishProgress(const std::vector<wxRealPoint>& centers)
+{
+    wxASSERT(centers.size() >= m_devices.size());
+    std::vector<wxPoint> positions(m_devices.size());
+    for (size_t i=0; i<positions.size(); i++)
+    {
+        wxRect bb = m_devices[i]->getRelativeBoundingBox();
+        positions[i] = wxPoint(wxRound(centers[i].x - bb.x - bb.width/2.0),
+                               wxRound(centers[i].y - bb.y - bb.height/2.0));
+    }
+    publishProgress(positions);
+}
+
+void svCircuit::publishProgress()
+{
+    std::vector<wxPoint> positions(m_devices.size());
+    for (size_t i=0; i<positions.size(); i++)
+        positions[i] = m_devices[i]->getGridPosition();
+    publishProgress(positions);
+}
+
+// ----------------------------------------------------------------------------
+// svCircuit - placement algorithms
+// ----------------------------------------------------------------------------
+
+void svCircuit::placeShelves(svPlaceAlgorithm ag)
+{
+    size_t nDevices = m_devices.size();
+
+    // the group of each device and its order inside the group
+    std::vector<unsigned int> group(nDevices, 0), rank(nDevices);
+    for (size_t i=0; i<nDevices; i++)
+        rank[i] = i;
+
+    if (ag == SVPA_PACK_BY_KIND)
+    {
+        std::map<std::string, unsigned int> kinds;
+        for (size_t i=0; i<nDevices; i++)
+            group[i] = kinds.insert(std::make_pair(m_devices[i]->getHumanReadableDesc(), kinds.size())).first->second;
+    }
+    else if (ag == SVPA_PACK_BY_CLUSTER)
+    {
+        // a breadth-first visit puts the connected devices close to each other
+        const svHyperGraph& hg = getHyperGraph();
+        std::vector<bool> visitedDevice(nDevices, false), visitedNet(hg.getNetsCount(), false);
+        std::vector<unsigned int> queue;
+        unsigned int nGroups = 0;
+        for (size_t first=0; first<nDevices; first++)
+        {
+            if (visitedDevice[first])
+                continue;
+
+            visitedDevice[first] = true;
+            queue.push_back(first);
+            for (size_t head=queue.size()-1; head<queue.size(); head++)
+            {
+                unsigned int dev = queue[head];
+                rank[dev] = head;
+                group[dev] = nGroups;
+                for (const unsigned int* net = hg.getDeviceNetsBegin(dev); net != hg.getDeviceNetsEnd(dev); net++)
+                {
+                    if (visitedNet[*net] || hg.isIgnoredNet(*net))
+                        continue;
+
+                    visitedNet[*net] = true;
+                    for (const unsigned int* other = hg.getNetDevicesBegin(*net); other != hg.getNetDevicesEnd(*net); other++)
+                        if (!visitedDevice[*other])
+                        {
+                            visitedDevice[*other] = true;
+                            queue.push_back(*other);
+                        }
+                }
+            }
+
+            nGroups++;
+        }
+    }
+
+    // the external pins go in the first rows, the other devices below them
+    std::vector<unsigned int> pins, others;
+    std::vector<wxRect> bb(nDevices);
+    double totalArea = 0;
+    for (size_t i=0; i<nDevices; i++)
+    {
+        (dynamic_cast<const svExternalPin*>(m_devices[i]) ? pins : others).push_back(i);
+
+        bb[i] = m_devices[i]->getRelativeBoundingBox();
+        totalArea += (bb[i].width + 1)*(bb[i].height + 1);
+    }
+
+    // inside each group the tallest devices come first, so that each row
+    // contains devices of similar height; clusters instead keep the order
+    // of the visit, which is what keeps the connected devices together
+    bool byHeight = ag != SVPA_PACK_BY_CLUSTER;
+    std::sort(others.begin(), others.end(),
+              [&](unsigned int a, unsigned int b) {
+                  if (group[a] != group[b])
+                      return group[a] < group[b];
+                  if (byHeight && bb[a].height != bb[b].height)
+                      return bb[a].height > bb[b].height;
+                  return rank[a] < rank[b];
+              });
+
+    // fill each row up to the width which gives the layout the wanted aspect
+    // ratio, leaving one free cell between the devices
+    int width = std::max(1, int(sqrt(totalArea*SHELF_ASPECT_RATIO)));
+    int y = 0;
+    auto pack = [&](const std::vector<unsigned int>& devices) {
+        int x = 0, rowHeight = 0;
+        for (size_t k=0; k<devices.size(); k++)
+        {
+            const wxRect& r = bb[devices[k]];
+            if (x > 0 && x + r.width > width)
+            {
+                y += rowHeight + 1;
+                x = rowHeight = 0;
+            }
+
+            m_devices[devices[k]]->setGridPosition(wxPoint(x - r.x, y - r.y));
+            x += r.width + 1;
+            rowHeight = std::max(rowHeight, r.height);
+        }
+
+        if (x > 0)
+            y += rowHeight + 1;
+    };
+
+    pack(pins);
+    pack(others);
+}
+
+void svCircuit::placeLayered()
+{
+    const svHyperGraph& hg = getHyperGraph();
+    size_t nDevices = m_devices.size();
+
+    // the graph of the devices: the nets with many pins (usually supplies and
+    // biases) say nothing about the signal flow and are ignored
+    svWeightedGraph g;
+    g.area.resize(nDevices);
+    buildAdjacency(g, nDevices,
+        [&hg](unsigned int dev, svWeightedEdgeArray& edges) {
+            for (const unsigned int* net = hg.getDeviceNetsBegin(dev); net != hg.getDeviceNetsEnd(dev); net++)
+            {
+                unsigned int degree = hg.getNetDegree(*net);
+                if (hg.isIgnoredNet(*net) || degree < 2 || degree > LAYERED_MAX_NET_DEGREE)
+                    continue;
+
+                for (const unsigned int* other = hg.getNetDevicesBegin(*net); other != hg.getNetDevicesEnd(*net); other++)
+                    edges.push_back(std::make_pair(*other, 1.0f/(degree - 1)));
+            }
+        });
+
+    // the signal flows from the external pins named like inputs (or from the
+    // first external pin) to the other external pins; top-level circuits have
+    // no external pins: there the signal flows from the independent sources
+    std::vector<unsigned int> inputs, outputs, sources;
+    for (size_t i=0; i<nDevices; i++)
+    {
+        if (dynamic_cast<const svExternalPin*>(m_devices[i]))
+        {
+            if (wxString(m_devices[i]->getNode(0)).Lower().StartsWith("in"))
+                inputs.push_back(i);
+            else
+                outputs.push_back(i);
+        }
+        else if (dynamic_cast<const svIndipendentSource*>(m_devices[i]))
+            sources.push_back(i);
+    }
+    if (inputs.empty() && !outputs.empty())
+    {
+        inputs.push_back(outputs.front());
+        outputs.erase(outputs.begin());
+    }
+    if (inputs.empty())
+        inputs = sources;
+
+    // assign the layers by breadth-first distance from the inputs; the devices
+    // not reachable from them start new visits (in the first layer)
+    std::vector<int> layer(nDevices, -1);
+    for (size_t k=0; k<outputs.size(); k++)
+        layer[outputs[k]] = INT_MAX;
+
+    std::vector<unsigned int> queue;
+    auto visit = [&](const std::vector<unsigned int>& roots) {
+        size_t head = queue.size();
+        for (size_t k=0; k<roots.size(); k++)
+            if (layer[roots[k]] < 0)
+            {
+                layer[roots[k]] = 0;
+                queue.push_back(roots[k]);
+            }
+        for (; head<queue.size(); head++)
+        {
+            unsigned int v = queue[head];
+            for (unsigned int e=g.offsets[v]; e<g.offsets[v+1]; e++)
+                if (layer[g.adjacency[e]] < 0)
+                {
+                    layer[g.adjacency[e]] = layer[v] + 1;
+                    queue.push_back(g.adjacency[e]);
+                }
+        }
+    };
+
+    visit(inputs);
+    for (unsigned int i=0; i<nDevices; i++)
+        if (layer[i] < 0)
+            visit(std::vector<unsigned int>(1, i));
+
+    // the outputs go in the last layer
+    int nLayers = 0;
+    for (size_t k=0; k<queue.size(); k++)
+        nLayers = std::max(nLayers, layer[queue[k]] + 1);
+    for (size_t k=0; k<outputs.size(); k++)
+    {
+        layer[outputs[k]] = nLayers;
+        queue.push_back(outputs[k]);
+    }
+    if (!outputs.empty())
+        nLayers++;
+
+    // the initial order inside each layer is the order of the visit
+    std::vector< std::vector<unsigned int> > layers(nLayers);
+    std::vector<double> order(nDevices);
+    for (size_t k=0; k<queue.size(); k++)
+    {
+        unsigned int v = queue[k];
+        order[v] = layers[layer[v]].size();
+        layers[layer[v]].push_back(v);
+    }
+
+    // reduce the crossings between adjacent layers sorting each layer by the
+    // barycenter of the neighbours in the two adjacent layers; the odd and the
+    // even layers are sorted alternately, so that all the layers being sorted
+    // depend only on layers which don't change and can be sorted in parallel
+    std::vector<double> barycenter(nDevices);
+    for (unsigned int sweep=0; sweep<2*LAYERED_SWEEPS; sweep++)
+    {
+        svParallelFor(nLayers,
+            [&](size_t begin, size_t end, unsigned int) {
+                for (size_t l=begin; l<end; l++)
+                {
+                    if (l % 2 != sweep % 2)
+                        continue;
+
+                    std::vector<unsigned int>& devices = layers[l];
+                    for (size_t k=0; k<devices.size(); k++)
+                    {
+                        unsigned int v = devices[k];
+                        double sum = 0, sw = 0;
+                        for (unsigned int e=g.offsets[v]; e<g.offsets[v+1]; e++)
+                        {
+                            unsigned int u = g.adjacency[e];
+                            if (abs(layer[u] - int(l)) == 1)
+                            {
+                                sum += g.weights[e]*order[u];
+                                sw += g.weights[e];
+                            }
+                        }
+                        barycenter[v] = sw > 0 ? sum/sw : order[v];
+                    }
+
+                    std::sort(devices.begin(), devices.end(),
+                              [&](unsigned int a, unsigned int b) {
+                                  return barycenter[a] < barycenter[b] ||
+                                         (barycenter[a] == barycenter[b] && order[a] < order[b]);
+                              });
+                    for (size_t k=0; k<devices.size(); k++)
+                        order[devices[k]] = k;
+                }
+            }, 0, 1);
+    }
+
+    // the layers are columns, from left to right; the layers taller than the
+    // side of the square which would contain all devices are split in more
+    // columns, so that a few layers with many devices don't give a tall strip
+    double area = 0;
+    for (size_t i=0; i<nDevices; i++)
+    {
+        wxRect bb = m_devices[i]->getRelativeBoundingBox();
+        area += double(bb.width + LAYERED_COLUMN_SPACING)*(bb.height + 1);
+    }
+    int maxHeight = int(ceil(sqrt(area)));
+
+    std::vector< std::vector<unsigned int> > columns;
+    std::vector<int> column(nDevices);
+    for (int l=0; l<nLayers; l++)
+    {
+        int height = -1;
+        for (size_t k=0; k<layers[l].size(); k++)
+        {
+            unsigned int v = layers[l][k];
+            int h = m_devices[v]->getRelativeBoundingBox().height + 1;
+            if (height < 0 || height + h > maxHeight)
+            {
+                columns.push_back(std::vector<unsigned int>());
+                height = 0;
+            }
+            column[v] = columns.size() - 1;
+            columns.back().push_back(v);
+            height += h;
+        }
+    }
+
+    // assign the vertical coordinates: each device is aligned with the
+    // barycenter of the devices it's connected to in the other columns, as far
+    // as the order of its column allows; the first pass goes from left to
+    // right and considers only the columns already placed, then the passes
+    // alternate their direction and consider all columns. The devices of each
+    // column are placed minimizing the (squared) distance from those targets
+    // with the pool adjacent violators algorithm, which centers each group of
+    // devices on its targets instead of pushing them downward
+    std::vector<double> centerY(nDevices, 0);
+    std::vector<bool> placed(nDevices, false);
+    std::vector<double> target, weight;
+    std::vector<size_t> blockEnd;
+    for (int pass=0; pass<=LAYERED_ALIGN_PASSES; pass++)
+    {
+        bool backward = pass % 2 == 1;
+        for (size_t c=0; c<columns.size(); c++)
+        {
+            const std::vector<unsigned int>& devices = columns[backward ? columns.size()-1-c : c];
+            size_t n = devices.size();
+
+            // the targets of the top coordinates, made independent of the
+            // stacking: the devices must then have non-decreasing targets
+            target.resize(n);
+            weight.resize(n);
+            int offset = 0;
+            for (size_t k=0; k<n; k++)
+            {
+                unsigned int v = devices[k];
+                double sum = 0, sw = 0;
+                for (unsigned int e=g.offsets[v]; e<g.offsets[v+1]; e++)
+                {
+                    unsigned int u = g.adjacency[e];
+                    if (placed[u] && column[u] != column[v])
+                    {
+                        sum += g.weights[e]*centerY[u];
+                        sw += g.weights[e];
+                    }
+                }
+
+                // the devices with no placed neighbours stay where they are
+                // (or around the first row) unless pushed by the others
+                int height = m_devices[v]->getRelativeBoundingBox().height;
+                double center = sw > 0 ? sum/sw : centerY[v];
+                target[k] = center - height/2.0 - offset;
+                weight[k] = sw > 0 ? sw : 1e-3;
+                offset += height + 1;
+            }
+
+            // pool adjacent violators: merge the blocks of consecutive devices
+            // whose (weighted mean) targets are in the wrong order
+            blockEnd.clear();
+            for (size_t k=0; k<n; k++)
+            {
+                blockEnd.push_back(k+1);
+                while (blockEnd.size() > 1)
+                {
+                    size_t last = blockEnd.size()-1;
+                    size_t b = blockEnd.size() > 2 ? blockEnd[last-2] : 0, a = blockEnd[last-1];
+                    if (target[b] <= target[a])
+                        break;
+
+                    // the first device of each block stores its mean and weight
+                    double w = weight[b] + weight[a];
+                    target[b] = (target[b]*weight[b] + target[a]*weight[a])/w;
+                    weight[b] = w;
+                    blockEnd[last-1] = blockEnd[last];
+                    blockEnd.pop_back();
+                }
+            }
+
+            offset = 0;
+            for (size_t blk=0, k=0; blk<blockEnd.size(); blk++)
+            {
+                int top = wxRound(target[k]);
+                for (; k<blockEnd[blk]; k++)
+                {
+                    unsigned int v = devices[k];
+                    int height = m_devices[v]->getRelativeBoundingBox().height;
+                    centerY[v] = top + offset + height/2.0;
+                    placed[v] = true;
+                    offset += height + 1;
+                }
+            }
+        }
+    }
+
+    int x = 0;
+    for (size_t c=0; c<columns.size(); c++)
+    {
+        int width = 0;
+        for (size_t k=0; k<columns[c].size(); k++)
+        {
+            unsigned int v = columns[c][k];
+            wxRect bb = m_devices[v]->getRelativeBoundingBox();
+            m_devices[v]->setGridPosition(wxPoint(x - bb.x, wxRound(centerY[v] - bb.height/2.0) - bb.y));
+            width = std::max(width, bb.width);
+        }
+
+        x += width + LAYERED_COLUMN_SPACING;
+    }
+}
+
+void svCircuit::placeForceDirected()
+{
+    const svHyperGraph& hg = getHyperGraph();
+    size_t nDevices = m_devices.size(), nNets = hg.getNetsCount();
+
+    // start from random positions in a square large enough to host
+    // all devices at the ideal distance
+    const double k = IDEAL_DEVICE_DISTANCE, k2 = FD_REPULSION*k*k;
+    double side = k*sqrt(double(nDevices));
+    std::mt19937 rng(PLACEMENT_SEED);
+    std::uniform_real_distribution<double> coord(0, side);
+    std::vector<wxRealPoint> pos(nDevices), disp(nDevices), netCenter(nNets);
+    for (size_t i=0; i<nDevices; i++)
+    {
+        pos[i].x = coord(rng);
+        pos[i].y = coord(rng);
+    }
+
+    double temperature = side/4;
+    const double cooling = pow(0.01/temperature, 1.0/FD_ITERATIONS);        // down to 1% of a grid step
+    for (unsigned int iter=0; iter<FD_ITERATIONS && !isPlacementStopped(); iter++)
+    {
+        if (isSnapshotDue())
+            publishProgress(pos);
+
+        svQuadTree tree(pos);
+
+        // the nets are modeled as stars: each device is attracted by the center
+        // of the nets it's attached to
+        svParallelFor(nNets,
+            [&](size_t begin, size_t end, unsigned int) {
+                for (size_t net=begin; net<end; net++)
+                {
+                    wxRealPoint c(0, 0);
+                    for (const unsigned int* d = hg.getNetDevicesBegin(net); d != hg.getNetDevicesEnd(net); d++)
+                        c += pos[*d];
+                    if (hg.getNetDegree(net) > 0)
+                        c = c / double(hg.getNetDegree(net));
+                    netCenter[net] = c;
+                }
+            });
+
+        svParallelFor(nDevices,
+            [&](size_t begin, size_t end, unsigned int) {
+                for (size_t dev=begin; dev<end; dev++)
+                {
+                    wxRealPoint f = tree.getRepulsion(dev, k2);
+
+                    for (const unsigned int* net = hg.getDeviceNetsBegin(dev); net != hg.getDeviceNetsEnd(dev); net++)
+                    {
+                        unsigned int degree = hg.getNetDegree(*net);
+                        if (hg.isIgnoredNet(*net) || degree < 2)
+                            continue;
+
+                        // the attraction of a net is shared among its pins, so that
+                        // high fan-out nets do not collapse the whole layout
+                        double dx = netCenter[*net].x - pos[dev].x, dy = netCenter[*net].y - pos[dev].y;
+                        double d = sqrt(dx*dx + dy*dy), w = 2.0/degree;
+                        f.x += w*dx*d/k;
+                        f.y += w*dy*d/k;
+                    }
+
+                    // limit the displacement to the current temperature
+                    double len = sqrt(f.x*f.x + f.y*f.y);
+                    if (len > temperature)
+                        f = f*(temperature/len);
+                    disp[dev] = f;
+                }
+            });
+
+        for (size_t i=0; i<nDevices; i++)
+            pos[i] += disp[i];
+        temperature *= cooling;
+    }
+
+    legalizePlacement(pos);
+}
+
+void svCircuit::placeKamadaKawai()
+{
+    size_t n = m_devices.size();
+    if (n > KK_MAX_DEVICES)
+    {
+        placeForceDirected();
+        return;
+    }
+
+    // compute the graph distances between all pairs of devices, with one BFS
+    // for each device; each thread works on a different range of source devices
+    // and thus on different rows of the matrix
+    const svHyperGraph& hg = getHyperGraph();
+    const unsigned short unreachable = USHRT_MAX;
+    std::vector<unsigned short> dist(n*n, unreachable);
+    std::vector<unsigned short> maxDist(svGetThreadsCount(), 0);
+    svParallelFor(n,
+        [&](size_t begin, size_t end, unsigned int threadIdx) {
+            std::vector<unsigned int> queue(n);
+            std::vector<size_t> netVisited(hg.getNetsCount(), size_t(-1));
+            for (size_t src=begin; src<end; src++)
+            {
+                unsigned short* row = &dist[src*n];
+                size_t head = 0, tail = 0;
+                queue[tail++] = src;
+                row[src] = 0;
+                while (head < tail)
+                {
+                    unsigned int dev = queue[head++];
+                    for (const unsigned int* net = hg.getDeviceNetsBegin(dev); net != hg.getDeviceNetsEnd(dev); net++)
+                    {
+                        if (hg.isIgnoredNet(*net) || netVisited[*net] == src)
+                            continue;
+                        netVisited[*net] = src;
+
+                        for (const unsigned int* other = hg.getNetDevicesBegin(*net); other != hg.getNetDevicesEnd(*net); other++)
+                            if (row[*other] == unreachable)
+                            {
+                                row[*other] = row[dev] + 1;
+                                maxDist[threadIdx] = std::max(maxDist[threadIdx], row[*other]);
+                                queue[tail++] = *other;
+                            }
+                    }
+                }
+            }
+        }, 0, 16 /* each BFS is O(pins) */);
+
+    // disconnected devices are kept slightly farther than the farthest connected ones
+    unsigned short farthest = *std::max_element(maxDist.begin(), maxDist.end()) + 1;
+    for (size_t i=0; i<dist.size(); i++)
+        if (dist[i] == unreachable)
+            dist[i] = farthest;
+
+    // minimize the stress sum(w_ij*(|p_i - p_j| - l*d_ij)^2) with w_ij = 1/(l*d_ij)^2
+    // by stress majorization: each step moves all devices at once (so that it
+    // can be done in parallel) and never increases the stress
+    const double l = IDEAL_DEVICE_DISTANCE;
+    std::vector<double> weight(farthest+1), weightTarget(farthest+1);
+    for (unsigned int d=1; d<=farthest; d++)
+    {
+        weight[d] = 1.0/(l*d*l*d);
+        weightTarget[d] = 1.0/(l*d);
+    }
+
+    // x and y are kept in separate arrays, so that the inner loop can be vectorized
+    std::mt19937 rng(PLACEMENT_SEED);
+    std::uniform_real_distribution<double> coord(0, l*sqrt(double(n)));
+    std::vector<double> x(n), y(n), nextX(n), nextY(n);
+    for (size_t i=0; i<n; i++)
+    {
+        x[i] = coord(rng);
+        y[i] = coord(rng);
+    }
+
+    std::vector<double> stress(svGetThreadsCount());
+    double prevStress = -1;
+    for (unsigned int iter=0; iter<KK_MAX_ITERATIONS && !isPlacementStopped(); iter++)
+    {
+        if (isSnapshotDue())
+        {
+            std::vector<wxRealPoint> pos(n);
+            for (size_t i=0; i<n; i++)
+                pos[i] = wxRealPoint(x[i], y[i]);
+            publishProgress(pos);
+        }
+
+        std::fill(stress.begin(), stress.end(), 0);
+        svParallelFor(n,
+            [&](size_t begin, size_t end, unsigned int threadIdx) {
+                for (size_t i=begin; i<end; i++)
+                {
+                    const unsigned short* row = &dist[i*n];
+                    double sx = 0, sy = 0, sw = 0, st = 0;
+                    for (size_t j=0; j<n; j++)
+                    {
+                        double dx = x[i] - x[j], dy = y[i] - y[j];
+                        double d = sqrt(dx*dx + dy*dy) + 1e-9;
+                        double w = weight[row[j]], wt = weightTarget[row[j]];
+
+                        // w*target/d, without divisions by the distance of the
+                        // device from itself (w is zero there)
+                        double f = wt/d;
+                        sx += w*x[j] + f*dx;
+                        sy += w*y[j] + f*dy;
+                        sw += w;
+                        st += w*d*d - 2*wt*d;       // the stress, up to a constant
+                    }
+
+                    nextX[i] = sw > 0 ? sx/sw : x[i];
+                    nextY[i] = sw > 0 ? sy/sw : y[i];
+                    stress[threadIdx] += st;
+                }
+            }, 0, 64 /* each device costs O(n) */);
+
+        x.swap(nextX);
+        y.swap(nextY);
+
+        double curStress = n*(n - 1);       // the constant omitted above
+        for (size_t t=0; t<stress.size(); t++)
+            curStress += stress[t];
+        if (prevStress >= 0 && prevStress - curStress < KK_TOLERANCE*prevStress)
+            break;      // converged
+        prevStress = curStress;
+    }
+
+    std::vector<wxRealPoint> pos(n);
+    for (size_t i=0; i<n; i++)
+        pos[i] = wxRealPoint(x[i], y[i]);
+    legalizePlacement(pos);
+}
+
+void svCircuit::placeMultilevel()
+{
+    const svHyperGraph& hg = getHyperGraph();
+    size_t nDevices = m_devices.size();
+    std::mt19937 rng(PLACEMENT_SEED);
+
+    // the finest level: the graph of the devices, where each net is a clique
+    // whose edges share a total weight of one per pin
+    std::vector<svWeightedGraph> levels(1);
+    svWeightedGraph& devices = levels[0];
+    devices.area.resize(nDevices);
+    for (size_t i=0; i<nDevices; i++)
+    {
+        wxRect bb = m_devices[i]->getRelativeBoundingBox();
+        devices.area[i] = (bb.width + 1)*(bb.height + 1);
+    }
+    buildAdjacency(devices, nDevices,
+        [&hg](unsigned int dev, svWeightedEdgeArray& edges) {
+            for (const unsigned int* net = hg.getDeviceNetsBegin(dev); net != hg.getDeviceNetsEnd(dev); net++)
+            {
+                unsigned int degree = hg.getNetDegree(*net);
+                if (hg.isIgnoredNet(*net) || degree < 2 || degree > ML_MAX_NET_DEGREE)
+                    continue;
+
+                for (const unsigned int* other = hg.getNetDevicesBegin(*net); other != hg.getNetDevicesEnd(*net); other++)
+                    edges.push_back(std::make_pair(*other, 1.0f/(degree - 1)));
+            }
+        });
+
+    // coarsen, until the graph is small enough or matching does not reduce it
+    // anymore (e.g. because most vertices are disconnected)
+    std::vector< std::vector<unsigned int> > coarseOf;
+    while (levels.back().getVerticesCount() > ML_COARSEST_VERTICES)
+    {
+        coarseOf.push_back(std::vector<unsigned int>());
+        svWeightedGraph coarse = coarsenGraph(levels.back(), coarseOf.back(), rng);
+        if (coarse.getVerticesCount() > 0.9*levels.back().getVerticesCount())
+        {
+            coarseOf.pop_back();
+            break;
+        }
+
+        levels.push_back(coarse);
+    }
+
+    // place the coarsest level starting from random positions...
+    const svWeightedGraph& coarsest = levels.back();
+    double totalArea = 0;
+    for (size_t v=0; v<coarsest.getVerticesCount(); v++)
+        totalArea += coarsest.area[v];
+
+    std::uniform_real_distribution<double> coord(0, sqrt(totalArea/ML_MAX_DENSITY));
+    std::vector<wxRealPoint> pos(coarsest.getVerticesCount());
+    for (size_t v=0; v<pos.size(); v++)
+    {
+        pos[v].x = coord(rng);
+        pos[v].y = coord(rng);
+    }
+
+    // shows the layout of the given level: each device is at the position of
+    // the vertex containing it
+    auto publishLevel = [&](size_t level) {
+        std::vector<wxRealPoint> centers(nDevices);
+        for (size_t i=0; i<nDevices; i++)
+        {
+            unsigned int v = i;
+            for (size_t l=0; l<level; l++)
+                v = coarseOf[l][v];
+            centers[i] = pos[v];
+        }
+        publishProgress(centers);
+    };
+    auto afterSweep = [&](size_t level) {
+        if (isSnapshotDue())
+            publishLevel(level);
+        return !isPlacementStopped();
+    };
+    refineLayout(coarsest, pos, ML_COARSEST_SWEEPS,
+                 [&]() { return afterSweep(levels.size()-1); });
+
+    // ...then project each level on the finer one: the two vertices merged in
+    // a coarse vertex start at the opposite sides of its position
+    std::uniform_real_distribution<double> angle(0, 2*M_PI);
+    for (size_t l=levels.size()-1; l>0; l--)
+    {
+        const svWeightedGraph& fine = levels[l-1];
+        const std::vector<unsigned int>& parent = coarseOf[l-1];
+
+        std::vector<wxRealPoint> finePos(fine.getVerticesCount());
+        std::vector<bool> first(levels[l].getVerticesCount(), true);
+        std::vector<double> dir(levels[l].getVerticesCount());
+        for (size_t c=0; c<dir.size(); c++)
+            dir[c] = angle(rng);
+        for (size_t v=0; v<finePos.size(); v++)
+        {
+            unsigned int c = parent[v];
+            double r = sqrt(fine.area[v]/ML_MAX_DENSITY)/2*(first[c] ? 1 : -1);
+            finePos[v] = pos[c] + wxRealPoint(r*cos(dir[c]), r*sin(dir[c]));
+            first[c] = false;
+        }
+
+        // once stopped, the levels are only projected
+        pos.swap(finePos);
+        refineLayout(fine, pos, isPlacementStopped() ? 0 : ML_REFINE_SWEEPS,
+                     [&]() { return afterSweep(l-1); });
+    }
+
+    legalizePlacement(pos);
+}
+
+void svCircuit::placeQuadratic()
+{
+    const svHyperGraph& hg = getHyperGraph();
+    size_t nDevices = m_devices.size(), nNets = hg.getNetsCount();
+
+    // the nets with many pins are modelled as stars, with an additional vertex
+    // at their center, to keep the matrix sparse; the others are cliques whose
+    // edges share a total weight of one per pin (the weight of the star edges
+    // is chosen so that the two models are equivalent)
+    std::vector<unsigned int> netOfStar;
+    std::vector<unsigned int> starOf(nNets, UINT_MAX);
+    for (size_t net=0; net<nNets; net++)
+        if (!hg.isIgnoredNet(net) && hg.getNetDegree(net) > QP_MAX_CLIQUE_DEGREE)
+        {
+            starOf[net] = nDevices + netOfStar.size();
+            netOfStar.push_back(net);
+        }
+
+    size_t nVertices = nDevices + netOfStar.size();
+    svWeightedGraph g;
+    g.area.assign(nVertices, 0);
+    buildAdjacency(g, nVertices,
+        [&](unsigned int v, svWeightedEdgeArray& edges) {
+            if (v >= nDevices)
+            {
+                unsigned int net = netOfStar[v - nDevices], degree = hg.getNetDegree(net);
+                for (const unsigned int* dev = hg.getNetDevicesBegin(net); dev != hg.getNetDevicesEnd(net); dev++)
+                    edges.push_back(std::make_pair(*dev, float(degree)/(degree - 1)));
+                return;
+            }
+
+            for (const unsigned int* net = hg.getDeviceNetsBegin(v); net != hg.getDeviceNetsEnd(v); net++)
+            {
+                unsigned int degree = hg.getNetDegree(*net);
+                if (hg.isIgnoredNet(*net) || degree < 2)
+                    continue;
+
+                if (starOf[*net] != UINT_MAX)
+                    edges.push_back(std::make_pair(starOf[*net], float(degree)/(degree - 1)));
+                else
+                    for (const unsigned int* other = hg.getNetDevicesBegin(*net); other != hg.getNetDevicesEnd(*net); other++)
+                        edges.push_back(std::make_pair(*other, 1.0f/(degree - 1)));
+            }
+        });
+
+    std::vector<double> area(nDevices);
+    double totalArea = 0;
+    for (size_t i=0; i<nDevices; i++)
+    {
+        wxRect bb = m_devices[i]->getRelativeBoundingBox();
+        area[i] = (bb.width + 1)*(bb.height + 1);
+        totalArea += area[i];
+    }
+
+    // the external pins are the fixed points of the placement: they are evenly
+    // distributed on a circle around the area which will host the devices
+    std::vector<wxRealPoint> pos(nVertices, wxRealPoint(0, 0));
+    std::vector<unsigned int> rowOf(nVertices, UINT_MAX), vertexOf;
+    std::vector<unsigned int> externalPins;
+    for (size_t v=0; v<nVertices; v++)
+    {
+        if (v < nDevices && dynamic_cast<const svExternalPin*>(m_devices[v]))
+            externalPins.push_back(v);
+        else
+        {
+            rowOf[v] = vertexOf.size();
+            vertexOf.push_back(v);
+        }
+    }
+
+    double radius = sqrt(totalArea/LEGALIZE_MAX_DENSITY)/2;
+    for (size_t k=0; k<externalPins.size(); k++)
+    {
+        double angle = 2*M_PI*k/externalPins.size();
+        pos[externalPins[k]] = wxRealPoint(radius*cos(angle), radius*sin(angle));
+    }
+
+    // build the matrix of the movable vertices: the edges towards the fixed
+    // ones only contribute to the diagonal and to the known terms
+    size_t nRows = vertexOf.size();
+    svSparseMatrix a;
+    a.offsets.assign(nRows + 1, 0);
+    a.diagonal.resize(nRows);
+    std::vector<double> laplacianDiagonal(nRows, 0), fixedX(nRows, 0), fixedY(nRows, 0);
+    for (size_t r=0; r<nRows; r++)
+    {
+        unsigned int v = vertexOf[r];
+        for (unsigned int e=g.offsets[v]; e<g.offsets[v+1]; e++)
+        {
+            unsigned int u = g.adjacency[e];
+            laplacianDiagonal[r] += g.weights[e];
+            if (rowOf[u] == UINT_MAX)
+            {
+                fixedX[r] += g.weights[e]*pos[u].x;
+                fixedY[r] += g.weights[e]*pos[u].y;
+            }
+            else
+            {
+                a.columns.push_back(rowOf[u]);
+                a.values.push_back(-g.weights[e]);
+            }
+        }
+        a.offsets[r+1] = a.columns.size();
+    }
+
+    // each iteration solves the systems with each device tied by an anchor to
+    // its position in a spread version of the previous solution; the anchors
+    // get stronger and stronger, so that the solutions converge to a spread
+    // layout; the first anchors are random, as the external pins alone would
+    // cluster most devices together (or in the origin, if there are none)
+    std::mt19937 rng(PLACEMENT_SEED);
+    std::uniform_real_distribution<double> coord(-radius, radius);
+    std::vector<wxRealPoint> spread(nDevices);
+    for (size_t i=0; i<nDevices; i++)
+    {
+        spread[i].x = coord(rng);
+        spread[i].y = coord(rng);
+    }
+
+    std::vector<double> x(nRows, 0), y(nRows, 0), bx(nRows), by(nRows);
+    for (unsigned int it=1; it<=QP_ITERATIONS; it++)
+    {
+        double anchorWeight = QP_ANCHOR_WEIGHT*it;
+        for (size_t r=0; r<nRows; r++)
+        {
+            unsigned int v = vertexOf[r];
+            double w = QP_REGULARIZATION + (v < nDevices ? anchorWeight : 0);
+            a.diagonal[r] = laplacianDiagonal[r] + w;
+            bx[r] = fixedX[r] + (v < nDevices ? anchorWeight*spread[v].x : 0);
+            by[r] = fixedY[r] + (v < nDevices ? anchorWeight*spread[v].y : 0);
+        }
+
+        a.solve(bx, x, QP_MAX_CG_ITERATIONS, QP_CG_TOLERANCE);
+        a.solve(by, y, QP_MAX_CG_ITERATIONS, QP_CG_TOLERANCE);
+
+        for (size_t r=0; r<nRows; r++)
+            pos[vertexOf[r]] = wxRealPoint(x[r], y[r]);
+        if (isSnapshotDue())
+            publishProgress(pos);
+        if (isPlacementStopped())
+            break;
+
+        std::copy(pos.begin(), pos.begin() + nDevices, spread.begin());
+        spreadLayout(spread, area);
+    }
+
+    pos.resize(nDevices);
+    legalizePlacement(pos);
+}
+
+void svCircuit::placeAnnealing()
+{
+    size_t nDevices = m_devices.size();
+    if (nDevices > SA_MAX_DEVICES)
+    {
+        placeQuadratic();
+        return;
+    }
+
+    // start from the quadratic placement, on an area a bit larger than its own
+    placeQuadratic();
+    if (isPlacementStopped())
+        return;
+
+    std::vector<wxPoint> start(nDevices);
+    wxRect area;
+    for (size_t i=0; i<nDevices; i++)
+    {
+        start[i] = m_devices[i]->getGridPosition();
+        wxRect bb = m_devices[i]->getRelativeBoundingBox();
+        wxRect fp(start[i].x + bb.x, start[i].y + bb.y, bb.width + 1, bb.height + 1);
+        area = i == 0 ? fp : area.Union(fp);
+    }
+    area.Inflate(area.width*SA_AREA_MARGIN + 1, area.height*SA_AREA_MARGIN + 1);
+
+    svAnnealer annealer(m_devices, getHyperGraph(), area);
+    unsigned int nReplicas = std::max<unsigned int>(SA_MIN_REPLICAS, std::min<unsigned int>(SA_MAX_REPLICAS, svGetThreadsCount()));
+    std::vector<svAnnealingState> replicas(nReplicas);
+    std::vector<std::mt19937> rngs;
+    for (unsigned int k=0; k<nReplicas; k++)
+    {
+        annealer.init(replicas[k], start);
+        rngs.push_back(std::mt19937(PLACEMENT_SEED + k));
+    }
+    double startCost = replicas[0].getCost();
+
+    // the highest temperature accepts most of the moves which worsen the cost
+    // of the starting placement (estimated on a copy of it); the others form a
+    // geometric series down to the coldest one
+    int window = std::max(area.width, area.height)/2;
+    double sumDelta = 0;
+    unsigned int nDeltas = 0;
+    {
+        svAnnealingState probe = replicas[0];
+        std::mt19937 rng(PLACEMENT_SEED);
+        for (unsigned int i=0; i<std::min<size_t>(SA_PROBE_MOVES, 10*nDevices); i++)
+        {
+            double delta = annealer.move(probe, 1e100, window, rng);
+            if (delta > 0)
+            {
+                sumDelta += delta;
+                nDeltas++;
+            }
+        }
+    }
+    if (nDeltas == 0)
+        return;     // nothing can be improved
+
+    std::vector<double> temperatures(nReplicas);
+    for (unsigned int k=0; k<nReplicas; k++)
+        temperatures[k] = sumDelta/nDeltas*pow(SA_TEMPERATURE_RANGE, -double(k)/(nReplicas - 1));
+
+    // each round runs the replicas in parallel, then tries to exchange the
+    // configurations of the replicas at adjacent temperatures; the whole
+    // ladder cools down during the rounds, so that the replicas converge
+    unsigned int movesPerRound = SA_MOVES_PER_DEVICE*nDevices/SA_ROUNDS + 1;
+    double cooling = pow(SA_COOLING_RANGE, -1.0/SA_ROUNDS);
+    std::mt19937 exchangeRng(PLACEMENT_SEED);
+    std::uniform_real_distribution<double> probability(0, 1);
+    auto getBestReplica = [&]() {
+        unsigned int best = 0;
+        for (unsigned int k=1; k<nReplicas; k++)
+            if (replicas[k].getCost() < replicas[best].getCost())
+                best = k;
+        return best;
+    };
+    for (unsigned int round=0; round<SA_ROUNDS && !isPlacementStopped(); round++)
+    {
+        svParallelFor(nReplicas,
+            [&](size_t begin, size_t end, unsigned int) {
+                for (size_t k=begin; k<end; k++)
+                {
+                    // hotter replicas explore the whole area, colder ones
+                    // only move the devices by a few cells
+                    int w = std::max(2, int(window*temperatures[k]/temperatures[0]));
+                    for (unsigned int m=0; m<movesPerRound; m++)
+                        annealer.move(replicas[k], temperatures[k], w, rngs[k]);
+                }
+            }, 0, 1);
+
+        for (unsigned int k=round % 2; k+1<nReplicas; k+=2)
+        {
+            double e = (replicas[k].getCost() - replicas[k+1].getCost())*
+                       (1/temperatures[k] - 1/temperatures[k+1]);
+            if (e >= 0 || probability(exchangeRng) < exp(e))
+                std::swap(replicas[k], replicas[k+1]);
+        }
+
+        for (unsigned int k=0; k<nReplicas; k++)
+            temperatures[k] *= cooling;
+
+        if (isSnapshotDue())
+            publishProgress(replicas[getBestReplica()].positions);
+    }
+
+    // keep the best replica; the last overlaps (if any) are removed by legalization
+    const svAnnealingState& result = replicas[getBestReplica()];
+    if (result.getCost() >= startCost)
+        return;
+
+    std::vector<wxRealPoint> centers(nDevices);
+    for (size_t i=0; i<nDevices; i++)
+    {
+        m_devices[i]->setGridPosition(result.positions[i]);
+        wxRect bb = m_devices[i]->getRelativeBoundingBox();
+        centers[i] = wxRealPoint(result.positions[i].x + bb.x + bb.width/2.0,
+                                 result.positions[i].y + bb.y + bb.height/2.0);
+    }
+    if (result.overlaps > 0)
+        legalizePlacement(centers);
+}
+
+void svCircuit::legalizePlacement(const std::vector<wxRealPoint>& centers)
+{
+    wxASSERT(centers.size() == m_devices.size());
+    if (centers.empty())
+        return;
+
+    // the devices closest to the center of the layout are placed first, so that
+    // the devices which need to be moved are the ones in the outer, sparse regions
+    std::vector<wxRealPoint> pos(centers);
+    std::vector<double> area(centers.size());
+    for (size_t i=0; i<centers.size(); i++)
+    {
+        wxRect bb = m_devices[i]->getRelativeBoundingBox();
+        area[i] = (bb.width + 1)*(bb.height + 1);
+    }
+    spreadLayout(pos, area);
+
+    wxRealPoint mean(0, 0);
+    for (size_t i=0; i<pos.size(); i++)
+        mean += pos[i];
+    mean = mean / double(pos.size());
+
+    std::vector<double> dist2(centers.size());
+    std::vector<unsigned int> order(centers.size());
+    for (size_t i=0; i<centers.size(); i++)
+    {
+        double dx = pos[i].x - mean.x, dy = pos[i].y - mean.y;
+        dist2[i] = dx*dx + dy*dy;
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(),
+              [&dist2](unsigned int a, unsigned int b) { return dist2[a] < dist2[b] || (dist2[a] == dist2[b] && a < b); });
+
+    // each device goes to the free position closest to its target one, with
+    // one free cell all around it, so that devices never touch
+    svOccupancyGrid occupied;
+    for (size_t n=0; n<order.size(); n++)
+    {
+        svBaseDevice* dev = m_devices[order[n]];
+        wxRect bb = dev->getRelativeBoundingBox();
+        wxPoint target(wxRound(pos[order[n]].x - bb.x - bb.width/2.0),
+                       wxRound(pos[order[n]].y - bb.y - bb.height/2.0));
+
+        wxRect cells = occupied.findFree(getDeviceCells(order[n], target), 1);
+        dev->setGridPosition(cells.GetTopLeft() - bb.GetTopLeft());
+        occupied.occupy(cells);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// svCircuit - rotation optimization
+// ----------------------------------------------------------------------------
+
+void svCircuit::optimizeRotations()
+{
+    const svHyperGraph& hg = getHyperGraph();
+    size_t nDevices = m_devices.size();
+    if (hg.getPinsCount() == 0)
+        return;
+
+    // the position of each pin relative to the reference node (which does not
+    // move when the device is rotated) and the footprint of each device, for
+    // the four rotations: the rotation is the innermost index, so that the four
+    // candidates are evaluated together
+    const unsigned int* firstNet = hg.getDeviceNetsBegin(0);
+    std::vector<int> pinX(4*hg.getPinsCount()), pinY(4*hg.getPinsCount());
+    std::vector<wxRect> footprint(4*nDevices);
+    std::vector<double> predisposition(4*nDevices);
+    std::vector<unsigned char> rotation(nDevices);
+    svParallelFor(nDevices,
+        [&](size_t begin, size_t end, unsigned int) {
+            for (size_t i=begin; i<end; i++)
+            {
+                svBaseDevice* dev = m_devices[i];
+                size_t first = hg.getDeviceNetsBegin(i) - firstNet;
+                rotation[i] = dev->getRotation();
+
+                for (unsigned int r=0; r<4; r++)
+                {
+                    dev->setRotation(svRotation(r));
+                    predisposition[4*i + r] = dev->getRotationPredisposition(svRotation(r));
+                    footprint[4*i + r] = dev->getRelativeBoundingBox();
+                    for (unsigned int j=0; j<hg.getDeviceDegree(i); j++)
+                    {
+                        wxPoint pt = dev->getRelativeGridNodePosition(j);
+                        pinX[4*(first + j) + r] = pt.x;
+                        pinY[4*(first + j) + r] = pt.y;
+                    }
+                }
+
+                dev->setRotation(svRotation(rotation[i]));
+            }
+        });
+
+    // the sum of the pin positions of each net
+    std::vector<long long> sumX(hg.getNetsCount(), 0), sumY(hg.getNetsCount(), 0);
+    auto addPins = [&](unsigned int dev, int sign) {
+        size_t first = hg.getDeviceNetsBegin(dev) - firstNet;
+        wxPoint pos = m_devices[dev]->getGridPosition();
+        for (unsigned int j=0; j<hg.getDeviceDegree(dev); j++)
+        {
+            sumX[firstNet[first + j]] += sign*(pos.x + pinX[4*(first + j) + rotation[dev]]);
+            sumY[firstNet[first + j]] += sign*(pos.y + pinY[4*(first + j) + rotation[dev]]);
+        }
+    };
+    for (unsigned int i=0; i<nDevices; i++)
+        addPins(i, +1);
+
+    // devices which share a net (except the biggest ones, which are hardly
+    // affected by a single device) get different colours: the devices of
+    // the same colour are independent and are rotated in parallel; the
+    // devices with a single pin gain nothing from a rotation
+    std::vector<unsigned int> colour(nDevices, UINT_MAX), usedBy;
+    std::vector< std::vector<unsigned int> > batches;
+    for (unsigned int i=0; i<nDevices; i++)
+    {
+        if (hg.getDeviceDegree(i) < 2)
+            continue;
+
+        for (const unsigned int* net = hg.getDeviceNetsBegin(i); net != hg.getDeviceNetsEnd(i); net++)
+        {
+            if (hg.isIgnoredNet(*net) || hg.getNetDegree(*net) > ROTATION_MAX_NET_DEGREE)
+                continue;
+            for (const unsigned int* other = hg.getNetDevicesBegin(*net); other != hg.getNetDevicesEnd(*net); other++)
+                if (colour[*other] != UINT_MAX)
+                    usedBy[colour[*other]] = i;
+        }
+
+        unsigned int c = 0;
+        while (c < usedBy.size() && usedBy[c] == i)
+            c++;
+        if (c == usedBy.size())
+        {
+            usedBy.push_back(UINT_MAX);
+            batches.push_back(std::vector<unsigned int>());
+        }
+        colour[i] = c;
+        batches[c].push_back(i);
+    }
+
+    svOccupancyGrid occupied;
+    for (unsigned int i=0; i<nDevices; i++)
+        occupied.occupy(getDeviceCells(i, m_devices[i]->getGridPosition()));
+
+    std::vector<unsigned char> best;
+    for (unsigned int pass=0; pass<ROTATION_PASSES && !isPlacementStopped(); pass++)
+    {
+        size_t changed = 0;
+        for (size_t c=0; c<batches.size(); c++)
+        {
+            const std::vector<unsigned int>& batch = batches[c];
+            best.resize(batch.size());
+
+            // the cost of a rotation is the distance of the pins from the centers
+            // of the other pins of their nets, divided by its predisposition
+            svParallelFor(batch.size(),
+                [&](size_t begin, size_t end, unsigned int) {
+                    for (size_t k=begin; k<end; k++)
+                    {
+                        unsigned int i = batch[k];
+                        size_t first = hg.getDeviceNetsBegin(i) - firstNet;
+                        wxPoint pos = m_devices[i]->getGridPosition();
+
+                        double cost[4] = { 0, 0, 0, 0 };
+                        for (unsigned int j=0; j<hg.getDeviceDegree(i); j++)
+                        {
+                            unsigned int net = firstNet[first + j];
+                            unsigned int degree = hg.getNetDegree(net);
+                            if (hg.isIgnoredNet(net) || degree < 2)
+                                continue;
+
+                            const int* x = &pinX[4*(first + j)];
+                            const int* y = &pinY[4*(first + j)];
+                            double cx = double(sumX[net] - x[rotation[i]] - pos.x)/(degree - 1) - pos.x;
+                            double cy = double(sumY[net] - y[rotation[i]] - pos.y)/(degree - 1) - pos.y;
+                            for (unsigned int r=0; r<4; r++)
+                                cost[r] += fabs(x[r] - cx) + fabs(y[r] - cy);
+                        }
+
+                        const double* pred = &predisposition[4*i];
+                        double bestCost = pred[rotation[i]] > 0 ? cost[rotation[i]]/pred[rotation[i]] : DBL_MAX;
+                        best[k] = rotation[i];
+                        for (unsigned int r=0; r<4; r++)
+                            if (pred[r] > 0 && cost[r]/pred[r] < bestCost - 1e-9)
+                            {
+                                bestCost = cost[r]/pred[r];
+                                best[k] = r;
+                            }
+                    }
+                }, 0, 256);
+
+            // apply the rotations which don't make the device touch other ones
+            for (size_t k=0; k<batch.size(); k++)
+            {
+                unsigned int i = batch[k];
+                if (best[k] == rotation[i])
+                    continue;
+
+                wxPoint pos = m_devices[i]->getGridPosition();
+                wxRect current = footprint[4*i + rotation[i]], cells = footprint[4*i + best[k]];
+                current.Offset(pos);
+                cells.Offset(pos);
+
+                occupied.release(current);
+                if (occupied.isFree(wxRect(cells).Inflate(1, 1)))
+                {
+                    addPins(i, -1);
+                    rotation[i] = best[k];
+                    addPins(i, +1);
+                    occupied.occupy(cells);
+                    changed++;
+                }
+                else
+                    occupied.occupy(current);
+            }
+        }
+
+        if (changed == 0)
+            break;
+    }
+
+    for (unsigned int i=0; i<nDevices; i++)
+        m_devices[i]->setRotation(svRotation(rotation[i]));
+}
+
+// ----------------------------------------------------------------------------
+// svCircuit - crossing reduction
+// ----------------------------------------------------------------------------
+
+//! Returns the rectangle containing all the pins of the given circuit.
+static wxRect getPinsBoundingBox(const svCircuit& ckt)
+{
+    const svHyperGraph& hg = ckt.getHyperGraph();
+    wxPoint tl(INT_MAX, INT_MAX), br(INT_MIN, INT_MIN);
+    for (unsigned int net=0; net<hg.getNetsCount(); net++)
+        for (unsigned int k=0; k<hg.getNetDegree(net); k++)
+        {
+            wxPoint pt = ckt.getPinPosition(hg.getNetPin(net, k));
+            tl.x = std::min(tl.x, pt.x);
+            tl.y = std::min(tl.y, pt.y);
+            br.x = std::max(br.x, pt.x);
+            br.y = std::max(br.y, pt.y);
+        }
+    return tl.x > br.x ? wxRect() : wxRect(tl, br);
+}
+
+size_t svCircuit::getAirwireCrossingsCount() const
+{
+    if (getHyperGraph().getPinsCount() == 0)
+        return 0;
+    return svAirwireIndex(*this, getPinsBoundingBox(*this)).getCrossingsCount();
+}
+
+void svCircuit::reduceCrossings()
+{
+    const svHyperGraph& hg = getHyperGraph();
+    size_t nDevices = m_devices.size();
+    if (hg.getPinsCount() == 0)
+        return;
+
+    // swaps and rotations never move the devices out of their current cells,
+    // but rotations may move the pins out of the current bounding box of the
+    // pins: the index covers some more space
+    wxRect area = getPinsBoundingBox(*this).Inflate(2*CROSSING_CELL_SIZE, 2*CROSSING_CELL_SIZE);
+    svAirwireIndex index(*this, area);
+
+    // for each device pin, the index of the same pin in the net order
+    const unsigned int* firstNet = hg.getDeviceNetsBegin(0);
+    std::vector<unsigned int> netPinOf(hg.getPinsCount());
+    for (unsigned int net=0; net<hg.getNetsCount(); net++)
+        for (unsigned int k=0; k<hg.getNetDegree(net); k++)
+        {
+            svPinRef pin = hg.getNetPin(net, k);
+            netPinOf[hg.getDeviceNetsBegin(pin.device) - firstNet + pin.pin] = index.getFirstSegment(net) + k;
+        }
+
+    // the layout is divided in square regions: the devices whose nets lie
+    // entirely inside one region are moved by the thread which owns that
+    // region, and no other thread reads or writes those nets or the cells
+    // of the region; the regions are shifted by half their size at every
+    // other round, so that the devices near their borders get a chance too;
+    // larger regions leave fewer nets across their borders, so they're only
+    // as small as needed to give some work to each thread
+    const int cols = area.width/CROSSING_CELL_SIZE + 1, rows = area.height/CROSSING_CELL_SIZE + 1;
+    const int regionsPerSide = int(ceil(sqrt(2.0*svGetThreadsCount())));
+    const int regionCells = std::max(CROSSING_REGION_CELLS, (std::max(cols, rows) + regionsPerSide - 1)/regionsPerSide);
+    const int regionCols = cols/regionCells + 2;
+    const unsigned int noRegion = UINT_MAX;
+    std::vector<unsigned int> netRegion(hg.getNetsCount());
+    std::vector<unsigned char> marked(hg.getNetsCount(), 0);
+
+    auto getRegion = [&](const wxRect& cells, int shift) {
+        int c0 = (cells.GetLeft() + shift)/regionCells, c1 = (cells.GetRight() + shift)/regionCells;
+        int r0 = (cells.GetTop() + shift)/regionCells, r1 = (cells.GetBottom() + shift)/regionCells;
+        return c0 == c1 && r0 == r1 ? (unsigned int)(r0*regionCols + c0) : noRegion;
+    };
+
+    // the score of a group of nets: their crossings (with any other net) and
+    // their length; the crossings between two nets of the group count once
+    auto getScore = [&](const std::vector<unsigned int>& nets) {
+        size_t crossings = 0;
+        double length = 0;
+        for (size_t n=0; n<nets.size(); n++)
+        {
+            size_t first = index.getFirstSegment(nets[n]);
+            for (size_t s=first+1; s<first+hg.getNetDegree(nets[n]); s++)
+            {
+                length += index.getLength(s);
+                index.forEachCell(s, [&](size_t cell) {
+                    const std::vector<unsigned int>& segments = index.getCell(cell);
+                    for (size_t k=0; k<segments.size(); k++)
+                    {
+                        unsigned int t = segments[k];
+                        if (index.getNet(t) == nets[n] || (marked[index.getNet(t)] && t < s))
+                            continue;
+                        if (index.crosses(s, t, cell))
+                            crossings++;
+                    }
+                });
+            }
+        }
+        return CROSSING_WEIGHT*crossings + length;
+    };
+
+    // returns true if the airwires of the given device lie in the given region
+    auto isInside = [&](unsigned int dev, unsigned int region, int shift) {
+        for (unsigned int j=0; j<hg.getDeviceDegree(dev); j++)
+        {
+            unsigned int net = hg.getDeviceNetsBegin(dev)[j];
+            if (hg.isIgnoredNet(net) || hg.getNetDegree(net) < 2)
+                continue;
+
+            wxPoint pt = getPinPosition(svPinRef(dev, j));
+            wxRect cell(index.getCellColumn(pt.x), index.getCellRow(pt.y), 1, 1);
+            if (getRegion(cell, shift) != region)
+                return false;
+        }
+        return true;
+    };
+
+    // moves the airwires of the given device in the index
+    auto updatePins = [&](unsigned int dev) {
+        size_t first = hg.getDeviceNetsBegin(dev) - firstNet;
+        for (unsigned int j=0; j<hg.getDeviceDegree(dev); j++)
+        {
+            index.forEachSegmentOf(netPinOf[first + j], [&index](size_t s) { index.update(s); });
+        }
+    };
+
+    // rotating a device by 180 degrees mirrors its pins and swapping two
+    // devices with the same size exchanges their pins: both moves leave the
+    // occupied cells unchanged, so that they never cause overlaps
+    auto mirror = [this](unsigned int dev) {
+        svBaseDevice* d = m_devices[dev];
+        wxPoint topLeft = d->getGridPosition() + d->getRelativeBoundingBox().GetTopLeft();
+        d->setRotation(svRotation((d->getRotation() + 2) % 4));
+        d->setGridPosition(topLeft - d->getRelativeBoundingBox().GetTopLeft());
+    };
+    auto swap = [this](unsigned int a, unsigned int b) {
+        wxRect bbA = m_devices[a]->getRelativeBoundingBox(), bbB = m_devices[b]->getRelativeBoundingBox();
+        wxPoint topLeftA = m_devices[a]->getGridPosition() + bbA.GetTopLeft();
+        wxPoint topLeftB = m_devices[b]->getGridPosition() + bbB.GetTopLeft();
+        m_devices[a]->setGridPosition(topLeftB - bbA.GetTopLeft());
+        m_devices[b]->setGridPosition(topLeftA - bbB.GetTopLeft());
+    };
+
+    std::vector< std::pair<unsigned int, unsigned int> > regionDevices;
+    std::vector<size_t> improved(svGetThreadsCount(), 0);
+    for (unsigned int round=0; round<2*CROSSING_ROUNDS && !isPlacementStopped(); round++)
+    {
+        int shift = (round % 2)*regionCells/2;
+        if (shift == 0)
+            std::fill(improved.begin(), improved.end(), 0);
+
+        for (unsigned int net=0; net<hg.getNetsCount(); net++)
+        {
+            netRegion[net] = noRegion;
+            if (hg.isIgnoredNet(net) || hg.getNetDegree(net) < 2)
+                continue;
+
+            size_t first = index.getFirstSegment(net);
+            wxRect cells = index.getCellRange(first + 1);
+            for (size_t s=first+2; s<first+hg.getNetDegree(net); s++)
+                cells.Union(index.getCellRange(s));
+            netRegion[net] = getRegion(cells, shift);
+        }
+
+        // the devices which can be moved, grouped by region
+        regionDevices.clear();
+        for (unsigned int i=0; i<nDevices; i++)
+        {
+            unsigned int region = noRegion;
+            bool movable = true;
+            for (const unsigned int* net = hg.getDeviceNetsBegin(i); net != hg.getDeviceNetsEnd(i) && movable; net++)
+            {
+                if (hg.isIgnoredNet(*net) || hg.getNetDegree(*net) < 2)
+                    continue;
+                movable = netRegion[*net] != noRegion && (region == noRegion || region == netRegion[*net]);
+                region = netRegion[*net];
+            }
+            if (movable && region != noRegion)
+                regionDevices.push_back(std::make_pair(region, i));
+        }
+        std::sort(regionDevices.begin(), regionDevices.end());
+
+        std::vector<size_t> groups;
+        for (size_t k=0; k<regionDevices.size(); k++)
+            if (k == 0 || regionDevices[k].first != regionDevices[k-1].first)
+                groups.push_back(k);
+        groups.push_back(regionDevices.size());
+
+        svParallelFor(groups.size() - 1,
+            [&](size_t begin, size_t end, unsigned int threadIdx) {
+                std::vector<unsigned int> nets;
+                std::vector< std::pair<int, unsigned int> > candidates, byColumn;
+                for (size_t g=begin; g<end; g++)
+                {
+                    unsigned int region = regionDevices[groups[g]].first;
+
+                    // the devices of the region sorted by their leftmost cell,
+                    // so that the swap candidates are found in a window
+                    byColumn.clear();
+                    for (size_t k=groups[g]; k<groups[g+1]; k++)
+                    {
+                        unsigned int dev = regionDevices[k].second;
+                        byColumn.push_back(std::make_pair(getDeviceCells(dev, m_devices[dev]->getGridPosition()).x, dev));
+                    }
+                    std::sort(byColumn.begin(), byColumn.end());
+
+                    // tries the given move (b == a for a mirroring) and keeps it
+                    // only if it improves the score of the nets involved
+                    auto tryMove = [&](unsigned int a, unsigned int b) {
+                        nets.clear();
+                        for (unsigned int dev : { a, b })
+                            for (const unsigned int* net = hg.getDeviceNetsBegin(dev); net != hg.getDeviceNetsEnd(dev); net++)
+                                if (netRegion[*net] == region && !marked[*net])
+                                {
+                                    marked[*net] = 1;
+                                    nets.push_back(*net);
+                                }
+
+                        // the airwires must stay in the region before they are
+                        // moved in the index: the cells of the other regions
+                        // belong to other threads
+                        double before = getScore(nets);
+                        if (a == b) mirror(a); else swap(a, b);
+                        bool keep = isInside(a, region, shift) && isInside(b, region, shift);
+                        if (keep)
+                        {
+                            updatePins(a);
+                            updatePins(b);
+                            keep = getScore(nets) < before - 1e-6;
+                        }
+                        if (!keep)
+                        {
+                            if (a == b) mirror(a); else swap(a, b);
+                            updatePins(a);
+                            updatePins(b);
+                        }
+
+                        for (size_t n=0; n<nets.size(); n++)
+                            marked[nets[n]] = 0;
+                        return keep;
+                    };
+
+                    for (size_t k=0; k<byColumn.size(); k++)
+                    {
+                        unsigned int a = byColumn[k].second;
+                        wxRect bbA = getDeviceCells(a, m_devices[a]->getGridPosition());
+
+                        // where many airwires pass moving single devices hardly helps
+                        // and counting the crossings is expensive
+                        size_t load = 0, cells = 0;
+                        for (const unsigned int* net = hg.getDeviceNetsBegin(a); net != hg.getDeviceNetsEnd(a); net++)
+                        {
+                            if (netRegion[*net] != region)
+                                continue;
+
+                            size_t first = index.getFirstSegment(*net);
+                            for (size_t s=first+1; s<first+hg.getNetDegree(*net); s++)
+                                index.forEachCell(s, [&](size_t cell) {
+                                    load += index.getCell(cell).size();
+                                    cells++;
+                                });
+                        }
+                        if (load > cells*CROSSING_MAX_CELL_SEGMENTS)
+                            continue;
+
+                        svRotation mirrored = svRotation((m_devices[a]->getRotation() + 2) % 4);
+                        if (m_devices[a]->getRotationPredisposition(mirrored) > 0 && tryMove(a, a))
+                            improved[threadIdx]++;
+
+                        // only the closest devices of the same size are tried:
+                        // in dense layouts there would be too many candidates;
+                        // the devices on the left were tried when their turn came
+                        candidates.clear();
+                        for (size_t h=k+1; h<byColumn.size() && byColumn[h].first - byColumn[k].first <= CROSSING_SWAP_DISTANCE; h++)
+                        {
+                            unsigned int b = byColumn[h].second;
+                            wxRect bbB = getDeviceCells(b, m_devices[b]->getGridPosition());
+                            int dist = abs(bbA.x - bbB.x) + abs(bbA.y - bbB.y);
+                            if (bbA.width == bbB.width && bbA.height == bbB.height &&
+                                dist <= CROSSING_SWAP_DISTANCE)
+                                candidates.push_back(std::make_pair(dist, b));
+                        }
+                        size_t nCandidates = std::min<size_t>(candidates.size(), CROSSING_SWAP_CANDIDATES);
+                        std::partial_sort(candidates.begin(), candidates.begin() + nCandidates, candidates.end());
+
+                        for (size_t h=0; h<nCandidates; h++)
+                            if (tryMove(a, candidates[h].second))
+                                improved[threadIdx]++;
+                    }
+                }
+            }, 0, 1);
+
+        if (isSnapshotDue())
+            publishProgress();
+
+        size_t total = 0;
+        for (size_t i=0; i<improved.size(); i++)
+            total += improved[i];
+        if (total == 0 && shift != 0)
+            break;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// svLayoutStore
+// ----------------------------------------------------------------------------
+
+//! Returns the devices of the given circuit sorted by their structural labels
+//! (ties are broken by their index) and fills @a labels with the sorted labels.
+static std::vector<unsigned int> getStructuralOrder(const svCircuit& ckt, unsigned long long* hash,
+                                                    std::vector<unsigned long long>& labels)
+{
+    std::vector<unsigned long long> deviceLabels;
+    *hash = ckt.getStructuralHash(&deviceLabels);
+
+    std::vector< std::pair<unsigned long long, unsigned int> > sorted(deviceLabels.size());
+    for (unsigned int i=0; i<deviceLabels.size(); i++)
+        sorted[i] = std::make_pair(deviceLabels[i], i);
+    std::sort(sorted.begin(), sorted.end());
+
+    std::vector<unsigned int> order(sorted.size());
+    labels.resize(sorted.size());
+    for (size_t k=0; k<sorted.size(); k++)
+    {
+        labels[k] = sorted[k].first;
+        order[k] = sorted[k].second;
+    }
+    return order;
+}
+
+void svLayoutStore::store(const svCircuit& ckt)
+{
+    unsigned long long hash;
+    Layout layout;
+    std::vector<unsigned int> order = getStructuralOrder(ckt, &hash, layout.labels);
+
+    const svBaseDeviceArray& devices = ckt.getDevices();
+    layout.positions.resize(order.size());
+    layout.rotations.resize(order.size());
+    for (size_t k=0; k<order.size(); k++)
+    {
+        layout.positions[k] = devices[order[k]]->getGridPosition();
+        layout.rotations[k] = devices[order[k]]->getRotation();
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_layouts[hash] = layout;
+}
+
+bool svLayoutStore::apply(svCircuit& ckt) const
+{
+    unsigned long long hash;
+    std::vector<unsigned long long> labels;
+    std::vector<unsigned int> order = getStructuralOrder(ckt, &hash, labels);
+
+    Layout layout;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::unordered_map<unsigned long long, Layout>::const_iterator it = m_layouts.find(hash);
+        if (it == m_layouts.end())
+            return false;
+        layout = it->second;
+    }
+
+    // devices with the same label have the same kind and size: if all labels
+    // match (i.e. the hash didn't collide) the layout has no overlaps
+    if (layout.labels != labels)
+        return false;
+
+    const svBaseDeviceArray& devices = ckt.getDevices();
+    for (size_t k=0; k<order.size(); k++)
+    {
+        devices[order[k]]->setRotation(layout.rotations[k]);
+        devices[order[k]]->setGridPosition(layout.positions[k]);
+    }
+    ckt.updateBoundingBox();
+    return true;
+}
+
+size_t svLayoutStore::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_layouts.size();
+}
+
+void svLayoutStore::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_layouts.clear();
+}
+
+// ----------------------------------------------------------------------------
+// hierarchical placement
+// ----------------------------------------------------------------------------
+
+//! Gives to the subcircuit instances of the given circuit the layout of their
+//! definitions, if they're already placed.
+static void updateMacros(svCircuit& ckt, const svCircuitArray& circuits,
+                         const std::map<std::string, size_t>& byName,
+                         const std::vector<bool>& placed)
+{
+    const svBaseDeviceArray& devices = ckt.getDevices();
+    for (size_t i=0; i<devices.size(); i++)
+    {
+        svSubcircuitInstance* inst = dynamic_cast<svSubcircuitInstance*>(devices[i]);
+        if (!inst)
+            continue;
+
+        std::map<std::string, size_t>::const_iterator it = byName.find(inst->getSubcircuitName());
+        if (it == byName.end() || !placed[it->second])
+            continue;
+
+        // the pins of the instance are the external pins of the definition,
+        // in the same order
+        const svCircuit& def = circuits[it->second];
+        std::vector<wxPoint> pins;
+        wxRect box;
+        for (size_t j=0; j<def.getDevices().size(); j++)
+        {
+            box.Union(def.getDeviceCells(j, def.getDevices()[j]->getGridPosition()));
+            if (dynamic_cast<const svExternalPin*>(def.getDevices()[j]))
+                pins.push_back(def.getDevices()[j]->getGridPosition());
+        }
+
+        if (pins.size() != inst->getNodesCount())
+        {
+            wxLogWarning("The instance '%s' of subcircuit '%s' has %u nodes instead of %u",
+                         inst->getSPICEName(), def.getName(), inst->getNodesCount(), (unsigned int)pins.size());
+            continue;
+        }
+
+        wxPoint origin = pins[0];
+        for (size_t k=0; k<pins.size(); k++)
+            pins[k] -= origin;
+        box.Offset(-origin.x, -origin.y);
+        inst->setMacro(pins, box);
+    }
+}
+
+//! Places the given circuit, or gives it the layout of a circuit with the same
+//! structure if the given store (if any) has one.
+static void placeDefinition(svCircuit& ckt, svPlaceAlgorithm ag, svLayoutStore* store)
+{
+    if (store && store->apply(ckt))
+        return;
+
+    ckt.placeDevices(ag);
+    if (store)
+        store->store(ckt);
+}
+
+size_t svPlaceHierarchy(svCircuitArray& circuits, svPlaceAlgorithm ag, svLayoutStore* store,
+                        size_t maxTopLevelDevices)
+{
+    size_t n = circuits.size();
+
+    // SPICE names are case-insensitive; the first definition of a name wins
+    std::map<std::string, size_t> byName;
+    for (size_t i=0; i<n; i++)
+        byName.insert(std::make_pair(wxString(circuits[i].getName()).Lower().ToStdString(), i));
+
+    // the hierarchy DAG: each definition depends on the ones it instantiates
+    std::vector< std::vector<size_t> > parents(n);
+    std::vector<unsigned int> pending(n, 0);
+    std::vector<bool> instantiated(n, false);
+    for (size_t i=0; i<n; i++)
+    {
+        std::vector<size_t> children;
+        const svBaseDeviceArray& devices = circuits[i].getDevices();
+        for (size_t j=0; j<devices.size(); j++)
+        {
+            const svSubcircuitInstance* inst = dynamic_cast<const svSubcircuitInstance*>(devices[j]);
+            std::map<std::string, size_t>::const_iterator it;
+            if (inst && (it = byName.find(inst->getSubcircuitName())) != byName.end())
+                children.push_back(it->second);
+        }
+
+        std::sort(children.begin(), children.end());
+        children.erase(std::unique(children.begin(), children.end()), children.end());
+        for (size_t k=0; k<children.size(); k++)
+        {
+            parents[children[k]].push_back(i);
+            instantiated[children[k]] = true;
+        }
+        pending[i] = children.size();
+    }
+
+    // place the definitions level by level: the definitions whose children
+    // have all been placed don't depend on each other
+    std::vector<size_t> level, next;
+    std::vector<bool> placed(n, false);
+    for (size_t i=0; i<n; i++)
+        if (pending[i] == 0)
+            level.push_back(i);
+
+    while (!level.empty())
+    {
+        for (size_t k=0; k<level.size(); k++)
+            updateMacros(circuits[level[k]], circuits, byName, placed);
+
+        // the top-level definitions too large to be placed are left to the caller
+        std::vector<size_t> candidates;
+        for (size_t k=0; k<level.size(); k++)
+            if (instantiated[level[k]] || maxTopLevelDevices == 0 ||
+                circuits[level[k]].getDevices().size() <= maxTopLevelDevices)
+                candidates.push_back(level[k]);
+
+        // the definitions with the same structure of another one of their level
+        // wait for its layout instead of being placed at the same time
+        std::vector<size_t> todo, copies;
+        if (store)
+        {
+            std::vector<unsigned long long> hashes(candidates.size());
+            svParallelFor(candidates.size(),
+                [&](size_t begin, size_t end, unsigned int) {
+                    for (size_t k=begin; k<end; k++)
+                        hashes[k] = circuits[candidates[k]].getStructuralHash();
+                }, 0, 1);
+
+            std::set<unsigned long long> seen;
+            for (size_t k=0; k<candidates.size(); k++)
+                (seen.insert(hashes[k]).second ? todo : copies).push_back(candidates[k]);
+        }
+        else
+            todo = candidates;
+
+        svParallelFor(todo.size(),
+            [&](size_t begin, size_t end, unsigned int) {
+                for (size_t k=begin; k<end; k++)
+                    placeDefinition(circuits[todo[k]], ag, store);
+            }, 0, 1);
+        for (size_t k=0; k<copies.size(); k++)
+            placeDefinition(circuits[copies[k]], ag, store);
+
+        next.clear();
+        for (size_t k=0; k<level.size(); k++)
+        {
+            placed[level[k]] = true;
+            for (size_t p=0; p<parents[level[k]].size(); p++)
+                if (--pending[parents[level[k]][p]] == 0)
+                    next.push_back(parents[level[k]][p]);
+        }
+        level.swap(next);
+    }
+
+    // recursive definitions are not valid SPICE: place them anyway, with the
+    // layouts available
+    for (size_t i=0; i<n; i++)
+        if (!placed[i])
+        {
+            wxLogWarning("The subcircuit '%s' instantiates itself (directly or not)", circuits[i].getName());
+            updateMacros(circuits[i], circuits, byName, placed);
+            if (instantiated[i] || maxTopLevelDevices == 0 ||
+                circuits[i].getDevices().size() <= maxTopLevelDevices)
+                placeDefinition(circuits[i], ag, store);
+            placed[i] = true;
+        }
+
+    for (size_t i=0; i<n; i++)
+        if (!instantiated[i])
+            return i;
+    return 0;
+}
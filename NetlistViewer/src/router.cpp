@@ -0,0 +1,684 @@
+/////////////////////////////////////////////////////////////////////////////
+// Name:        router.cpp
+// Purpose:     routing of the nets with orthogonal wires
+// Author:      Francesco Montorsi
+// Created:     18/10/2026
+// Copyright:   (c) 2026 Francesco Montorsi
+// Licence:     GPL licence
+/////////////////////////////////////////////////////////////////////////////
+
+// ============================================================================
+// declarations
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// headers
+// ----------------------------------------------------------------------------
+
+#include <wx/wx.h>
+
+#include <limits.h>
+#include <math.h>
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+
+#include "netlist.h"
+#include "devices.h"
+#include "parallel.h"
+
+// ----------------------------------------------------------------------------
+// constants
+// ----------------------------------------------------------------------------
+
+// the wires run on a grid finer than the one of the devices, with this
+// number of tracks per cell: so that more than one wire fits in the gap
+// between two devices placed side by side
+#define ROUTER_TRACKS               2
+
+// the wires can run in this number of free cells around the devices
+#define ROUTER_MARGIN               4
+
+// the connections of a net are searched in the bounding box of its pins,
+// enlarged by this number of cells; only if that fails the whole routing
+// grid is searched
+#define ROUTER_WINDOW_MARGIN        4
+
+// the cost of a bend and of crossing another net, compared to the cost
+// of one track of wire
+#define ROUTER_BEND_COST            2.0f
+#define ROUTER_CROSSING_COST        3.0f
+
+// rip-up and reroute with negotiated congestion: the cost of sharing an edge
+// of the grid with another net starts at ROUTER_PRESENT_COST and grows by
+// ROUTER_PRESENT_GROWTH at each iteration, while the edges still shared at the
+// end of an iteration become more expensive by ROUTER_HISTORY_COST for good
+#define ROUTER_ITERATIONS           12
+#define ROUTER_PRESENT_COST         1.0f
+#define ROUTER_PRESENT_GROWTH       2.0f
+#define ROUTER_HISTORY_COST         1.0f
+
+// the iterations stop early when more than this fraction of the nets still
+// conflict and less than this fraction of them was solved by the last one
+#define ROUTER_MIN_PROGRESS         0.05
+
+// the routing grid is divided in square regions of at least this many tracks:
+// the nets which lie inside a region are routed by the thread owning it
+#define ROUTER_REGION_CELLS         64
+
+
+// ============================================================================
+// implementation
+// ============================================================================
+
+// ----------------------------------------------------------------------------
+// helper functions
+// ----------------------------------------------------------------------------
+
+//! Converts a point of the grid of the devices to the routing grid.
+static wxPoint toTracks(const wxPoint& pt)
+{
+    return wxPoint(pt.x*ROUTER_TRACKS, pt.y*ROUTER_TRACKS);
+}
+
+//! Converts a point computed by fromTracks() back to the routing grid.
+static wxPoint toTracks(const wxRealPoint& pt)
+{
+    return wxPoint(wxRound(pt.x*ROUTER_TRACKS), wxRound(pt.y*ROUTER_TRACKS));
+}
+
+//! Converts a rectangle of cells of the grid of the devices to the routing grid.
+static wxRect toTracks(const wxRect& rc)
+{
+    return wxRect(toTracks(rc.GetTopLeft()), toTracks(rc.GetBottomRight()));
+}
+
+//! Converts a point of the routing grid to the grid of the devices.
+static wxRealPoint fromTracks(const wxPoint& pt)
+{
+    return wxRealPoint(double(pt.x)/ROUTER_TRACKS, double(pt.y)/ROUTER_TRACKS);
+}
+
+//! Returns the cells of the grid of the devices covering the given rectangle
+//! of the routing grid.
+static wxRect fromTracks(const wxRect& rc)
+{
+    return svWire(fromTracks(rc.GetTopLeft()), fromTracks(rc.GetBottomRight())).getCells();
+}
+
+// ----------------------------------------------------------------------------
+// helper classes
+// ----------------------------------------------------------------------------
+
+//! The points of the routing grid where the wires can run, with the nets using
+//! each of them.
+//! The edge from a point to the one on its right has index 2*point, the edge
+//! to the point below has index 2*point+1.
+struct svRoutingGrid
+{
+    enum { FREE, BODY, PIN };
+
+    wxRect area;
+    std::vector<unsigned char> kind;            // FREE, BODY or PIN
+    std::unordered_map<unsigned int, unsigned int> pinNet;  // the net of each PIN point
+    std::vector<unsigned short> use;            // the nets using each edge
+    std::vector<float> history;                 // the congestion of each edge in the past
+    std::vector<unsigned short> pointUse;       // the nets passing through each point
+
+    void init(const wxRect& rc)
+        {
+            size_t n = size_t(rc.width)*rc.height;
+            area = rc;
+            kind.assign(n, FREE);
+            pinNet.clear();
+            use.assign(2*n, 0);
+            history.assign(2*n, 0);
+            pointUse.assign(n, 0);
+        }
+
+    unsigned int getIndex(const wxPoint& pt) const
+        { return (pt.y - area.y)*area.width + (pt.x - area.x); }
+    wxPoint getPoint(unsigned int idx) const
+        { return wxPoint(area.x + int(idx % area.width), area.y + int(idx / area.width)); }
+
+    //! Returns the index of the edge between the two given (adjacent) points.
+    static unsigned int getEdge(unsigned int a, unsigned int b)
+        {
+            if (a > b)
+                std::swap(a, b);
+            return 2*a + (b - a == 1 ? 0 : 1);
+        }
+
+    //! Returns true if the wires of @a net can pass through the given point.
+    bool isOpenTo(unsigned int idx, unsigned int net) const
+        {
+            if (kind[idx] == FREE)
+                return true;
+            if (kind[idx] == BODY)
+                return false;
+            return pinNet.find(idx)->second == net;
+        }
+
+    //! Adds (or removes, if @a delta is negative) the given wire to the usage
+    //! counters of the grid; only its part inside the grid is considered.
+    void addWire(const wxPoint& from, const wxPoint& to, int delta)
+        {
+            wxRect rc = wxRect(from, to).Intersect(area);
+            if (rc.IsEmpty())
+                return;
+
+            bool vertical = from.x == to.x;
+            for (int y=rc.GetTop(); y<=rc.GetBottom(); y++)
+                for (int x=rc.GetLeft(); x<=rc.GetRight(); x++)
+                {
+                    unsigned int idx = getIndex(wxPoint(x, y));
+                    pointUse[idx] += delta;
+                    if (vertical ? y < rc.GetBottom() : x < rc.GetRight())
+                        use[2*idx + (vertical ? 1 : 0)] += delta;
+                }
+        }
+};
+
+//! The (partial) routing of a net.
+struct svNetRouting
+{
+    //! The paths of the connections, as lists of grid points: the first point
+    //! of each path is already part of the previous ones (or it's the first pin).
+    std::vector< std::vector<unsigned int> > paths;
+
+    //! The edges and the points used by the paths, without duplicates.
+    std::vector<unsigned int> edges, points;
+
+    //! The pins which could not be reached.
+    std::vector<unsigned int> unreached;
+
+    void addUsage(svRoutingGrid& grid, int delta) const
+        {
+            for (size_t k=0; k<edges.size(); k++)
+                grid.use[edges[k]] += delta;
+            for (size_t k=0; k<points.size(); k++)
+                grid.pointUse[points[k]] += delta;
+        }
+};
+
+//! An A* search for the cheapest path on a routing grid, where the cost of a
+//! path depends on its length, its bends, the nets it crosses and the edges it
+//! shares with other nets. The search states are (point, direction) pairs,
+//! since the cost of a move depends on the direction of the previous one.
+//! The buffers are reused from one search to the next one.
+class svMazeSearch
+{
+    std::vector<float> m_cost;
+    std::vector<unsigned int> m_parent;
+    std::vector<unsigned int> m_stamp;
+    unsigned int m_run;
+
+public:
+    svMazeSearch()
+        { m_run = 0; }
+
+    //! Finds the cheapest path of @a net from one of the @a sources to the
+    //! @a target point without leaving @a window; returns false if there's none.
+    //! The path is returned from the source to the target.
+    bool findPath(const svRoutingGrid& grid, const wxRect& window, unsigned int net,
+                  const std::vector<unsigned int>& sources, unsigned int target,
+                  float presentCost, std::vector<unsigned int>& path)
+    {
+        static const int dx[4] = { 1, 0, -1, 0 }, dy[4] = { 0, 1, 0, -1 };
+
+        size_t nStates = size_t(window.width)*window.height*4;
+        if (m_stamp.size() < nStates)
+        {
+            m_cost.resize(nStates);
+            m_parent.resize(nStates);
+            m_stamp.resize(nStates, 0);
+        }
+        if (++m_run == 0)
+        {
+            std::fill(m_stamp.begin(), m_stamp.end(), 0);
+            m_run = 1;
+        }
+
+        const wxPoint to = grid.getPoint(target);
+        auto getState = [&window](const wxPoint& pt, int dir) {
+            return (unsigned int)(((pt.y - window.y)*window.width + (pt.x - window.x))*4 + dir);
+        };
+        auto getPoint = [&window](unsigned int state) {
+            unsigned int cell = state/4;
+            return wxPoint(window.x + int(cell % window.width), window.y + int(cell / window.width));
+        };
+        auto getDistance = [&to](const wxPoint& pt) {
+            return float(abs(pt.x - to.x) + abs(pt.y - to.y));
+        };
+
+        typedef std::pair<float, unsigned int> Entry;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > heap;
+        for (size_t k=0; k<sources.size(); k++)
+        {
+            wxPoint pt = grid.getPoint(sources[k]);
+            if (!window.Contains(pt))
+                continue;
+            for (int dir=0; dir<4; dir++)
+            {
+                unsigned int s = getState(pt, dir);
+                m_cost[s] = 0;
+                m_parent[s] = UINT_MAX;
+                m_stamp[s] = m_run;
+                heap.push(Entry(getDistance(pt), s));
+            }
+        }
+
+        while (!heap.empty())
+        {
+            Entry top = heap.top();
+            heap.pop();
+
+            unsigned int s = top.second;
+            wxPoint pt = getPoint(s);
+            float cost = m_cost[s];
+            if (top.first > cost + getDistance(pt) + 1e-3f)
+                continue;       // a cheaper path to this state was found after pushing it
+
+            if (pt == to)
+            {
+                path.clear();
+                for (; s != UINT_MAX; s = m_parent[s])
+                    path.push_back(grid.getIndex(getPoint(s)));
+                std::reverse(path.begin(), path.end());
+                return true;
+            }
+
+            unsigned int idx = grid.getIndex(pt);
+            int dir = s % 4;
+            for (int next=0; next<4; next++)
+            {
+                if (next == (dir + 2) % 4)
+                    continue;       // going back is never useful
+
+                wxPoint npt(pt.x + dx[next], pt.y + dy[next]);
+                if (!window.Contains(npt))
+                    continue;
+
+                unsigned int nidx = grid.getIndex(npt);
+                if (!grid.isOpenTo(nidx, net))
+                    continue;
+
+                unsigned int edge = svRoutingGrid::getEdge(idx, nidx);
+                float ncost = cost + 1 + grid.use[edge]*presentCost + grid.history[edge];
+                if (next != dir)
+                    ncost += ROUTER_BEND_COST;
+                if (grid.pointUse[nidx] > 0)
+                    ncost += ROUTER_CROSSING_COST;
+
+                unsigned int ns = getState(npt, next);
+                if (m_stamp[ns] != m_run || ncost < m_cost[ns])
+                {
+                    m_cost[ns] = ncost;
+                    m_parent[ns] = s;
+                    m_stamp[ns] = m_run;
+                    heap.push(Entry(ncost + getDistance(npt), ns));
+                }
+            }
+        }
+
+        return false;
+    }
+};
+
+//! Routes the given pins of @a net (as grid points, ordered so that each
+//! pin is close to the previous ones) connecting each of them to the wires
+//! already routed. Returns false if some pin could not be reached.
+static bool routeNet(const svRoutingGrid& grid, svMazeSearch& search, unsigned int net,
+                     const std::vector<unsigned int>& pins, const wxRect& window,
+                     float presentCost, svNetRouting& ret)
+{
+    ret.paths.clear();
+    ret.unreached.clear();
+
+    std::vector<unsigned int> tree(1, pins[0]), path;
+    for (size_t k=1; k<pins.size(); k++)
+    {
+        if (std::find(tree.begin(), tree.end(), pins[k]) != tree.end())
+            continue;       // the wires already pass through this pin
+
+        if (!search.findPath(grid, window, net, tree, pins[k], presentCost, path))
+        {
+            ret.unreached.push_back(pins[k]);
+            continue;
+        }
+
+        tree.insert(tree.end(), path.begin() + 1, path.end());
+        ret.paths.push_back(path);
+    }
+
+    ret.edges.clear();
+    ret.points.clear();
+    for (size_t p=0; p<ret.paths.size(); p++)
+    {
+        const std::vector<unsigned int>& path = ret.paths[p];
+        for (size_t k=1; k<path.size(); k++)
+        {
+            ret.edges.push_back(svRoutingGrid::getEdge(path[k-1], path[k]));
+            ret.points.push_back(path[k]);
+        }
+    }
+    ret.points.push_back(pins[0]);
+    std::sort(ret.edges.begin(), ret.edges.end());
+    ret.edges.erase(std::unique(ret.edges.begin(), ret.edges.end()), ret.edges.end());
+    std::sort(ret.points.begin(), ret.points.end());
+    ret.points.erase(std::unique(ret.points.begin(), ret.points.end()), ret.points.end());
+
+    return ret.unreached.empty();
+}
+
+// ----------------------------------------------------------------------------
+// svCircuit - routing
+// ----------------------------------------------------------------------------
+
+size_t svCircuit::routeNets(const std::vector<unsigned int>& which)
+{
+    const svHyperGraph& hg = getHyperGraph();
+    size_t nNets = hg.getNetsCount();
+    if (m_routesValid.size() != nNets)
+    {
+        m_routes.assign(nNets, svRoute());
+        m_routesValid.assign(nNets, false);
+        m_routeIndex.clear();
+    }
+
+    std::vector<unsigned int> nets;
+    if (which.empty())
+    {
+        for (unsigned int net=0; net<nNets; net++)
+            nets.push_back(net);
+        m_routesValid.assign(nNets, false);
+    }
+    else
+        nets = which;
+
+    // the pins of each net, ordered as a (breadth-first) visit of their
+    // spanning tree, and the bounding box of its pins, where its wires
+    // are searched first
+    std::vector< std::vector<wxPoint> > pins(nets.size());
+    std::vector<wxRect> windows(nets.size());
+    wxRect area;
+    std::vector<unsigned int> parent, queue;
+    for (size_t n=0; n<nets.size(); n++)
+    {
+        setRoute(nets[n], svRoute());
+        m_routesValid[nets[n]] = true;
+        if (hg.isIgnoredNet(nets[n]) || hg.getNetDegree(nets[n]) < 2)
+            continue;
+
+        std::vector<wxPoint> pts = getDeviceNodesConnectedTo(nets[n]);
+        std::sort(pts.begin(), pts.end(), [](const wxPoint& a, const wxPoint& b) {
+            return a.x < b.x || (a.x == b.x && a.y < b.y);
+        });
+        pts.erase(std::unique(pts.begin(), pts.end()), pts.end());
+        if (pts.size() < 2)
+            continue;
+        for (size_t k=0; k<pts.size(); k++)
+            pts[k] = toTracks(pts[k]);
+
+        svGetRectilinearMST(pts, parent);
+        queue.assign(1, 0);
+        for (size_t head=0; head<queue.size(); head++)
+            for (unsigned int k=1; k<pts.size(); k++)
+                if (parent[k] == queue[head])
+                    queue.push_back(k);
+        for (size_t k=0; k<queue.size(); k++)
+            pins[n].push_back(pts[queue[k]]);
+
+        wxRect bb(pts[0], pts[0]);
+        for (size_t k=1; k<pts.size(); k++)
+            bb.Union(wxRect(pts[k], pts[k]));
+        windows[n] = bb.Inflate(ROUTER_WINDOW_MARGIN*ROUTER_TRACKS, ROUTER_WINDOW_MARGIN*ROUTER_TRACKS);
+        area = area.IsEmpty() ? windows[n] : area.Union(windows[n]);
+    }
+    if (area.IsEmpty())
+        return 0;
+
+    // the grid covers the nets to route (but not much more than the devices)
+    svRoutingGrid grid;
+    wxRect bb(m_bb.GetTopLeft(), m_bb.GetTopLeft() + wxPoint(m_bb.width, m_bb.height));
+    area.Intersect(toTracks(bb).Inflate(ROUTER_MARGIN*ROUTER_TRACKS, ROUTER_MARGIN*ROUTER_TRACKS));
+    grid.init(area);
+    for (size_t n=0; n<nets.size(); n++)
+        windows[n].Intersect(area);
+
+    // only the devices and the wires inside the grid matter
+    std::vector<unsigned int> found;
+    getOccupancy();
+    m_deviceIndex.query(fromTracks(area), found);
+    for (size_t k=0; k<found.size(); k++)
+    {
+        // the pins lie on the border of the cells of their device
+        unsigned int i = found[k];
+        wxRect cells = toTracks(getDeviceCells(i, m_devices[i]->getGridPosition()));
+        if (!cells.Intersects(area))
+            continue;
+
+        cells.Intersect(area);
+        for (int y=cells.GetTop(); y<=cells.GetBottom(); y++)
+            for (int x=cells.GetLeft(); x<=cells.GetRight(); x++)
+                grid.kind[grid.getIndex(wxPoint(x, y))] = svRoutingGrid::BODY;
+        for (unsigned int j=0; j<hg.getDeviceDegree(i); j++)
+        {
+            wxPoint pt = toTracks(getPinPosition(svPinRef(i, j)));
+            if (!area.Contains(pt))
+                continue;
+            grid.kind[grid.getIndex(pt)] = svRoutingGrid::PIN;
+            grid.pinNet[grid.getIndex(pt)] = hg.getDeviceNetsBegin(i)[j];
+        }
+    }
+
+    // the wires of the nets which are not rerouted are obstacles
+    std::vector<bool> rerouted(nNets, false);
+    for (size_t n=0; n<nets.size(); n++)
+        rerouted[nets[n]] = true;
+    m_routeIndex.query(fromTracks(area), found);
+    for (size_t k=0; k<found.size(); k++)
+    {
+        unsigned int net = found[k];
+        if (m_routesValid[net] && !rerouted[net])
+            for (size_t j=0; j<m_routes[net].wires.size(); j++)
+                grid.addWire(toTracks(m_routes[net].wires[j].from), toTracks(m_routes[net].wires[j].to), +1);
+    }
+
+    // the short nets are routed first; each iteration reroutes the nets which
+    // share some edge with other ones
+    std::vector<unsigned int> todo;
+    std::vector< std::vector<unsigned int> > pinPoints(nets.size());
+    for (size_t n=0; n<nets.size(); n++)
+    {
+        for (size_t k=0; k<pins[n].size(); k++)
+            pinPoints[n].push_back(grid.getIndex(pins[n][k]));
+        if (pinPoints[n].size() > 1)
+            todo.push_back(n);
+    }
+    std::sort(todo.begin(), todo.end(), [&windows](unsigned int a, unsigned int b) {
+        return windows[a].width + windows[a].height < windows[b].width + windows[b].height;
+    });
+
+    unsigned int nThreads = svGetThreadsCount();
+    const int regionsPerSide = int(ceil(sqrt(2.0*nThreads)));
+    const int regionCells = std::max(ROUTER_REGION_CELLS, (std::max(area.width, area.height) + regionsPerSide - 1)/regionsPerSide);
+    const int regionCols = area.width/regionCells + 2;
+    auto getRegion = [&](const wxRect& rc, int shift) {
+        int c0 = (rc.GetLeft() - area.x + shift)/regionCells, c1 = (rc.GetRight() - area.x + shift)/regionCells;
+        int r0 = (rc.GetTop() - area.y + shift)/regionCells, r1 = (rc.GetBottom() - area.y + shift)/regionCells;
+        return c0 == c1 && r0 == r1 ? r0*regionCols + c0 : -1;
+    };
+
+    // the pins walled in by the devices can't be reached by any wire: since
+    // the wires are never obstacles for other nets, they're found out by the
+    // first search in the whole area and not searched again
+    std::vector< std::vector<unsigned int> > unreachable(nets.size());
+    std::vector<svNetRouting> routing(nets.size());
+    std::vector<svMazeSearch> searches(nThreads);
+    float presentCost = ROUTER_PRESENT_COST;
+    for (unsigned int iteration=0; iteration<ROUTER_ITERATIONS && !todo.empty(); iteration++)
+    {
+        for (size_t k=0; k<todo.size(); k++)
+            routing[todo[k]].addUsage(grid, -1);
+
+        // the nets lying inside a region are routed in parallel, each region by
+        // one thread: their searches and their wires never leave their region;
+        // the regions are shifted by half their size to catch more nets; the
+        // nets across the regions (or which need more space than their window)
+        // are routed at the end
+        std::vector<unsigned char> routed(todo.size(), 0);
+        for (int shift=0; nThreads > 1 && shift<regionCells; shift+=regionCells/2)
+        {
+            std::unordered_map<int, std::vector<unsigned int> > regionNets;
+            for (size_t k=0; k<todo.size(); k++)
+            {
+                int region = getRegion(windows[todo[k]], shift);
+                if (!routed[k] && region >= 0)
+                    regionNets[region].push_back(k);
+            }
+
+            std::vector< std::vector<unsigned int> > groups;
+            for (auto it = regionNets.begin(); it != regionNets.end(); ++it)
+                groups.push_back(it->second);
+            svParallelFor(groups.size(),
+                [&](size_t begin, size_t end, unsigned int threadIdx) {
+                    for (size_t g=begin; g<end; g++)
+                        for (size_t j=0; j<groups[g].size(); j++)
+                        {
+                            unsigned int k = groups[g][j], n = todo[k];
+                            if (routeNet(grid, searches[threadIdx], nets[n], pinPoints[n], windows[n], presentCost, routing[n]))
+                            {
+                                routing[n].addUsage(grid, +1);
+                                routed[k] = 1;
+                            }
+                        }
+                }, 0, 1);
+        }
+
+        for (size_t k=0; k<todo.size(); k++)
+        {
+            if (routed[k])
+                continue;
+
+            unsigned int n = todo[k];
+            if (!routeNet(grid, searches[0], nets[n], pinPoints[n], windows[n], presentCost, routing[n]) &&
+                !routeNet(grid, searches[0], nets[n], pinPoints[n], area, presentCost, routing[n]))
+            {
+                const std::vector<unsigned int>& lost = routing[n].unreached;
+                for (size_t j=0; j<lost.size(); j++)
+                    pinPoints[n].erase(std::find(pinPoints[n].begin(), pinPoints[n].end(), lost[j]));
+                unreachable[n].insert(unreachable[n].end(), lost.begin(), lost.end());
+            }
+            routing[n].addUsage(grid, +1);
+        }
+
+        // the shared edges become more expensive
+        for (size_t e=0; e<grid.use.size(); e++)
+            if (grid.use[e] > 1)
+                grid.history[e] += ROUTER_HISTORY_COST*(grid.use[e] - 1);
+        presentCost *= ROUTER_PRESENT_GROWTH;
+
+        std::vector<unsigned int> conflicts;
+        for (size_t k=0; k<todo.size(); k++)
+        {
+            const svNetRouting& r = routing[todo[k]];
+            for (size_t e=0; e<r.edges.size(); e++)
+                if (grid.use[r.edges[e]] > 1)
+                {
+                    conflicts.push_back(todo[k]);
+                    break;
+                }
+        }
+
+        // when the devices are too close to each other there isn't enough room
+        // for all the wires: stop as soon as many conflicts remain and they
+        // don't decrease anymore
+        bool stalled = conflicts.size() > todo.size()*(1 - ROUTER_MIN_PROGRESS) &&
+                       conflicts.size() > nets.size()*ROUTER_MIN_PROGRESS;
+        todo.swap(conflicts);
+        if (stalled)
+            break;
+    }
+
+    // each path becomes a list of straight wires; the pins which could not be
+    // reached are joined to the closest pin with an airwire
+    for (size_t n=0; n<nets.size(); n++)
+    {
+        svRoute route;
+        const svNetRouting& r = routing[n];
+        for (size_t p=0; p<r.paths.size(); p++)
+        {
+            const std::vector<unsigned int>& path = r.paths[p];
+            if (grid.kind[path[0]] != svRoutingGrid::PIN)
+                route.junctions.push_back(fromTracks(grid.getPoint(path[0])));
+
+            size_t start = 0;
+            for (size_t k=1; k<path.size(); k++)
+                if (k == path.size()-1 ||
+                    path[k+1] - path[k] != path[k] - path[k-1])
+                {
+                    route.wires.push_back(svWire(fromTracks(grid.getPoint(path[start])), fromTracks(grid.getPoint(path[k]))));
+                    start = k;
+                }
+        }
+
+        for (size_t k=0; k<unreachable[n].size(); k++)
+        {
+            wxPoint pt = grid.getPoint(unreachable[n][k]), closest = pins[n][0];
+            for (size_t j=1; j<pins[n].size(); j++)
+                if (abs(pins[n][j].x - pt.x) + abs(pins[n][j].y - pt.y) < abs(closest.x - pt.x) + abs(closest.y - pt.y) &&
+                    pins[n][j] != pt)
+                    closest = pins[n][j];
+            route.wires.push_back(svWire(fromTracks(closest), fromTracks(pt)));
+        }
+        setRoute(nets[n], route);
+    }
+
+    return todo.size();
+}
+
+void svCircuit::setRoute(unsigned int net, const svRoute& route)
+{
+    const std::vector<svWire>& old = m_routes[net].wires;
+    for (size_t k=0; k<old.size(); k++)
+        m_routeIndex.remove(net, old[k].getCells());
+
+    m_routes[net] = route;
+    for (size_t k=0; k<route.wires.size(); k++)
+        m_routeIndex.insert(net, route.wires[k].getCells());
+}
+
+size_t svCircuit::rerouteDirtyNets(wxRect* damaged)
+{
+    std::vector<unsigned int> dirty;
+    for (unsigned int net=0; net<m_routesValid.size(); net++)
+        if (!m_routesValid[net])
+            dirty.push_back(net);
+
+    // the area of the wires being replaced (which are out of date, but still
+    // there) and of the new ones
+    auto addWires = [this, &dirty, damaged]() {
+        for (size_t n=0; n<dirty.size(); n++)
+        {
+            const std::vector<svWire>& wires = m_routes[dirty[n]].wires;
+            for (size_t j=0; j<wires.size(); j++)
+            {
+                wxRect rc = wires[j].getCells();
+                *damaged = damaged->IsEmpty() ? rc : damaged->Union(rc);
+            }
+        }
+    };
+
+    if (damaged)
+    {
+        *damaged = wxRect();
+        addWires();
+    }
+
+    // NB: routeNets() would route all nets given an empty list
+    size_t conflicts = dirty.empty() ? 0 : routeNets(dirty);
+    if (damaged)
+        addWires();
+    return conflicts;
+}